@@ -0,0 +1,127 @@
+#!/usr/bin/env python3
+"""Builds the firmware in the debug and release environments and compares them: flash and RAM
+from the toolchain's size, and with -p, what the loop's logging costs in CPU cycles on the board.
+
+Run it from anywhere, it works in the repository root. See README.md.
+"""
+import argparse
+import glob
+import os
+import re
+import shutil
+import subprocess
+import sys
+import time
+
+ROOT = os.path.abspath(os.path.join(os.path.dirname(os.path.abspath(__file__)), ".."))
+
+SIZE_TOOL = "xtensa-esp32-elf-size"
+BENCHMARK_LINE = re.compile(rb"Log benchmark: (\d+) cycles/iteration, mean (\d+)")
+# LogBenchmark::run() prints within a few seconds of boot, printing its records takes most of it.
+BENCHMARK_TIMEOUT = 60
+
+
+def pio(*args, build_flags=None):
+    """Runs pio in the repository root, with extra build flags for every environment."""
+    env = dict(os.environ)
+    if build_flags:
+        env["PLATFORMIO_BUILD_FLAGS"] = build_flags
+    subprocess.run(["pio", "run", *args], cwd=ROOT, env=env, check=True)
+
+
+def find_size_tool():
+    """The size from PlatformIO's Xtensa toolchain, unless one is on the PATH."""
+    tool = shutil.which(SIZE_TOOL)
+    if tool:
+        return tool
+    packages = os.path.join(os.path.expanduser("~"), ".platformio", "packages")
+    for candidate in glob.glob(os.path.join(packages, "toolchain-xtensa-esp32*", "bin",
+                                            SIZE_TOOL + "*")):
+        return candidate
+    raise FileNotFoundError(f"{SIZE_TOOL} is neither on the PATH nor in {packages}")
+
+
+def firmware_size(size_tool, env_name):
+    """Returns text, data and bss of the environment's firmware.elf, as size prints them."""
+    elf = os.path.join(ROOT, ".pio", "build", env_name, "firmware.elf")
+    output = subprocess.run([size_tool, elf], check=True, capture_output=True, text=True).stdout
+    print(output.rstrip())
+    text, data, bss = (int(value) for value in output.splitlines()[1].split()[:3])
+    return text, data, bss
+
+
+def hard_reset(port):
+    """Pulses EN through RTS, like esptool, so the board boots with the port already open."""
+    port.dtr = False
+    port.rts = True
+    time.sleep(0.1)
+    port.rts = False
+
+
+def read_benchmark(port_name, baud):
+    """Resets the board and returns the best and mean cycles per iteration it prints."""
+    import serial
+
+    with serial.Serial(port_name, baud, timeout=0.1) as port:
+        hard_reset(port)
+        deadline = time.monotonic() + BENCHMARK_TIMEOUT
+        line = b""
+        while time.monotonic() < deadline:
+            line += port.read(256)
+            match = BENCHMARK_LINE.search(line)
+            if match:
+                return int(match.group(1)), int(match.group(2))
+            # Keep the tail, the line may be split across reads.
+            line = line[-128:]
+    raise TimeoutError(f"no benchmark line from {port_name} in {BENCHMARK_TIMEOUT} s")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("-e", "--envs", nargs="+", default=["debug", "release"],
+                        help="Environments to compare, the first is the baseline "
+                             "(default: debug release).")
+    parser.add_argument("-p", "--port",
+                        help="Serial port of a board to flash with -DLOG_BENCHMARK and time on.")
+    parser.add_argument("-b", "--baud", type=int, default=115200,
+                        help="The board's serial baud rate (default: 115200).")
+    args = parser.parse_args()
+
+    if args.port:
+        try:
+            import serial  # noqa: F401
+        except ImportError:
+            print("Error: -p needs pyserial (pip install pyserial).")
+            sys.exit(1)
+
+    size_tool = find_size_tool()
+    sizes = {}
+    for env_name in args.envs:
+        pio("-e", env_name)
+    for env_name in args.envs:
+        sizes[env_name] = firmware_size(size_tool, env_name)
+
+    cycles = {}
+    if args.port:
+        # A different set of flags, so pio rebuilds everything, after the sizes were read.
+        for env_name in args.envs:
+            pio("-e", env_name, "-t", "upload", "--upload-port", args.port,
+                build_flags="-DLOG_BENCHMARK")
+            cycles[env_name] = read_benchmark(args.port, args.baud)
+
+    baseline = args.envs[0]
+    base_text, base_data, base_bss = sizes[baseline]
+    print()
+    print(f"{'env':<12} {'flash':>9} {'ram':>9} {'vs ' + baseline:>12} {'cycles/it':>10} "
+          f"{'mean':>8}")
+    for env_name in args.envs:
+        text, data, bss = sizes[env_name]
+        # Initialized data is stored in flash and copied to RAM at boot.
+        flash = text + data
+        delta = flash - (base_text + base_data)
+        best, mean = cycles.get(env_name, ("-", "-"))
+        print(f"{env_name:<12} {flash:>9} {data + bss:>9} {delta:>+12} {best:>10} {mean:>8}")
+
+
+if __name__ == "__main__":
+    main()
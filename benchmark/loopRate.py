@@ -0,0 +1,73 @@
+#!/usr/bin/env python3
+"""Flashes the debug environment twice, once with the loop spinning as it did before it slept on
+wakeups (-DLOOP_POLLING) and once as it is, and prints the loop's iterations per second in each.
+
+Needs a board on -p and pyserial. See README.md.
+"""
+import argparse
+import re
+import sys
+import time
+
+from compare import hard_reset, pio
+
+LOOP_LINE = re.compile(rb"Loop: (\d+) iterations/s, busy us p50 (\d+), p99 (\d+), max (\d+)")
+# PhoneApp logs the loop's rate once a minute (kLoopStatsInterval). The first minute includes
+# booting and registering on the network, so it takes the second report.
+REPORTS = 2
+REPORT_TIMEOUT = 3 * 60
+
+VARIANTS = [("polling", "-DLOOP_POLLING"), ("wakeups", "")]
+
+
+def read_loop_rate(port_name, baud):
+    """Resets the board and returns the iterations/s and the busy time p50/p99/max it reports."""
+    import serial
+
+    with serial.Serial(port_name, baud, timeout=0.1) as port:
+        hard_reset(port)
+        deadline = time.monotonic() + REPORT_TIMEOUT
+        line = b""
+        reports = 0
+        while time.monotonic() < deadline:
+            line += port.read(256)
+            match = LOOP_LINE.search(line)
+            if match:
+                reports += 1
+                if reports == REPORTS:
+                    return tuple(int(value) for value in match.groups())
+                line = line[match.end():]
+            # Keep the tail, the line may be split across reads.
+            line = line[-160:]
+    raise TimeoutError(f"no loop report from {port_name} in {REPORT_TIMEOUT} s")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("-p", "--port", required=True, help="Serial port of the board.")
+    parser.add_argument("-b", "--baud", type=int, default=115200,
+                        help="The board's serial baud rate (default: 115200).")
+    parser.add_argument("-e", "--env", default="debug",
+                        help="Environment to build, it needs debug logging (default: debug).")
+    args = parser.parse_args()
+
+    try:
+        import serial  # noqa: F401
+    except ImportError:
+        print("Error: loopRate.py needs pyserial (pip install pyserial).")
+        sys.exit(1)
+
+    rates = {}
+    for name, build_flags in VARIANTS:
+        pio("-e", args.env, "-t", "upload", "--upload-port", args.port, build_flags=build_flags)
+        rates[name] = read_loop_rate(args.port, args.baud)
+
+    print()
+    print(f"{'loop':<10} {'iterations/s':>13} {'busy p50':>9} {'p99':>6} {'max':>6}")
+    for name, _ in VARIANTS:
+        iterations, p50, p99, largest = rates[name]
+        print(f"{name:<10} {iterations:>13} {p50:>9} {p99:>6} {largest:>6}")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,270 @@
+#!/usr/bin/env python3
+"""Turns the log frames of a LOG_TOKENIZED build back into text.
+
+The device only sends where each format string sits in flash, so the strings are read from the
+build's ELF. See src/common/logTokenizer.h for the frame format.
+"""
+import argparse
+import hashlib
+import re
+import struct
+import sys
+
+SOF = b"\xa5\x4c"
+CRC_SIZE = 2
+
+TOKEN, TEXT, SESSION = range(3)
+LEVELS = ["[DEBUG]", "[INFO]", "[WARN]", "[ERROR]"]
+
+# SOC_DROM_LOW on the ESP32. The device says which base it uses when it starts, this is only for
+# decoders attached after that.
+DEFAULT_FLASH_BASE = 0x3F400000
+
+# kLogElfShaPrefixSize on the device.
+ELF_SHA_PREFIX_SIZE = 8
+
+SHF_ALLOC = 0x2
+SHT_NOBITS = 8
+
+CONVERSION = re.compile(r"%([-+ #0]*)(\d*)(?:\.(\d+))?(hh|h|ll|l|z|j|t)?([diouxXcspfFeEgG%])")
+
+
+def crc16(data, crc=0xFFFF):
+    """CRC16-CCITT (0x1021, starting at 0xFFFF), the same as the device's."""
+    for byte in data:
+        crc ^= byte << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) & 0xFFFF if crc & 0x8000 else (crc << 1) & 0xFFFF
+    return crc
+
+
+class Elf:
+    """The sections an ELF loads, enough to read strings at the addresses they run from."""
+
+    def __init__(self, path):
+        with open(path, "rb") as f:
+            data = f.read()
+
+        if data[:4] != b"\x7fELF":
+            raise ValueError(f"{path} is not an ELF file")
+
+        endian = "<" if data[5] == 1 else ">"
+        if data[4] == 2:
+            (section_offset,) = struct.unpack_from(endian + "Q", data, 0x28)
+            section_size, section_count = struct.unpack_from(endian + "HH", data, 0x3A)
+            section = struct.Struct(endian + "IIQQQQIIQQ")
+        else:
+            (section_offset,) = struct.unpack_from(endian + "I", data, 0x20)
+            section_size, section_count = struct.unpack_from(endian + "HH", data, 0x2E)
+            section = struct.Struct(endian + "IIIIIIIIII")
+
+        self.sections = []
+        for i in range(section_count):
+            _, kind, flags, address, offset, size, *_ = section.unpack_from(
+                data, section_offset + i * section_size)
+            if flags & SHF_ALLOC and kind != SHT_NOBITS and size > 0:
+                self.sections.append((address, data[offset:offset + size]))
+
+        self.sha256 = hashlib.sha256(data).digest()
+
+    def string(self, address):
+        for start, contents in self.sections:
+            if start <= address < start + len(contents):
+                begin = address - start
+                end = contents.find(b"\0", begin)
+                return contents[begin:end if end >= 0 else len(contents)].decode("utf-8", "replace")
+        return None
+
+
+class Reader:
+    def __init__(self, data):
+        self.data = data
+        self.offset = 0
+
+    def byte(self):
+        return self.bytes(1)[0]
+
+    def bytes(self, count):
+        if self.offset + count > len(self.data):
+            raise ValueError("record cut short")
+        value = self.data[self.offset:self.offset + count]
+        self.offset += count
+        return value
+
+    def varint(self):
+        value = 0
+        shift = 0
+        while True:
+            byte = self.byte()
+            value |= (byte & 0x7F) << shift
+            shift += 7
+            if not byte & 0x80:
+                return value
+
+
+class Decoder:
+    def __init__(self, elf, out):
+        self.elf = elf
+        self.out = out
+        self.buffer = bytearray()
+        self.flash_base = DEFAULT_FLASH_BASE
+
+    def feed(self, data):
+        self.buffer += data
+        while self._parse():
+            pass
+        self.out.flush()
+
+    def _parse(self):
+        """Decodes the next frame in the buffer. Whatever comes before it is printed as it is."""
+        start = self.buffer.find(SOF)
+        if start < 0:
+            # Keep a trailing 0xA5, it may be the start of a frame.
+            keep = 1 if self.buffer.endswith(SOF[:1]) else 0
+            self._text(self.buffer[:len(self.buffer) - keep])
+            del self.buffer[:len(self.buffer) - keep]
+            return False
+
+        self._text(self.buffer[:start])
+        del self.buffer[:start]
+
+        if len(self.buffer) < len(SOF) + 1:
+            return False
+        length = self.buffer[len(SOF)]
+        end = len(SOF) + 1 + length + CRC_SIZE
+        if len(self.buffer) < end:
+            return False
+
+        body = bytes(self.buffer[len(SOF):end - CRC_SIZE])
+        (crc,) = struct.unpack_from("<H", self.buffer, end - CRC_SIZE)
+        if crc16(body) != crc:
+            # Not a frame after all, or a damaged one.
+            self._text(self.buffer[:1])
+            del self.buffer[:1]
+            return True
+
+        del self.buffer[:end]
+        try:
+            self._record(Reader(body[1:]))
+        except ValueError as e:
+            self.out.write(f"<bad log frame: {e}>\n")
+        return True
+
+    def _text(self, data):
+        if data:
+            self.out.write(bytes(data).decode("utf-8", "replace"))
+
+    def _record(self, reader):
+        header = reader.byte()
+        level = header & 0x03
+        newline = bool(header & 0x04)
+        kind = header >> 4
+        time_ms = reader.varint()
+
+        if kind == SESSION:
+            self._session(reader)
+            return
+
+        if kind == TEXT:
+            text = reader.data[reader.offset:].decode("utf-8", "replace")
+        elif kind == TOKEN:
+            text = self._format(reader)
+        else:
+            text = f"<unknown log frame kind {kind}>"
+
+        end = "\n" if newline else ""
+        self.out.write(f"{LEVELS[level]} {time_ms} {text}{end}")
+
+    def _session(self, reader):
+        self.flash_base = reader.varint()
+        sha = reader.bytes(ELF_SHA_PREFIX_SIZE)
+
+        if any(sha) and sha != self.elf.sha256[:ELF_SHA_PREFIX_SIZE]:
+            print("Warning: the device runs a different build than this ELF, lines may be wrong",
+                  file=sys.stderr)
+
+    def _flash_string(self, offset):
+        return self.elf.string(self.flash_base + offset)
+
+    def _format(self, reader):
+        token = reader.varint()
+        format_string = self._flash_string(token)
+        if format_string is None:
+            return f"<unknown token 0x{token:x}: {reader.data[reader.offset:].hex()}>"
+
+        text = []
+        last = 0
+        for match in CONVERSION.finditer(format_string):
+            text.append(format_string[last:match.start()])
+            last = match.end()
+            text.append(self._convert(match, reader))
+        text.append(format_string[last:])
+        return "".join(text)
+
+    def _convert(self, match, reader):
+        flags, width, precision, length, conversion = match.groups()
+        if conversion == "%":
+            return "%"
+
+        spec = "%" + flags + width + (f".{precision}" if precision is not None else "")
+
+        # Integers come as their bits, so the conversion decides the sign, as it does in printf.
+        if conversion in "di":
+            bits = 64 if length in ("ll", "j") else 32
+            value = reader.varint()
+            if value >= 1 << (bits - 1):
+                value -= 1 << bits
+            return (spec + "d") % value
+        if conversion in "ouxX":
+            return (spec + conversion) % reader.varint()
+        if conversion == "c":
+            return (spec + "c") % chr(reader.varint() & 0xFF)
+        if conversion == "p":
+            return (spec + "s") % f"0x{reader.varint():x}"
+        if conversion == "s":
+            return (spec + "s") % self._string(reader)
+        (value,) = struct.unpack("<d", reader.bytes(8))
+        return (spec + conversion) % value
+
+    def _string(self, reader):
+        value = reader.varint()
+        if value & 1:
+            string = self._flash_string(value >> 1)
+            return string if string is not None else f"<unknown string 0x{value >> 1:x}>"
+        return reader.bytes(value >> 1).decode("utf-8", "replace")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("elf", help="The build's ELF, e.g. .pio/build/debugTokenized/firmware.elf")
+    source = parser.add_mutually_exclusive_group(required=True)
+    source.add_argument("-p", "--port", help="Serial port to read from (needs pyserial)")
+    source.add_argument("-i", "--input", help="A raw capture to decode, - for stdin")
+    parser.add_argument("-b", "--baud", type=int, default=115200, help="Baud rate (default 115200)")
+    args = parser.parse_args()
+
+    decoder = Decoder(Elf(args.elf), sys.stdout)
+
+    if args.input is not None:
+        stream = sys.stdin.buffer if args.input == "-" else open(args.input, "rb")
+        with stream:
+            while True:
+                data = stream.read(4096)
+                if not data:
+                    break
+                decoder.feed(data)
+        return 0
+
+    import serial
+
+    with serial.Serial(args.port, args.baud, timeout=0.1) as port:
+        try:
+            while True:
+                decoder.feed(port.read(max(1, port.in_waiting)))
+        except KeyboardInterrupt:
+            pass
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,253 @@
+#include "embeddedUpload.h"
+#include "../src/common/logger.h"
+#include "generated/writeMp3.h"
+#include "modemFs.h"
+
+// Lists what was uploaded last time, so a run only has to send what changed. +FSLS can't be used
+// for that: its output gets truncated once the directory holds more than a few files.
+#define MANIFEST_FILE "manifest.txt"
+#define MAX_MANIFEST_ENTRIES 64
+#define MAX_MANIFEST_SIZE 4096
+
+typedef struct {
+  char fileName[48];
+  unsigned int length;
+  unsigned int hash;
+} ManifestEntry;
+
+ManifestEntry manifest[MAX_MANIFEST_ENTRIES];
+unsigned int manifestCount = 0;
+
+char manifestText[MAX_MANIFEST_SIZE + 1];
+
+// Lines of "<file name>,<length>,<hash in hex>".
+void parseManifest(char *text) {
+  manifestCount = 0;
+
+  for (char *line = strtok(text, "\r\n"); line != nullptr && manifestCount < MAX_MANIFEST_ENTRIES;
+       line = strtok(nullptr, "\r\n")) {
+    ManifestEntry &entry = manifest[manifestCount];
+    char *length = strchr(line, ',');
+    char *hash = length != nullptr ? strchr(length + 1, ',') : nullptr;
+
+    if (hash == nullptr) {
+      LOG_WARNLN(F("Skipping malformed manifest line: %s"), line);
+      continue;
+    }
+
+    *length++ = '\0';
+    *hash++ = '\0';
+
+    snprintf(entry.fileName, sizeof(entry.fileName), "%s", line);
+    entry.length = strtoul(length, nullptr, 10);
+    entry.hash = strtoul(hash, nullptr, 16);
+    manifestCount++;
+  }
+}
+
+void readManifest() {
+  manifestCount = 0;
+
+  const int size = getFileSize(MP3_DIR "/" MANIFEST_FILE);
+
+  if (size <= 0 || size > MAX_MANIFEST_SIZE) {
+    LOG_INFOLN(F("No usable manifest (size %d), uploading everything"), size);
+    return;
+  }
+
+  const int fileHandle = openFile(MP3_DIR "/" MANIFEST_FILE, 2);
+
+  if (fileHandle < 0) {
+    return;
+  }
+
+  const int read = readFile(
+      fileHandle, reinterpret_cast<unsigned char *>(manifestText), static_cast<unsigned>(size));
+
+  if (read == size) {
+    manifestText[read] = '\0';
+    parseManifest(manifestText);
+  } else {
+    LOG_ERRORLN(F("Failed to read manifest: %d of %d bytes"), read, size);
+  }
+
+  closeFile(fileHandle);
+
+  LOG_INFOLN(F("Manifest lists %u files"), manifestCount);
+}
+
+// Written last, and only lists files that made it, so an interrupted run is picked up next time.
+void writeManifest(const bool *uploaded) {
+  size_t length = 0;
+
+  for (unsigned int i = 0; i < mp3FilesCount; i++) {
+    if (!uploaded[i]) {
+      continue;
+    }
+
+    length += snprintf(manifestText + length,
+                       sizeof(manifestText) - length,
+                       "%s,%u,%08x\n",
+                       mp3Files[i].fileName,
+                       mp3Files[i].length,
+                       mp3Files[i].hash);
+
+    if (length >= sizeof(manifestText)) {
+      LOG_ERRORLN(F("Manifest too large, not writing it"));
+      return;
+    }
+  }
+
+  const int fileHandle = openFile(MP3_DIR "/" MANIFEST_FILE, 1);
+
+  if (fileHandle < 0) {
+    return;
+  }
+
+  if (!writeFile(fileHandle, reinterpret_cast<const unsigned char *>(manifestText), length)) {
+    LOG_ERRORLN(F("Failed to write manifest"));
+  }
+
+  closeFile(fileHandle);
+}
+
+const ManifestEntry *findManifestEntry(const char *fileName) {
+  for (unsigned int i = 0; i < manifestCount; i++) {
+    if (strcmp(manifest[i].fileName, fileName) == 0) {
+      return &manifest[i];
+    }
+  }
+
+  return nullptr;
+}
+
+bool isInLibrary(const char *fileName) {
+  for (unsigned int i = 0; i < mp3FilesCount; i++) {
+    if (strcmp(mp3Files[i].fileName, fileName) == 0) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+// In 64 bits, a few MB times 1000 doesn't fit in 32.
+unsigned long bytesPerSecond(const uint64_t bytes, const uint32_t elapsedMs) {
+  return elapsedMs > 0 ? static_cast<unsigned long>(bytes * 1000ULL / elapsedMs) : 0UL;
+}
+
+void writeMp3s() {
+  LOG_INFOLN(F("Writing MP3s..."));
+
+  if (mp3FilesCount > MAX_MANIFEST_ENTRIES) {
+    LOG_ERRORLN(F("Too many MP3s for the manifest: %u"), mp3FilesCount);
+    return;
+  }
+
+  sendCommand(F("+FSMEM"));
+
+  if (_modemImpl.waitResponse("+FSMEM: C:(") != 1) {
+    LOG_ERRORLN(F("Failed to get memory size!"));
+    return;
+  }
+
+  String capSize = _modemImpl.stream.readStringUntil('\n');
+  capSize.replace(F("\n"), F(""));
+  capSize.replace(F(")"), F(""));
+
+  LOG_INFOLN(F("Capacity [<total>/<used>]: %s"), capSize.c_str());
+
+  sendCommand(F("+FSMKDIR=" MP3_DIR));
+  _modemImpl.waitResponse(1000UL);
+
+  readManifest();
+
+  // Files the last run uploaded that are no longer part of the library. Anything the manifest
+  // doesn't know about, like the phone's own announcement clips, is left alone.
+  unsigned int deleted = 0;
+
+  for (unsigned int i = 0; i < manifestCount; i++) {
+    if (isInLibrary(manifest[i].fileName)) {
+      continue;
+    }
+
+    char fullPath[64];
+    snprintf(fullPath, sizeof(fullPath), MP3_DIR "/%s", manifest[i].fileName);
+
+    if (deleteFile(fullPath)) {
+      LOG_INFOLN(F("Deleted stale file: %s"), fullPath);
+      deleted++;
+    } else {
+      LOG_ERRORLN(F("Delete file failed for: %s"), fullPath);
+    }
+  }
+
+  LOG_INFOLN(F("Writing audio files..."));
+
+  raiseBaudRate();
+
+  bool uploaded[MAX_MANIFEST_ENTRIES] = {};
+  unsigned int sent = 0;
+  unsigned int skipped = 0;
+  unsigned int failed = 0;
+  uint32_t sentBytes = 0;
+  const uint32_t start = millis();
+
+  for (unsigned int i = 0; i < mp3FilesCount; i++) {
+    const MP3File &file = mp3Files[i];
+    const ManifestEntry *entry = findManifestEntry(file.fileName);
+
+    if (entry != nullptr && entry->length == file.length && entry->hash == file.hash) {
+      LOG_INFOLN(F("[%u/%u] %s unchanged"), i + 1, mp3FilesCount, file.fileName);
+      uploaded[i] = true;
+      skipped++;
+      continue;
+    }
+
+    char fullPath[64];
+    snprintf(fullPath, sizeof(fullPath), MP3_DIR "/%s", file.fileName);
+
+    const uint32_t fileStart = millis();
+    const int fileHandle = openFile(fullPath, 1);
+
+    uploaded[i] = fileHandle >= 0 && writeFile(fileHandle, getMp3Data(file), file.length);
+
+    if (fileHandle >= 0 && !closeFile(fileHandle)) {
+      LOG_ERRORLN(F("Close file failed for: %s"), fullPath);
+      uploaded[i] = false;
+    }
+
+    if (!uploaded[i]) {
+      LOG_ERRORLN(F("[%u/%u] Write file failed for: %s"), i + 1, mp3FilesCount, fullPath);
+      failed++;
+      continue;
+    }
+
+    const uint32_t elapsed = millis() - fileStart;
+    sent++;
+    sentBytes += file.length;
+
+    LOG_INFOLN(F("[%u/%u] %s: %u bytes in %lu ms (%lu B/s)"),
+               i + 1,
+               mp3FilesCount,
+               file.fileName,
+               file.length,
+               elapsed,
+               bytesPerSecond(file.length, elapsed));
+  }
+
+  writeManifest(uploaded);
+  restoreBaudRate();
+
+  const uint32_t elapsed = millis() - start;
+
+  LOG_INFOLN(F("Done: %u uploaded, %u unchanged, %u deleted, %u failed"),
+             sent,
+             skipped,
+             deleted,
+             failed);
+  LOG_INFOLN(F("Sent %lu bytes in %lu ms (%lu B/s)"),
+             sentBytes,
+             elapsed,
+             bytesPerSecond(sentBytes, elapsed));
+}
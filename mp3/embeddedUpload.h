@@ -0,0 +1,5 @@
+#pragma once
+
+// Uploads the MP3s that generate.py compiled into the firmware, skipping the ones the modem
+// already has.
+void writeMp3s();
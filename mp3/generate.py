@@ -3,22 +3,139 @@ import os
 import sys
 import argparse
 
-def convert_file_to_c_array(filepath, array_name):
-    """Reads a binary file and returns a C array string of its bytes for definitions."""
-    with open(filepath, "rb") as f:
-        data = f.read()
-    # Convert each byte to a hexadecimal representation.
-    hex_bytes = [f"0x{byte:02x}" for byte in data]
-    bytes_per_line = 12  # adjust formatting as needed
-    lines = []
-    for i in range(0, len(hex_bytes), bytes_per_line):
-        line = ", ".join(hex_bytes[i:i+bytes_per_line])
-        if i + bytes_per_line < len(hex_bytes):
-            line += ","
-        lines.append("  " + line)
-    array_def = f"const unsigned char {array_name}[] = {{\n" + "\n".join(lines) + "\n};\n"
-    array_def += f"unsigned int {array_name}_len = {len(data)};\n"
-    return array_def
+def fnv1a32(data):
+    """32-bit FNV-1a, so the uploader can tell whether a file on the modem is out of date."""
+    value = 0x811C9DC5
+    for byte in data:
+        value = ((value ^ byte) * 0x01000193) & 0xFFFFFFFF
+    return value
+
+def pack_blob(clips, blob_path):
+    """Writes the clips back to back into one binary file, and returns each one's offset."""
+    offsets = []
+    with open(blob_path, "wb") as out:
+        for data in clips:
+            offsets.append(out.tell())
+            out.write(data)
+    return offsets
+
+def incbin_source(symbol, blob_path, blob_hash):
+    """Returns C++ that links the binary file in as symbol[], straight from the assembler."""
+    # The build doesn't know about the .bin, so the hash makes the source change along with it.
+    path = os.path.abspath(blob_path).replace("\\", "/")
+    return (f"// {os.path.basename(blob_path)}, FNV-1a 0x{blob_hash:08x}\n"
+            f'asm(".section .rodata.{symbol}, \\"a\\"\\n"\n'
+            f'    ".global {symbol}\\n"\n'
+            f'    ".balign 4\\n"\n'
+            f'    "{symbol}:\\n"\n'
+            f'    ".incbin \\"{path}\\"\\n"\n'
+            f'    ".previous\\n");\n')
+
+def unique_mp3_files(folder):
+    """Returns the folder's MP3 file names, sorted, and maps each one to the first file with the
+    same contents. A clip used under several names is only stored and uploaded once."""
+    names = sorted(f for f in os.listdir(folder) if f.lower().endswith(".mp3"))
+    canonical = {}
+    first_with_data = {}
+    for name in names:
+        with open(os.path.join(folder, name), "rb") as f:
+            canonical[name] = first_with_data.setdefault(f.read(), name)
+    return names, canonical
+
+def normalize_phone_number(number, country_code):
+    """National format, the same as normalizePhoneNumber() in the firmware: separators are dropped,
+    and "+<code>" or "00<code>" becomes a leading 0. Returns None for an empty number."""
+    international = False
+    digits = ""
+    for c in number:
+        if c == "+" and not digits and not international:
+            international = True
+        elif c in "0123456789":
+            digits += c
+    if not digits:
+        return None
+    rest = digits
+    if not international and digits.startswith("00"):
+        international = True
+        rest = digits[2:]
+    if international and rest.startswith(country_code):
+        return "0" + rest[len(country_code):]
+    return ("+" if international else "") + rest
+
+def caller_hash(number, seed):
+    """FNV-1a from a seeded basis with a murmur3 finalizer, as callerHash() in mp3.cpp does."""
+    value = (0x811C9DC5 ^ (seed * 0x9E3779B9)) & 0xFFFFFFFF
+    for byte in number.encode():
+        value = ((value ^ byte) * 0x01000193) & 0xFFFFFFFF
+    value ^= value >> 16
+    value = (value * 0x85EBCA6B) & 0xFFFFFFFF
+    value ^= value >> 13
+    value = (value * 0xC2B2AE35) & 0xFFFFFFFF
+    value ^= value >> 16
+    return value
+
+def build_perfect_hash(numbers):
+    """Hash and displace: the unseeded hash puts each number in a bucket, and every bucket gets
+    the first seed that sends all its numbers to free slots. Returns the seeds and the numbers in
+    slot order, so a lookup is two hashes and one compare."""
+    count = len(numbers)
+    bucket_count = max(1, (count + 3) // 4)
+    buckets = [[] for _ in range(bucket_count)]
+    for number in numbers:
+        buckets[caller_hash(number, 0) % bucket_count].append(number)
+
+    seeds = [0] * bucket_count
+    slots = [None] * count
+    # The big buckets go first, while there's still room for them.
+    for index in sorted(range(bucket_count), key=lambda i: -len(buckets[i])):
+        bucket = buckets[index]
+        if not bucket:
+            continue
+        for seed in range(1, 0x10000):
+            positions = {caller_hash(number, seed) % count for number in bucket}
+            if len(positions) == len(bucket) and all(slots[p] is None for p in positions):
+                break
+        else:
+            raise ValueError("no seed found for the caller perfect hash")
+        seeds[index] = seed
+        for number in bucket:
+            slots[caller_hash(number, seed) % count] = number
+    return seeds, slots
+
+# MPEG audio bitrates (kbps) by version and layer III, and sample rates (Hz) by version.
+MPEG1_L3_BITRATES = [0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320]
+MPEG2_L3_BITRATES = [0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160]
+SAMPLE_RATES = {3: [44100, 48000, 32000], 2: [22050, 24000, 16000], 0: [11025, 12000, 8000]}
+
+def mp3_frame_length(data, offset):
+    """Returns the length of the layer III frame at offset, or 0 if there is no frame header."""
+    if offset + 4 > len(data) or data[offset] != 0xFF or (data[offset + 1] & 0xE0) != 0xE0:
+        return 0
+    version = (data[offset + 1] >> 3) & 0x03
+    layer = (data[offset + 1] >> 1) & 0x03
+    bitrate_index = data[offset + 2] >> 4
+    rate_index = (data[offset + 2] >> 2) & 0x03
+    padding = (data[offset + 2] >> 1) & 0x01
+    if version == 1 or layer != 1 or bitrate_index in (0, 15) or rate_index == 3:
+        return 0
+    sample_rate = SAMPLE_RATES[version][rate_index]
+    if version == 3:
+        return 144000 * MPEG1_L3_BITRATES[bitrate_index] // sample_rate + padding
+    return 72000 * MPEG2_L3_BITRATES[bitrate_index] // sample_rate + padding
+
+def mp3_frames_only(data):
+    """Strips ID3 tags and the Xing/Info frame, so clips can be concatenated into one MP3."""
+    start, end = 0, len(data)
+    if data[:3] == b"ID3" and len(data) >= 10:
+        size = (data[6] << 21) | (data[7] << 14) | (data[8] << 7) | data[9]
+        start = 10 + size + (10 if data[5] & 0x10 else 0)
+    if end - start >= 128 and data[end - 128:end - 125] == b"TAG":
+        end -= 128
+    first_frame = mp3_frame_length(data, start)
+    if first_frame and (b"Xing" in data[start:start + first_frame] or
+                        b"Info" in data[start:start + first_frame]):
+        start += first_frame
+    return data[start:end]
 
 def main():
     parser = argparse.ArgumentParser(
@@ -27,6 +144,10 @@ def main():
     parser.add_argument("folder", help="Folder containing MP3 files")
     parser.add_argument("-o", "--output", default="mp3.h",
                         help="Output main app header file name (default: mp3.h).")
+    parser.add_argument("--country-code", default="972",
+                        help="Country calling code, kCountryCallingCode in config.h (default: 972).")
+    parser.add_argument("--main-only", action="store_true",
+                        help="Only generate the main app files, for when stream.py uploads the MP3s.")
     args = parser.parse_args()
 
     folder = args.folder
@@ -43,6 +164,7 @@ def main():
     # Set the write file paths to be inside the generated folder.
     write_header = os.path.join(generated_folder, "writeMp3.h")
     write_source = os.path.join(generated_folder, "writeMp3.cpp")
+    write_blob = os.path.join(generated_folder, "mp3Blob.bin")
 
     if not os.path.isdir(folder):
         print(f"Error: '{folder}' is not a valid directory.")
@@ -51,7 +173,7 @@ def main():
     # Look for a numbers.txt file that maps call numbers to MP3 base names.
     # Now expected next to the script instead of inside the MP3 folder.
     numbers_filename = os.path.join(script_dir, "numbers.txt")
-    call_dict = {}  # mapping: call number -> base name
+    call_dict = {}  # mapping: call number in national format -> base name
     if os.path.isfile(numbers_filename):
         with open(numbers_filename, "r") as nf:
             for line in nf:
@@ -60,31 +182,27 @@ def main():
                     continue
                 parts = line.split(",")
                 if len(parts) >= 2:
-                    number = parts[0].strip()
+                    number = normalize_phone_number(parts[0].strip(), args.country_code)
                     base = parts[1].strip()
+                    if number is None:
+                        print(f"Skipping line without a number: {line}")
+                        continue
+                    if number in call_dict:
+                        print(f"{number} is listed more than once, using {base}")
                     call_dict[number] = base
-    else:
-        call_dict = None
 
     # Find all .mp3 files (case-insensitive)
-    mp3_files = [f for f in os.listdir(folder) if f.lower().endswith(".mp3")]
+    mp3_files, canonical_files = unique_mp3_files(folder)
     if not mp3_files:
         print("No MP3 files found in the specified folder.")
         sys.exit(1)
-    mp3_files.sort()
 
-    base_names = []
-    arrays_definitions = {}  # base name -> full raw array definition string
-    file_lengths = {}       # base name -> file length (integer)
+    base_names = [os.path.splitext(filename)[0] for filename in mp3_files]
+    # The files that end up on the modem, one per distinct clip.
+    unique_files = [f for f in mp3_files if canonical_files[f] == f]
     for filename in mp3_files:
-        base_name = os.path.splitext(filename)[0]
-        base_names.append(base_name)
-        array_name = base_name + "_mp3"
-        filepath = os.path.join(folder, filename)
-        arrays_definitions[base_name] = convert_file_to_c_array(filepath, array_name)
-        with open(filepath, "rb") as f:
-            data = f.read()
-            file_lengths[base_name] = len(data)
+        if canonical_files[filename] != filename:
+            print(f"{filename} is the same clip as {canonical_files[filename]}, sharing it")
 
     # ------------------------------
     # Generate Main App Files (mp3.h and mp3.cpp)
@@ -108,19 +226,15 @@ def main():
             
             # Declare dialedDigitsToMp3s as a fixed array for digits 0-9.
             out.write("extern const char* dialedDigitsToMp3s[10];\n\n")
+
+            # The digit clips' raw frames, for rendering caller announcements on the modem.
+            out.write("extern const unsigned char* const dialedDigitsMp3Data[10];\n")
+            out.write("extern const unsigned int dialedDigitsMp3Lengths[10];\n\n")
             
-            # Call mapping declarations.
-            if call_dict is not None:
-                out.write("// Mapping of call numbers to MP3 filenames\n")
-                out.write("typedef struct {\n")
-                out.write("    const char* callNumber;\n")
-                out.write("    const char* fileName;\n")
-                out.write("} CallMapping;\n\n")
-                out.write("extern const CallMapping callNumbersToMp3s[];\n")
-                out.write("extern const unsigned int callNumbersToMp3sCount;\n\n")
-                out.write("bool hasMp3ForCall(const char* callNumber);\n")
-                out.write("const char* getMp3ForCall(const char* callNumber);\n")
-            out.write("\n")
+            # Caller lookup.
+            out.write("// Returns the MP3 for the caller, or nullptr. The number is normalized first, so\n")
+            out.write("// it doesn't matter whether it comes in national or international format.\n")
+            out.write("const char* lookupCallerMp3(const char* callNumber);\n")
         print(f"Main app header generated: {main_app_header}")
     except Exception as e:
         print(f"Error writing main app header: {e}")
@@ -130,17 +244,20 @@ def main():
         with open(main_app_source, "w") as out:
             out.write("// Main app source: Auxiliary MP3 metadata (filenames only)\n")
             out.write("// Generated by mp3_to_header.py\n\n")
-            out.write(f'#include "{os.path.basename(main_app_header)}"\n\n')
+            out.write(f'#include "{os.path.basename(main_app_header)}"\n')
+            out.write('#include "common/consts.h"\n')
+            out.write('#include "common/phoneBook.h"\n\n')
             
-            # Define each filename as a constant string.
+            # Define each filename as a constant string. Names of a shared clip point at the
+            # one file that holds it.
             for filename, base_name in zip(mp3_files, base_names):
-                out.write(f"const char* {base_name} = \"{filename}\";\n")
+                out.write(f"const char* {base_name} = \"{canonical_files[filename]}\";\n")
             out.write("\n")
             
             # Define master array and count.
             out.write("const char* mp3Files[] = {\n")
-            for base_name in base_names:
-                out.write(f"    {base_name},\n")
+            for filename in unique_files:
+                out.write(f"    \"{filename}\",\n")
             out.write("};\n\n")
             out.write("unsigned int mp3FilesCount = sizeof(mp3Files) / sizeof(mp3Files[0]);\n")
             
@@ -150,30 +267,71 @@ def main():
                 # Assume naming convention: dial_0, dial_1, ... dial_9.
                 out.write(f"    dial_{i},\n")
             out.write("};\n")
+
+            # Digit clip frames, without tags so they can be concatenated.
+            digit_frames = []
+            for i in range(10):
+                with open(os.path.join(folder, f"dial_{i}.mp3"), "rb") as f:
+                    digit_frames.append(mp3_frames_only(f.read()))
+            digits_blob = os.path.join(os.path.dirname(os.path.abspath(main_app_header)),
+                                       "dialedDigits.bin")
+            digit_offsets = pack_blob(digit_frames, digits_blob)
+            out.write("\n")
+            out.write(incbin_source("dialedDigitsMp3Blob", digits_blob,
+                                    fnv1a32(b"".join(digit_frames))))
+            out.write("extern const unsigned char dialedDigitsMp3Blob[];\n")
+            out.write("\nconst unsigned char* const dialedDigitsMp3Data[10] = {\n")
+            for i in range(10):
+                out.write(f"    dialedDigitsMp3Blob + {digit_offsets[i]},\n")
+            out.write("};\n")
+            out.write("\nconst unsigned int dialedDigitsMp3Lengths[10] = {\n")
+            for i in range(10):
+                out.write(f"    {len(digit_frames[i])},\n")
+            out.write("};\n")
             
-            # Call mappings.
-            if call_dict is not None:
-                out.write("\n// Mapping of call numbers to MP3 filenames\n")
-                out.write("const CallMapping callNumbersToMp3s[] = {\n")
-                for number, base in call_dict.items():
-                    if base in base_names:
-                        out.write(f'    {{"{number}", {base}}},\n')
-                out.write("};\n")
-                out.write("const unsigned int callNumbersToMp3sCount = sizeof(callNumbersToMp3s) / sizeof(callNumbersToMp3s[0]);\n\n")
-                out.write("bool hasMp3ForCall(const char* callNumber) {\n")
-                out.write("    for (const auto& mapping : callNumbersToMp3s) {\n")
-                out.write("        if (strcmp(mapping.callNumber, callNumber) == 0) {\n")
-                out.write("            return true;\n")
+            # Caller lookup, a minimal perfect hash over the mapped numbers.
+            callers = {number: base for number, base in call_dict.items() if base in base_names}
+            out.write("\n")
+            if callers:
+                seeds, slots = build_perfect_hash(list(callers))
+                out.write("namespace {\n")
+                out.write("    struct CallMapping {\n")
+                out.write("        const char* callNumber;\n")
+                out.write("        const char* fileName;\n")
+                out.write("    };\n\n")
+                out.write("    // In slot order.\n")
+                out.write("    const CallMapping callNumbersToMp3s[] = {\n")
+                for number in slots:
+                    out.write(f'        {{"{number}", {callers[number]}}},\n')
+                out.write("    };\n\n")
+                out.write("    const uint16_t callerHashSeeds[] = {\n")
+                for i in range(0, len(seeds), 12):
+                    out.write("        " + ", ".join(str(seed) for seed in seeds[i:i + 12]) + ",\n")
+                out.write("    };\n\n")
+                out.write("    uint32_t callerHash(const char* number, const uint32_t seed) {\n")
+                out.write("        uint32_t value = 0x811C9DC5u ^ (seed * 0x9E3779B9u);\n")
+                out.write("        for (const char* c = number; *c != '\\0'; c++) {\n")
+                out.write("            value = (value ^ static_cast<uint8_t>(*c)) * 0x01000193u;\n")
                 out.write("        }\n")
+                out.write("        value ^= value >> 16;\n")
+                out.write("        value *= 0x85EBCA6Bu;\n")
+                out.write("        value ^= value >> 13;\n")
+                out.write("        value *= 0xC2B2AE35u;\n")
+                out.write("        value ^= value >> 16;\n")
+                out.write("        return value;\n")
                 out.write("    }\n")
-                out.write("    return false;\n")
                 out.write("}\n\n")
-                out.write("const char* getMp3ForCall(const char* callNumber) {\n")
-                out.write("    for (const auto& mapping : callNumbersToMp3s) {\n")
-                out.write("        if (strcmp(mapping.callNumber, callNumber) == 0) {\n")
-                out.write("            return mapping.fileName;\n")
-                out.write("        }\n")
-                out.write("    }\n")
+                out.write("const char* lookupCallerMp3(const char* callNumber) {\n")
+                out.write("    char number[kMediumBufferSize];\n")
+                out.write("    if (!normalizePhoneNumber(callNumber, number, sizeof(number))) {\n")
+                out.write("        return nullptr;\n")
+                out.write("    }\n\n")
+                out.write(f"    const uint32_t seed = callerHashSeeds[callerHash(number, 0) % {len(seeds)}];\n")
+                out.write(f"    const CallMapping& mapping = callNumbersToMp3s[callerHash(number, seed) % {len(slots)}];\n")
+                out.write("    return strcmp(mapping.callNumber, number) == 0 ? mapping.fileName : nullptr;\n")
+                out.write("}\n")
+            else:
+                out.write("const char* lookupCallerMp3(const char*) {\n")
                 out.write("    return nullptr;\n")
                 out.write("}\n")
         print(f"Main app source generated: {main_app_source}")
@@ -181,38 +339,48 @@ def main():
         print(f"Error writing main app source: {e}")
         sys.exit(1)
 
+    if args.main_only:
+        return
+
     # -----------------------------
-    # Generate Write Files (writeMp3.h and writeMp3.cpp)
+    # Generate Write Files (writeMp3.h, writeMp3.cpp and mp3Blob.bin)
     # -----------------------------
+    clips = []
+    for filename in unique_files:
+        with open(os.path.join(folder, filename), "rb") as f:
+            clips.append(f.read())
+    try:
+        offsets = pack_blob(clips, write_blob)
+    except Exception as e:
+        print(f"Error writing write blob: {e}")
+        sys.exit(1)
+    print(f"Write blob generated: {write_blob} ({len(unique_files)} of {len(mp3_files)} files, "
+          f"{sum(len(data) for data in clips)} bytes)")
+
     try:
         with open(write_header, "w") as out:
             out.write("#pragma once\n\n")
             out.write("#include <Arduino.h>\n")
             out.write("#include <cstring>\n\n")
-            out.write("// Write MP3 header: Contains full MP3 data arrays and metadata\n")
+            out.write("// Write MP3 header: Index into the packed MP3 blob\n")
             out.write("// Generated by mp3_to_header.py\n\n")
             
-            # Declare raw arrays.
-            for base_name in base_names:
-                array_name = base_name + "_mp3"
-                out.write(f"extern const unsigned char {array_name}[];\n")
-                out.write(f"extern unsigned int {array_name}_len;\n")
-            out.write("\n")
-            
             # Declare the MP3File struct.
             out.write("typedef struct {\n")
             out.write("    const char* fileName;\n")
-            out.write("    const unsigned char* data;\n")
+            out.write("    unsigned int offset;\n")
             out.write("    unsigned int length;\n")
+            out.write("    unsigned int hash;\n")
             out.write("} MP3File;\n\n")
             
-            # Declare extern MP3File instances.
-            for base_name in base_names:
-                out.write(f"extern const MP3File {base_name};\n")
-            out.write("\n")
+            # Declare the blob, and read clips from it in place.
+            out.write("extern const unsigned char mp3Blob[];\n\n")
+            out.write("inline const unsigned char* getMp3Data(const MP3File& file) {\n")
+            out.write("    return mp3Blob + file.offset;\n")
+            out.write("}\n\n")
             
             # Declare master array and count.
-            out.write("extern MP3File mp3Files[];\n")
+            out.write("extern const MP3File mp3Files[];\n")
             out.write("extern unsigned int mp3FilesCount;\n")
         print(f"Write header generated: {write_header}")
     except Exception as e:
@@ -221,26 +389,16 @@ def main():
 
     try:
         with open(write_source, "w") as out:
-            out.write("// Write MP3 source: Contains full MP3 data arrays and metadata\n")
+            out.write("// Write MP3 source: Links the packed MP3 blob and defines its index\n")
             out.write("// Generated by mp3_to_header.py\n\n")
             out.write(f'#include "{os.path.basename(write_header)}"\n\n')
-            
-            # Write full raw array definitions.
-            for base_name in base_names:
-                out.write(f"// {base_name}.mp3\n")
-                out.write(arrays_definitions[base_name])
-                out.write("\n")
-            
-            # Define MP3File instances with actual data pointers.
-            for filename, base_name in zip(mp3_files, base_names):
-                array_name = base_name + "_mp3"
-                out.write(f"const MP3File {base_name} = {{ \"{filename}\", {array_name}, {array_name}_len }};\n")
+            out.write(incbin_source("mp3Blob", write_blob, fnv1a32(b"".join(clips))))
             out.write("\n")
             
-            # Define master array and count.
-            out.write("MP3File mp3Files[] = {\n")
-            for base_name in base_names:
-                out.write(f"    {base_name},\n")
+            # Define the index, one entry per distinct clip.
+            out.write("const MP3File mp3Files[] = {\n")
+            for filename, offset, data in zip(unique_files, offsets, clips):
+                out.write(f"    {{ \"{filename}\", {offset}, {len(data)}, 0x{fnv1a32(data):08x} }},\n")
             out.write("};\n\n")
             out.write("unsigned int mp3FilesCount = sizeof(mp3Files) / sizeof(mp3Files[0]);\n")
         print(f"Write source generated: {write_source}")
@@ -0,0 +1,418 @@
+#include "hostStream.h"
+#include "../src/common/logger.h"
+#include "modemFs.h"
+#include <Arduino.h>
+#include <algorithm>
+
+#define HOST_STREAM_VERSION 1
+
+#define FRAME_SOF_0 0xA5
+#define FRAME_SOF_1 0x5A
+// Type, seq and payload length.
+#define FRAME_HEADER_SIZE 4
+#define FRAME_CRC_SIZE 2
+#define FRAME_MAX_PAYLOAD 1024
+#define FRAME_MAX_SIZE (2 + FRAME_HEADER_SIZE + FRAME_MAX_PAYLOAD + FRAME_CRC_SIZE)
+// A frame that stalls for longer than this is dropped, the host will resend it.
+#define FRAME_TIMEOUT 200
+
+// A host that goes away without saying goodbye must not leave the modem at the transfer rate.
+#define SESSION_TIMEOUT 30000
+
+// Writes are gathered to the modem's chunk size, so most frames are acknowledged straight away and
+// the modem sees one +FSWRITE per 4 KB rather than per frame.
+#define WRITE_BUFFER_SIZE 4096
+
+#define MAX_FILE_NAME 47
+
+enum FrameType : uint8_t {
+  FrameHello = 0x01,
+  FrameOpen = 0x02,
+  FrameWrite = 0x03,
+  FrameRead = 0x04,
+  FrameClose = 0x05,
+  FrameDelete = 0x06,
+  FrameSize = 0x07,
+  FrameBye = 0x08,
+  FrameAck = 0x80,
+  FrameNak = 0x81,
+};
+
+enum NakReason : uint8_t {
+  NakUnknownType = 1,
+  NakBadRequest = 2,
+  NakNoFile = 3,
+  NakModemError = 4,
+};
+
+namespace {
+  uint8_t rxFrame[FRAME_HEADER_SIZE + FRAME_MAX_PAYLOAD + FRAME_CRC_SIZE];
+  size_t rxLength = 0;
+  bool rxInFrame = false;
+  uint8_t rxPrevious = 0;
+  uint32_t rxLastByteMillis = 0;
+
+  uint8_t txFrame[FRAME_MAX_SIZE];
+  size_t txLength = 0;
+  uint8_t txPayload[FRAME_MAX_PAYLOAD];
+
+  bool sessionActive = false;
+  uint32_t sessionLastFrameMillis = 0;
+  bool hasLastReply = false;
+  uint8_t lastSeq = 0;
+
+  int fileHandle = -1;
+  uint8_t writeBuffer[WRITE_BUFFER_SIZE];
+  size_t writeBuffered = 0;
+
+  uint16_t crc16(const uint8_t *data, const size_t length) {
+    uint16_t crc = 0xFFFF;
+
+    for (size_t i = 0; i < length; i++) {
+      crc ^= static_cast<uint16_t>(data[i]) << 8;
+
+      for (int bit = 0; bit < 8; bit++) {
+        crc = (crc & 0x8000) ? static_cast<uint16_t>((crc << 1) ^ 0x1021) : crc << 1;
+      }
+    }
+
+    return crc;
+  }
+
+  uint16_t readU16(const uint8_t *data) {
+    return data[0] | (data[1] << 8);
+  }
+
+  void writeU16(uint8_t *data, const uint16_t value) {
+    data[0] = value & 0xFF;
+    data[1] = value >> 8;
+  }
+
+  // Kept, so a request the host resends because the reply got lost can be answered again.
+  void sendReply(
+      const uint8_t type, const uint8_t seq, const uint8_t *payload, const size_t length) {
+    txFrame[0] = FRAME_SOF_0;
+    txFrame[1] = FRAME_SOF_1;
+    txFrame[2] = type;
+    txFrame[3] = seq;
+    writeU16(txFrame + 4, length);
+    memcpy(txFrame + 2 + FRAME_HEADER_SIZE, payload, length);
+    writeU16(txFrame + 2 + FRAME_HEADER_SIZE + length,
+             crc16(txFrame + 2, FRAME_HEADER_SIZE + length));
+
+    txLength = 2 + FRAME_HEADER_SIZE + length + FRAME_CRC_SIZE;
+    hasLastReply = true;
+    lastSeq = seq;
+
+    Serial.write(txFrame, txLength);
+  }
+
+  void sendAck(const uint8_t seq, const size_t length = 0) {
+    sendReply(FrameAck, seq, txPayload, length);
+  }
+
+  void sendNak(const uint8_t seq, const NakReason reason) {
+    const uint8_t payload = reason;
+    sendReply(FrameNak, seq, &payload, 1);
+  }
+
+  // Returns true once a whole frame with a good CRC is in rxFrame.
+  bool receiveFrame() {
+    while (Serial.available()) {
+      const uint8_t byte = Serial.read();
+      rxLastByteMillis = millis();
+
+      if (!rxInFrame) {
+        rxInFrame = rxPrevious == FRAME_SOF_0 && byte == FRAME_SOF_1;
+        rxPrevious = byte;
+        rxLength = 0;
+        continue;
+      }
+
+      rxFrame[rxLength++] = byte;
+
+      if (rxLength < FRAME_HEADER_SIZE) {
+        continue;
+      }
+
+      const size_t payloadLength = readU16(rxFrame + 2);
+
+      if (payloadLength > FRAME_MAX_PAYLOAD) {
+        LOG_WARNLN(F("Dropping frame with a %u byte payload"), payloadLength);
+        rxInFrame = false;
+        rxPrevious = 0;
+        continue;
+      }
+
+      if (rxLength < FRAME_HEADER_SIZE + payloadLength + FRAME_CRC_SIZE) {
+        continue;
+      }
+
+      rxInFrame = false;
+      rxPrevious = 0;
+
+      if (crc16(rxFrame, FRAME_HEADER_SIZE + payloadLength) ==
+          readU16(rxFrame + FRAME_HEADER_SIZE + payloadLength)) {
+        return true;
+      }
+
+      LOG_WARNLN(F("Dropping frame with a bad CRC"));
+    }
+
+    if (rxInFrame && millis() - rxLastByteMillis > FRAME_TIMEOUT) {
+      rxInFrame = false;
+      rxPrevious = 0;
+    }
+
+    return false;
+  }
+
+  bool flushWrites() {
+    if (writeBuffered == 0) {
+      return true;
+    }
+
+    const bool written = writeFile(fileHandle, writeBuffer, writeBuffered);
+    writeBuffered = 0;
+
+    return written;
+  }
+
+  bool closeCurrentFile() {
+    if (fileHandle < 0) {
+      return true;
+    }
+
+    const bool flushed = flushWrites();
+    const bool closed = closeFile(fileHandle);
+    fileHandle = -1;
+
+    return flushed && closed;
+  }
+
+  // Names are relative to MP3_DIR, like the ones in the manifest.
+  bool getFullPath(const uint8_t *name, const size_t length, char *fullPath, const size_t size) {
+    if (length == 0 || length > MAX_FILE_NAME || memchr(name, '/', length) != nullptr) {
+      return false;
+    }
+
+    snprintf(fullPath, size, MP3_DIR "/%.*s", static_cast<int>(length), name);
+    return true;
+  }
+
+  void endSession() {
+    if (!sessionActive) {
+      return;
+    }
+
+    if (!closeCurrentFile()) {
+      LOG_ERRORLN(F("Failed to close the open file"));
+    }
+
+    restoreBaudRate();
+    sessionActive = false;
+    hasLastReply = false;
+
+    LOG_INFOLN(F("Host stream session ended"));
+  }
+
+  void handleHello(const uint8_t seq) {
+    if (!sessionActive) {
+      LOG_INFOLN(F("Host stream session started"));
+
+      sendCommand(F("+FSMKDIR=" MP3_DIR));
+      _modemImpl.waitResponse(1000UL);
+
+      raiseBaudRate();
+      sessionActive = true;
+    } else if (!closeCurrentFile()) {
+      LOG_ERRORLN(F("Failed to close the open file"));
+    }
+
+    // The host waits longer for the frames it knows make the device write to the modem.
+    txPayload[0] = HOST_STREAM_VERSION;
+    writeU16(txPayload + 1, FRAME_MAX_PAYLOAD);
+    writeU16(txPayload + 3, WRITE_BUFFER_SIZE);
+    sendAck(seq, 5);
+  }
+
+  void handleOpen(const uint8_t seq, const uint8_t *payload, const size_t length) {
+    char fullPath[64];
+
+    if (length < 2 || !getFullPath(payload + 1, length - 1, fullPath, sizeof(fullPath))) {
+      sendNak(seq, NakBadRequest);
+      return;
+    }
+
+    closeCurrentFile();
+    fileHandle = openFile(fullPath, payload[0]);
+
+    if (fileHandle < 0) {
+      sendNak(seq, NakModemError);
+      return;
+    }
+
+    sendAck(seq);
+  }
+
+  void handleWrite(const uint8_t seq, const uint8_t *payload, const size_t length) {
+    if (fileHandle < 0) {
+      sendNak(seq, NakNoFile);
+      return;
+    }
+
+    size_t offset = 0;
+
+    while (offset < length) {
+      const size_t chunk = std::min(length - offset, sizeof(writeBuffer) - writeBuffered);
+      memcpy(writeBuffer + writeBuffered, payload + offset, chunk);
+      writeBuffered += chunk;
+      offset += chunk;
+
+      if (writeBuffered == sizeof(writeBuffer) && !flushWrites()) {
+        sendNak(seq, NakModemError);
+        return;
+      }
+    }
+
+    sendAck(seq);
+  }
+
+  void handleRead(const uint8_t seq, const uint8_t *payload, const size_t length) {
+    if (length != 2) {
+      sendNak(seq, NakBadRequest);
+      return;
+    }
+
+    if (fileHandle < 0) {
+      sendNak(seq, NakNoFile);
+      return;
+    }
+
+    const unsigned int wanted = std::min<unsigned int>(readU16(payload), FRAME_MAX_PAYLOAD);
+    const int read = wanted > 0 ? readFile(fileHandle, txPayload, wanted) : 0;
+
+    if (read < 0) {
+      sendNak(seq, NakModemError);
+      return;
+    }
+
+    // An empty ACK marks the end of the file.
+    sendAck(seq, read);
+  }
+
+  void handleClose(const uint8_t seq) {
+    if (fileHandle < 0) {
+      sendNak(seq, NakNoFile);
+      return;
+    }
+
+    if (!closeCurrentFile()) {
+      sendNak(seq, NakModemError);
+      return;
+    }
+
+    sendAck(seq);
+  }
+
+  void handleDelete(const uint8_t seq, const uint8_t *payload, const size_t length) {
+    char fullPath[64];
+
+    if (!getFullPath(payload, length, fullPath, sizeof(fullPath))) {
+      sendNak(seq, NakBadRequest);
+      return;
+    }
+
+    if (!deleteFile(fullPath)) {
+      sendNak(seq, NakModemError);
+      return;
+    }
+
+    sendAck(seq);
+  }
+
+  // -1 for a file that doesn't exist.
+  void handleSize(const uint8_t seq, const uint8_t *payload, const size_t length) {
+    char fullPath[64];
+
+    if (!getFullPath(payload, length, fullPath, sizeof(fullPath))) {
+      sendNak(seq, NakBadRequest);
+      return;
+    }
+
+    const int32_t size = getFileSize(fullPath);
+
+    for (int i = 0; i < 4; i++) {
+      txPayload[i] = (static_cast<uint32_t>(size) >> (8 * i)) & 0xFF;
+    }
+
+    sendAck(seq, 4);
+  }
+
+  void handleFrame() {
+    const uint8_t type = rxFrame[0];
+    const uint8_t seq = rxFrame[1];
+    const size_t length = readU16(rxFrame + 2);
+    const uint8_t *payload = rxFrame + FRAME_HEADER_SIZE;
+
+    sessionLastFrameMillis = millis();
+
+    if (type != FrameHello && !sessionActive) {
+      sendNak(seq, NakBadRequest);
+      return;
+    }
+
+    if (type != FrameHello && hasLastReply && seq == lastSeq) {
+      Serial.write(txFrame, txLength);
+      return;
+    }
+
+    switch (type) {
+    case FrameHello:
+      handleHello(seq);
+      break;
+    case FrameOpen:
+      handleOpen(seq, payload, length);
+      break;
+    case FrameWrite:
+      handleWrite(seq, payload, length);
+      break;
+    case FrameRead:
+      handleRead(seq, payload, length);
+      break;
+    case FrameClose:
+      handleClose(seq);
+      break;
+    case FrameDelete:
+      handleDelete(seq, payload, length);
+      break;
+    case FrameSize:
+      handleSize(seq, payload, length);
+      break;
+    case FrameBye:
+      // Acknowledged first, the host doesn't need to wait for the modem's rate to go back.
+      sendAck(seq);
+      endSession();
+      break;
+    default:
+      sendNak(seq, NakUnknownType);
+      break;
+    }
+  }
+}
+
+void beginHostStream() {
+  LOG_INFOLN(F("Waiting for the host to stream MP3s at %lu baud..."),
+             static_cast<unsigned long>(HOST_STREAM_BAUD_RATE));
+}
+
+void processHostStream() {
+  if (receiveFrame()) {
+    handleFrame();
+  }
+
+  if (sessionActive && millis() - sessionLastFrameMillis > SESSION_TIMEOUT) {
+    LOG_WARNLN(F("Host went quiet, ending the session"));
+    endSession();
+  }
+}
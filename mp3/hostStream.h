@@ -0,0 +1,18 @@
+#pragma once
+
+// The host link runs faster than the logs need, so a clip crosses it quicker than the modem can
+// take it. The RX buffer holds a few frames while the modem is busy with a write.
+#define HOST_STREAM_BAUD_RATE 921600
+#define HOST_STREAM_RX_BUFFER_SIZE 4096
+
+// Turns the board into a file proxy for stream.py: the host sends framed file operations over USB
+// serial, and they're carried out on the modem's filesystem. Only the modem's storage limits the
+// library, nothing is compiled into the firmware.
+//
+// Every frame is 0xA5 0x5A, type, seq, payload length (16 bit LE), payload, and a CRC16-CCITT
+// (LE) over everything from type to the end of the payload. The host sends one request at a time
+// and waits for its ACK or NAK, resending it when none comes. A repeated seq gets the last reply
+// again instead of running the request twice. Logs keep going to the same port: they're plain
+// text, which the host skips while looking for the next frame.
+void beginHostStream();
+void processHostStream();
@@ -0,0 +1,200 @@
+#include "modemFs.h"
+#include "../src/common/logger.h"
+#include "../src/config.h"
+#include <algorithm>
+
+#define GENERIC_DELAY 50
+
+// The transfer runs at a higher UART rate, and the runtime rate is restored when it's done.
+#define TRANSFER_BAUD_RATE 921600
+// Files go out in chunks of this size, each checked against the file position before the next.
+// A failed chunk is resent from where the last good one ended, not from the start of the file.
+#define WRITE_CHUNK_SIZE 4096
+#define WRITE_CHUNK_RETRIES 3
+
+TinyGsm _modemImpl = TinyGsm(SerialAT);
+
+void sendCommand(const char *command) {
+  LOG_INFOLN(F("Sending command: AT%s"), command);
+  _modemImpl.sendAT(command);
+}
+
+void sendCommand(const __FlashStringHelper *command) {
+  LOG_INFOLN(F("Sending command: AT%s"), command);
+  _modemImpl.sendAT(command);
+}
+
+int openFile(const char *fullPath, const int mode) {
+  char param[80];
+  snprintf(param, sizeof(param), "+FSOPEN=%s,%d", fullPath, mode);
+  sendCommand(param);
+
+  if (_modemImpl.waitResponse(3000UL, "+FSOPEN: ") != 1) {
+    LOG_ERRORLN(F("Open file failed for: %s"), fullPath);
+    return -1;
+  }
+
+  const int fileHandle = _modemImpl.stream.readStringUntil('\n').toInt();
+  _modemImpl.waitResponse();
+
+  return fileHandle;
+}
+
+bool closeFile(const int fileHandle) {
+  char param[20];
+  snprintf(param, sizeof(param), "+FSCLOSE=%d", fileHandle);
+  sendCommand(param);
+
+  return _modemImpl.waitResponse() == 1;
+}
+
+bool writeChunk(const int fileHandle, const unsigned char *data, const unsigned int length) {
+  char param[32];
+  snprintf(param, sizeof(param), "+FSWRITE=%d,%u,10", fileHandle, length);
+  sendCommand(param);
+
+  if (_modemImpl.waitResponse(3000UL, "CONNECT") != 1) {
+    return false;
+  }
+
+  _modemImpl.stream.write(data, length);
+
+  return _modemImpl.waitResponse(10000UL) == 1;
+}
+
+// Returns the file position, or -1.
+int getFilePosition(const int fileHandle) {
+  char param[24];
+  snprintf(param, sizeof(param), "+FSPOSITION=%d", fileHandle);
+  sendCommand(param);
+
+  if (_modemImpl.waitResponse(2000UL, "+FSPOSITION: ") != 1) {
+    return -1;
+  }
+
+  const int position = _modemImpl.stream.readStringUntil('\n').toInt();
+  _modemImpl.waitResponse();
+
+  return position;
+}
+
+int readFile(const int fileHandle, unsigned char *data, const unsigned int length) {
+  char param[32];
+  snprintf(param, sizeof(param), "+FSREAD=%d,%u", fileHandle, length);
+  sendCommand(param);
+
+  if (_modemImpl.waitResponse(3000UL, "CONNECT") != 1) {
+    return -1;
+  }
+
+  // "CONNECT <n>", where n can be short of what was asked for at the end of the file.
+  const int available = _modemImpl.stream.readStringUntil('\n').toInt();
+  const size_t read =
+      _modemImpl.stream.readBytes(data, std::min(static_cast<unsigned int>(available), length));
+  _modemImpl.waitResponse();
+
+  return static_cast<int>(read);
+}
+
+bool seekFile(const int fileHandle, const unsigned int offset) {
+  char param[32];
+  snprintf(param, sizeof(param), "+FSSEEK=%d,%u,0", fileHandle, offset);
+  sendCommand(param);
+
+  return _modemImpl.waitResponse() == 1;
+}
+
+bool writeFile(const int fileHandle, const unsigned char *data, const unsigned int length) {
+  unsigned int offset = 0;
+  unsigned int retries = 0;
+
+  while (offset < length) {
+    const unsigned int chunk = std::min(length - offset,
+                                        static_cast<unsigned int>(WRITE_CHUNK_SIZE));
+    const bool written = writeChunk(fileHandle, data + offset, chunk);
+
+    if (written && getFilePosition(fileHandle) == static_cast<int>(offset + chunk)) {
+      offset += chunk;
+      retries = 0;
+      continue;
+    }
+
+    if (++retries > WRITE_CHUNK_RETRIES) {
+      LOG_ERRORLN(F("Chunk at %u failed %u times, giving up"), offset, WRITE_CHUNK_RETRIES);
+      return false;
+    }
+
+    LOG_WARNLN(F("Chunk at %u failed, resending (%u)"), offset, retries);
+
+    if (!seekFile(fileHandle, offset)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool setModemBaudRate(const unsigned long baudRate) {
+  char param[24];
+  snprintf(param, sizeof(param), "+IPR=%lu", baudRate);
+  sendCommand(param);
+
+  // The OK still comes at the old rate.
+  if (_modemImpl.waitResponse() != 1) {
+    return false;
+  }
+
+  SerialAT.updateBaudRate(baudRate);
+  delay(GENERIC_DELAY);
+
+  return _modemImpl.testAT(1000UL);
+}
+
+void raiseBaudRate() {
+  if (setModemBaudRate(TRANSFER_BAUD_RATE)) {
+    LOG_INFOLN(F("Transferring at %lu baud"), static_cast<unsigned long>(TRANSFER_BAUD_RATE));
+    return;
+  }
+
+  LOG_WARNLN(F("Modem didn't take %lu baud, staying at %lu"),
+             static_cast<unsigned long>(TRANSFER_BAUD_RATE),
+             static_cast<unsigned long>(kModemBaudRate));
+
+  // Whichever side didn't switch, make both agree on the runtime rate again.
+  SerialAT.updateBaudRate(kModemBaudRate);
+
+  if (!_modemImpl.testAT(1000UL)) {
+    SerialAT.updateBaudRate(TRANSFER_BAUD_RATE);
+    setModemBaudRate(kModemBaudRate);
+  }
+}
+
+// The modem keeps its rate across power cycles, and the phone expects the runtime one.
+void restoreBaudRate() {
+  if (!setModemBaudRate(kModemBaudRate)) {
+    LOG_ERRORLN(F("Failed to restore %lu baud!"), static_cast<unsigned long>(kModemBaudRate));
+  }
+}
+
+bool deleteFile(const char *fullPath) {
+  char param[72];
+  snprintf(param, sizeof(param), "+FSDEL=%s", fullPath);
+  sendCommand(param);
+
+  return _modemImpl.waitResponse() == 1;
+}
+
+int getFileSize(const char *fullPath) {
+  char param[72];
+  snprintf(param, sizeof(param), "+FSATTRI=%s", fullPath);
+  sendCommand(param);
+
+  if (_modemImpl.waitResponse(2000UL, "+FSATTRI: ") != 1) {
+    return -1;
+  }
+
+  const int size = _modemImpl.stream.readStringUntil('\n').toInt();
+  _modemImpl.waitResponse();
+
+  return size;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <TinyGsmClient.h>
+
+#define MP3_DIR "C:/mp3"
+
+// File operations on the modem's filesystem, shared by both upload modes.
+extern TinyGsm _modemImpl;
+
+void sendCommand(const char *command);
+void sendCommand(const __FlashStringHelper *command);
+
+// Modes as per +FSOPEN: 0 creates or opens, 1 creates or truncates, 2 opens an existing file.
+// Returns the file handle, or -1.
+int openFile(const char *fullPath, const int mode);
+bool closeFile(const int fileHandle);
+bool writeFile(const int fileHandle, const unsigned char *data, const unsigned int length);
+// Returns the number of bytes read, 0 at the end of the file, or -1.
+int readFile(const int fileHandle, unsigned char *data, const unsigned int length);
+bool deleteFile(const char *fullPath);
+// Returns the file size, or -1 if it doesn't exist.
+int getFileSize(const char *fullPath);
+
+// Switches the modem UART to the transfer rate, and back to the runtime rate.
+void raiseBaudRate();
+void restoreBaudRate();
@@ -0,0 +1,308 @@
+#!/usr/bin/env python3
+"""Streams a folder of MP3s to the modem through an uploader built with MP3_HOST_STREAM.
+
+Only files that are new or changed since the last run are sent, like the compiled-in uploader
+does: both keep the same manifest.txt on the modem. See hostStream.h for the frame format.
+"""
+import argparse
+import os
+import struct
+import sys
+import time
+
+from generate import fnv1a32, unique_mp3_files
+
+SOF = b"\xa5\x5a"
+HEADER = struct.Struct("<BBH")
+
+HELLO, OPEN, WRITE, READ, CLOSE, DELETE, SIZE, BYE = range(0x01, 0x09)
+ACK, NAK = 0x80, 0x81
+
+NAK_REASONS = {1: "unknown type", 2: "bad request", 3: "no open file", 4: "modem error"}
+
+# As per +FSOPEN.
+MODE_TRUNCATE, MODE_EXISTING = 1, 2
+
+# The device's FRAME_MAX_PAYLOAD, HELLO says what it actually takes.
+MAX_PAYLOAD = 1024
+
+# How long to wait for replies to the frames that make the device write to the modem.
+MODEM_WRITE_TIMEOUT = 10.0
+
+MANIFEST_FILE = "manifest.txt"
+PROTOCOL_VERSION = 1
+
+
+class StreamError(Exception):
+    pass
+
+
+def crc16(data):
+    """CRC16-CCITT (0x1021, starting at 0xFFFF), the same as the device's."""
+    crc = 0xFFFF
+    for byte in data:
+        crc ^= byte << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) & 0xFFFF if crc & 0x8000 else (crc << 1) & 0xFFFF
+    return crc
+
+
+def encode_frame(frame_type, seq, payload=b""):
+    body = HEADER.pack(frame_type, seq, len(payload)) + payload
+    return SOF + body + struct.pack("<H", crc16(body))
+
+
+class Link:
+    """One request at a time, resent until its reply comes back."""
+
+    def __init__(self, port, timeout, retries, verbose):
+        self.port = port
+        self.timeout = timeout
+        self.retries = retries
+        self.verbose = verbose
+        self.seq = 0
+        self.buffer = bytearray()
+        self.log_line = bytearray()
+        self.max_payload = 0
+        self.write_buffer_size = 0
+
+    def request(self, frame_type, payload=b"", timeout=None):
+        self.seq = (self.seq + 1) & 0xFF
+        frame = encode_frame(frame_type, self.seq, payload)
+
+        for _ in range(self.retries + 1):
+            self.port.write(frame)
+            reply = self._wait_for_reply(timeout or self.timeout)
+            if reply is None:
+                continue
+            reply_type, reply_payload = reply
+            if reply_type == NAK:
+                reason = reply_payload[0] if reply_payload else 0
+                raise StreamError(NAK_REASONS.get(reason, f"error {reason}"))
+            return reply_payload
+
+        raise StreamError("no reply from the device")
+
+    def _wait_for_reply(self, timeout):
+        deadline = time.monotonic() + timeout
+        while time.monotonic() < deadline:
+            frame = self._parse()
+            if frame is not None:
+                frame_type, seq, payload = frame
+                # A late reply to an earlier attempt.
+                if seq == self.seq:
+                    return frame_type, payload
+                continue
+            data = self.port.read(max(1, self.port.in_waiting))
+            self.buffer += data
+        return None
+
+    def _parse(self):
+        """Pops the next good frame from the buffer. Whatever comes before it is device log."""
+        start = self.buffer.find(SOF)
+        if start < 0:
+            # Keep a trailing 0xA5, it may be the start of a frame.
+            keep = 1 if self.buffer.endswith(SOF[:1]) else 0
+            self._log(self.buffer[:len(self.buffer) - keep])
+            del self.buffer[:len(self.buffer) - keep]
+            return None
+
+        self._log(self.buffer[:start])
+        del self.buffer[:start]
+
+        if len(self.buffer) < len(SOF) + HEADER.size:
+            return None
+        frame_type, seq, length = HEADER.unpack_from(self.buffer, len(SOF))
+        if length > MAX_PAYLOAD:
+            del self.buffer[:1]
+            return self._parse()
+        end = len(SOF) + HEADER.size + length + 2
+        if len(self.buffer) < end:
+            return None
+
+        body = bytes(self.buffer[len(SOF):end - 2])
+        (crc,) = struct.unpack_from("<H", self.buffer, end - 2)
+        if crc != crc16(body):
+            # Not a frame after all, look for the next one.
+            del self.buffer[:1]
+            return self._parse()
+
+        del self.buffer[:end]
+        return frame_type, seq, body[HEADER.size:]
+
+    def _log(self, data):
+        for byte in data:
+            if byte == ord("\n"):
+                if self.verbose:
+                    print("device: " + self.log_line.decode("ascii", "replace").rstrip())
+                self.log_line.clear()
+            else:
+                self.log_line.append(byte)
+
+    def hello(self):
+        # The device sets up the modem before it answers.
+        payload = self.request(HELLO, timeout=max(self.timeout, 5.0))
+        version = payload[0] if payload else 0
+        if version != PROTOCOL_VERSION:
+            raise StreamError(f"device speaks version {version}, expected {PROTOCOL_VERSION}")
+        self.max_payload, self.write_buffer_size = struct.unpack_from("<HH", payload, 1)
+
+    def file_size(self, name):
+        (size,) = struct.unpack("<i", self.request(SIZE, name.encode()))
+        return size
+
+    def read_file(self, name):
+        self.request(OPEN, bytes([MODE_EXISTING]) + name.encode())
+        data = bytearray()
+        try:
+            while True:
+                chunk = self.request(READ, struct.pack("<H", self.max_payload))
+                if not chunk:
+                    break
+                data += chunk
+        finally:
+            self.request(CLOSE)
+        return bytes(data)
+
+    def write_file(self, name, data):
+        self.request(OPEN, bytes([MODE_TRUNCATE]) + name.encode())
+        try:
+            for offset in range(0, len(data), self.max_payload):
+                end = min(offset + self.max_payload, len(data))
+                # The device only acknowledges a frame that fills its buffer once the modem has it.
+                flushes = end // self.write_buffer_size > offset // self.write_buffer_size
+                self.request(WRITE, data[offset:end],
+                             timeout=MODEM_WRITE_TIMEOUT if flushes else None)
+        finally:
+            # Writes what's left in the device's buffer.
+            self.request(CLOSE, timeout=MODEM_WRITE_TIMEOUT)
+
+    def delete_file(self, name):
+        self.request(DELETE, name.encode())
+
+    def bye(self):
+        self.request(BYE)
+
+
+def parse_manifest(text):
+    """Lines of "<file name>,<length>,<hash in hex>", as the uploader writes them."""
+    manifest = {}
+    for line in text.splitlines():
+        parts = line.split(",")
+        if len(parts) != 3:
+            continue
+        try:
+            manifest[parts[0]] = (int(parts[1]), int(parts[2], 16))
+        except ValueError:
+            continue
+    return manifest
+
+
+def read_manifest(link):
+    size = link.file_size(MANIFEST_FILE)
+    if size <= 0:
+        print("No manifest on the modem, uploading everything")
+        return {}
+    manifest = parse_manifest(link.read_file(MANIFEST_FILE).decode("ascii", "replace"))
+    print(f"Manifest lists {len(manifest)} files")
+    return manifest
+
+
+def sync(link, folder):
+    # Names that share a clip use the first file that has it, like the main app expects.
+    names, canonical = unique_mp3_files(folder)
+    names = [name for name in names if canonical[name] == name]
+    library = {}
+    for name in names:
+        with open(os.path.join(folder, name), "rb") as f:
+            library[name] = f.read()
+
+    link.hello()
+    manifest = read_manifest(link)
+
+    # Anything the manifest doesn't list, like the phone's announcement clips, is left alone.
+    deleted = 0
+    for name in manifest:
+        if name not in library:
+            link.delete_file(name)
+            print(f"Deleted stale file: {name}")
+            deleted += 1
+
+    uploaded = {}
+    sent = skipped = failed = sent_bytes = 0
+    start = time.monotonic()
+
+    for index, name in enumerate(names, 1):
+        data = library[name]
+        entry = (len(data), fnv1a32(data))
+
+        if manifest.get(name) == entry:
+            print(f"[{index}/{len(names)}] {name} unchanged")
+            uploaded[name] = entry
+            skipped += 1
+            continue
+
+        file_start = time.monotonic()
+        try:
+            link.write_file(name, data)
+        except StreamError as e:
+            print(f"[{index}/{len(names)}] Write file failed for {name}: {e}")
+            failed += 1
+            continue
+
+        elapsed = time.monotonic() - file_start
+        uploaded[name] = entry
+        sent += 1
+        sent_bytes += len(data)
+        print(f"[{index}/{len(names)}] {name}: {len(data)} bytes in {elapsed * 1000:.0f} ms "
+              f"({len(data) / elapsed if elapsed > 0 else 0:.0f} B/s)")
+
+    # Written last, and only lists files that made it, so an interrupted run is picked up later.
+    text = "".join(f"{name},{length},{value:08x}\n" for name, (length, value) in uploaded.items())
+    link.write_file(MANIFEST_FILE, text.encode())
+    link.bye()
+
+    elapsed = time.monotonic() - start
+    print(f"Done: {sent} uploaded, {skipped} unchanged, {deleted} deleted, {failed} failed")
+    print(f"Sent {sent_bytes} bytes in {elapsed * 1000:.0f} ms "
+          f"({sent_bytes / elapsed if elapsed > 0 else 0:.0f} B/s)")
+    return failed == 0
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Upload a folder of MP3 files to the modem through the streaming uploader."
+    )
+    parser.add_argument("folder", help="Folder containing MP3 files")
+    parser.add_argument("-p", "--port", required=True, help="Serial port of the board")
+    parser.add_argument("-b", "--baud", type=int, default=921600,
+                        help="Host link baud rate, HOST_STREAM_BAUD_RATE (default: 921600).")
+    parser.add_argument("--timeout", type=float, default=1.0,
+                        help="Seconds to wait for a reply before resending (default: 1).")
+    parser.add_argument("--retries", type=int, default=5,
+                        help="Resends before giving up on a request (default: 5).")
+    parser.add_argument("-v", "--verbose", action="store_true", help="Print the device's logs.")
+    args = parser.parse_args()
+
+    if not os.path.isdir(args.folder):
+        print(f"Error: '{args.folder}' is not a valid directory.")
+        sys.exit(1)
+
+    try:
+        import serial
+    except ImportError:
+        print("Error: stream.py needs pyserial (pip install pyserial).")
+        sys.exit(1)
+
+    with serial.Serial(args.port, args.baud, timeout=0.05) as port:
+        try:
+            ok = sync(Link(port, args.timeout, args.retries, args.verbose), args.folder)
+        except StreamError as e:
+            print(f"Error: {e}")
+            sys.exit(1)
+
+    sys.exit(0 if ok else 1)
+
+
+if __name__ == "__main__":
+    main()
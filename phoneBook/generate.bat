@@ -1 +1 @@
-python generate.py -o ../src/generated/phoneBook.h
\ No newline at end of file
+python generate.py -o ../src/generated/phoneBook.h -b pb.bin
\ No newline at end of file
@@ -1,10 +1,13 @@
 #!/usr/bin/env python3
 import argparse
 import os
+import re
+import struct
 
 def main():
     parser = argparse.ArgumentParser(description="Generate phoneBook.h from pb.txt")
     parser.add_argument("-o", "--output", required=True, help="Full path and filename for the generated file")
+    parser.add_argument("-b", "--binary", help="Also write the phone book image here, for uploading over WiFi")
     args = parser.parse_args()
 
     with open("pb.txt", "r") as pb_file:
@@ -21,9 +24,15 @@ def main():
             continue
         entry = parts[0].strip()
         number = parts[1].strip()
+        if not entry.isdigit() or not entry.isascii():
+            print("Skipping entry that can't be dialed:", line)
+            continue
         entries.append((entry, number))
 
-    header_content = generate_header(entries)
+    dial_plan = parse_dial_plan("dialPlan.txt")
+
+    image = build_image(entries)
+    header_content = generate_header(image, build_dial_plan_dfa(dial_plan))
 
     output_path = args.output
     os.makedirs(os.path.dirname(output_path), exist_ok=True)
@@ -31,52 +40,152 @@ def main():
         out_file.write(header_content)
     print("Generated", output_path)
 
-def generate_header(entries):
-    entries_lines = []
+    if args.binary:
+        with open(args.binary, "wb") as out_file:
+            out_file.write(image)
+        print("Generated", args.binary)
+
+IMAGE_MAGIC = b"TPB1"
+IMAGE_MAX_POOL_SIZE = 0xFFFF
+
+def build_image(entries):
+    """The phone book as the phone stores it: a header (magic, entry count, pool size), an index of
+    (entry offset, number offset) pairs sorted by entry, then a pool of NUL terminated strings.
+    Everything is little endian, offsets are into the pool, and equal strings are stored once."""
+    unique = {}
     for entry, number in entries:
-        entries_lines.append('    { "%s", "%s" }' % (entry, number))
-    entries_str = ",\n".join(entries_lines)
+        if entry in unique:
+            print("Duplicate entry, using the first one:", entry)
+            continue
+        unique[entry] = number
+
+    pool = bytearray()
+    offsets = {}
+    def intern(text):
+        if text not in offsets:
+            offsets[text] = len(pool)
+            pool.extend(text.encode("ascii") + b"\0")
+        return offsets[text]
+
+    index = bytearray()
+    for entry in sorted(unique):
+        index += struct.pack("<HH", intern(entry), intern(unique[entry]))
+    if len(pool) > IMAGE_MAX_POOL_SIZE:
+        raise ValueError("The phone book doesn't fit in %d bytes of strings" % IMAGE_MAX_POOL_SIZE)
+    return IMAGE_MAGIC + struct.pack("<HH", len(unique), len(pool)) + index + pool
+
+def parse_digit_set(text):
+    """The digits of a [...] set, e.g. "0-13-9" is every digit but 2."""
+    digits = set()
+    for low, high in re.findall(r"(\d)(?:-(\d))?", text):
+        digits.update(range(int(low), int(high or low) + 1))
+    return frozenset(digits)
+
+def parse_dial_plan(path):
+    """Returns (pattern, pending) per line, where a pattern is the set of digits for each position."""
+    rules = []
+    with open(path, "r") as plan_file:
+        for line in plan_file:
+            line = line.split("#", 1)[0].strip()
+            if not line:
+                continue
+            pending = line.startswith("pending ")
+            if pending:
+                line = line[len("pending "):].strip()
+            if not re.fullmatch(r"(\d|X|\[[\d-]+\])+", line):
+                raise ValueError(f"Invalid dial plan pattern: {line}")
+            pattern = []
+            for token in re.findall(r"\d|X|\[[\d-]+\]", line):
+                if token == "X":
+                    pattern.append(frozenset(range(10)))
+                elif token.startswith("["):
+                    pattern.append(parse_digit_set(token[1:-1]))
+                else:
+                    pattern.append(frozenset([int(token)]))
+            rules.append((tuple(pattern), pending))
+    return rules
+
+def build_dial_plan_dfa(rules):
+    """Subset construction over (rule, position) pairs, then minimization. Returns the result and
+    the next state for every digit, per state. State 0 is the empty number."""
+    def result(positions):
+        if any(pos == len(rules[rule][0]) and not rules[rule][1] for rule, pos in positions):
+            return "Valid"
+        if positions or not rules:
+            return "Pending"
+        return "Invalid"
+
+    start = frozenset((rule, 0) for rule in range(len(rules)))
+    states = [start]
+    index = {start: 0}
+    transitions = []
+    for positions in states:
+        row = []
+        for digit in range(10):
+            following = frozenset((rule, pos + 1) for rule, pos in positions
+                                  if pos < len(rules[rule][0]) and digit in rules[rule][0][pos])
+            if following not in index:
+                index[following] = len(states)
+                states.append(following)
+            row.append(index[following])
+        transitions.append(row)
+    results = [result(positions) for positions in states]
+    # The empty number always waits for digits, even when no rule could use them.
+    results[0] = "Pending"
+
+    # Moore minimization: split states by result, then by where their digits lead, until stable.
+    groups = results[:]
+    while True:
+        signatures = [(groups[s], tuple(groups[t] for t in transitions[s]))
+                      for s in range(len(states))]
+        numbering = {}
+        refined = [numbering.setdefault(signature, len(numbering)) for signature in signatures]
+        if len(numbering) == len(set(groups)):
+            break
+        groups = refined
+    # Number the groups so the start state stays 0.
+    order = {}
+    for state in range(len(states)):
+        order.setdefault(refined[state], len(order))
+    dfa = [None] * len(order)
+    for state in range(len(states)):
+        dfa[order[refined[state]]] = (results[state],
+                                      [order[refined[t]] for t in transitions[state]])
+    if len(dfa) > 256:
+        raise ValueError("The dial plan needs more than 256 states")
+    return dfa
+
+def generate_header(image, dial_plan):
+    image_lines = []
+    for start in range(0, len(image), 16):
+        image_lines.append("    " + ", ".join("0x%02x" % byte for byte in image[start:start + 16]))
+    image_str = ",\n".join(image_lines)
+
+    dial_plan_lines = []
+    for result, following in dial_plan:
+        dial_plan_lines.append("    { DialedNumberValidationResult::%s, { %s } }"
+                               % (result, ", ".join(str(state) for state in following)))
+    dial_plan_str = ",\n".join(dial_plan_lines)
 
     header = f"""// This is a generated file. Do not edit manually.
 #pragma once
-#include <cstring>
+#include "common/phoneBook.h"
+#include <cstdint>
 
-struct PhoneBookEntry {{
-    const char* entry;
-    const char* number;
+// pb.txt in the phone book image format, used until one is uploaded over WiFi.
+static constexpr uint8_t phoneBookImage[] = {{
+{image_str}
 }};
 
-static const PhoneBookEntry phoneBookEntries[] = {{
-{entries_str}
+// dialPlan.txt as a DFA over the dialed digits. State 0 is the empty number.
+struct DialPlanState {{
+    DialedNumberValidationResult result;
+    uint8_t next[10];
 }};
 
-inline bool isPartialOfFullPhoneBookEntry(const char* number) {{
-    for (size_t i = 0; i < sizeof(phoneBookEntries)/sizeof(phoneBookEntries[0]); ++i) {{
-        size_t len = std::strlen(number);
-        if (std::strncmp(phoneBookEntries[i].entry, number, len) == 0) {{
-            return true;
-        }}
-    }}
-    return false;
-}}
-
-inline bool isPhoneBookEntry(const char* number) {{
-    for (size_t i = 0; i < sizeof(phoneBookEntries)/sizeof(phoneBookEntries[0]); ++i) {{
-        if (std::strcmp(phoneBookEntries[i].entry, number) == 0) {{
-            return true;
-        }}
-    }}
-    return false;
-}}
-
-inline const char* getPhoneBookNumberForEntry(const char* entry) {{
-    for (size_t i = 0; i < sizeof(phoneBookEntries)/sizeof(phoneBookEntries[0]); ++i) {{
-        if (std::strcmp(phoneBookEntries[i].entry, entry) == 0) {{
-            return phoneBookEntries[i].number;
-        }}
-    }}
-    return nullptr;
-}}
+static constexpr DialPlanState dialPlanStates[] = {{
+{dial_plan_str}
+}};
 """
     return header
 
@@ -0,0 +1,94 @@
+#include "announcementCache.h"
+#include "logger.h"
+#include "string.h"
+#include <Preferences.h>
+
+namespace {
+  const constexpr char *kPreferencesNamespace = "announce";
+  const constexpr char *kIndexKey = "index";
+}
+
+void AnnouncementCache::init() {
+  for (size_t i = 0; i < kAnnouncementCacheSlots; i++) {
+    AnnouncementSlot &slot = _slots[i];
+
+    slot.number[0] = '\0';
+    snprintf(slot.fileName, sizeof(slot.fileName), "ann_%u.mp3", static_cast<unsigned>(i));
+    slot.lastUsed = 0;
+  }
+
+  load();
+}
+
+const char *AnnouncementCache::find(const char *number) {
+  for (AnnouncementSlot &slot : _slots) {
+    if (slot.number[0] != '\0' && strEqual(slot.number, number)) {
+      // Only kept in RAM, persisting every play would wear the flash for little gain.
+      slot.lastUsed = ++_clock;
+      return slot.fileName;
+    }
+  }
+
+  return nullptr;
+}
+
+size_t AnnouncementCache::reserve() {
+  size_t victim = 0;
+
+  for (size_t i = 0; i < kAnnouncementCacheSlots; i++) {
+    if (_slots[i].number[0] == '\0') {
+      victim = i;
+      break;
+    }
+
+    if (_slots[i].lastUsed < _slots[victim].lastUsed) {
+      victim = i;
+    }
+  }
+
+  if (_slots[victim].number[0] != '\0') {
+    LOG_INFOLN(F("Evicting announcement for %s"), _slots[victim].number);
+    _slots[victim].number[0] = '\0';
+    save();
+  }
+
+  return victim;
+}
+
+void AnnouncementCache::commit(const size_t slot, const char *number) {
+  snprintf(_slots[slot].number, sizeof(_slots[slot].number), "%s", number);
+  _slots[slot].lastUsed = ++_clock;
+  save();
+}
+
+const char *AnnouncementCache::getFileName(const size_t slot) const {
+  return _slots[slot].fileName;
+}
+
+void AnnouncementCache::load() {
+  Preferences preferences;
+  preferences.begin(kPreferencesNamespace, true);
+
+  AnnouncementSlot stored[kAnnouncementCacheSlots];
+
+  if (preferences.getBytesLength(kIndexKey) == sizeof(stored) &&
+      preferences.getBytes(kIndexKey, stored, sizeof(stored)) == sizeof(stored)) {
+    for (size_t i = 0; i < kAnnouncementCacheSlots; i++) {
+      snprintf(_slots[i].number, sizeof(_slots[i].number), "%s", stored[i].number);
+      _slots[i].lastUsed = stored[i].lastUsed;
+
+      if (_slots[i].lastUsed > _clock) {
+        _clock = _slots[i].lastUsed;
+      }
+    }
+  }
+
+  preferences.end();
+}
+
+void AnnouncementCache::save() {
+  Preferences preferences;
+  preferences.begin(kPreferencesNamespace, false);
+  preferences.putBytes(kIndexKey, _slots, sizeof(_slots));
+  preferences.end();
+}
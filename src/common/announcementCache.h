@@ -0,0 +1,38 @@
+#pragma once
+
+#include "consts.h"
+#include <Arduino.h>
+
+const constexpr size_t kAnnouncementCacheSlots = 8;
+
+struct AnnouncementSlot {
+  char number[kMediumBufferSize];
+  // Relative to kMp3Dir, as playMp3 expects.
+  char fileName[kSmallBufferSize];
+  uint32_t lastUsed;
+};
+
+// Remembers which callers already have a rendered announcement on the modem filesystem. Each slot
+// owns one file, and the least recently used slot is the one that gets overwritten. The index
+// lives in NVS so the files stay useful across reboots.
+class AnnouncementCache {
+public:
+  void init();
+
+  // Returns the slot's file name, or nullptr if the number has no announcement.
+  const char *find(const char *number);
+
+  // Picks the slot to render into and forgets what it held, so a half-written file is never
+  // played. Returns the slot's index.
+  size_t reserve();
+  void commit(const size_t slot, const char *number);
+
+  const char *getFileName(const size_t slot) const;
+
+private:
+  void load();
+  void save();
+
+  AnnouncementSlot _slots[kAnnouncementCacheSlots];
+  uint32_t _clock = 0;
+};
@@ -0,0 +1,235 @@
+#include "atParser.h"
+
+namespace {
+  const char *skipSpaces(const char *p) {
+    while (*p == ' ') {
+      ++p;
+    }
+
+    return p;
+  }
+
+  // Consumes "<prefix>:" and any spaces after it.
+  const char *parsePrefix(const char *p, const char *prefix) {
+    while (*prefix != '\0') {
+      if (*p != *prefix) {
+        return nullptr;
+      }
+
+      ++p;
+      ++prefix;
+    }
+
+    if (*p != ':') {
+      return nullptr;
+    }
+
+    return skipSpaces(p + 1);
+  }
+
+  const char *parseInt(const char *p, int &value) {
+    if (p == nullptr) {
+      return nullptr;
+    }
+
+    bool negative = false;
+
+    if (*p == '-') {
+      negative = true;
+      ++p;
+    }
+
+    if (*p < '0' || *p > '9') {
+      return nullptr;
+    }
+
+    int result = 0;
+
+    while (*p >= '0' && *p <= '9') {
+      result = result * 10 + (*p - '0');
+      ++p;
+    }
+
+    value = negative ? -result : result;
+    return p;
+  }
+
+  const char *parseComma(const char *p) {
+    if (p == nullptr || *p != ',') {
+      return nullptr;
+    }
+
+    return p + 1;
+  }
+
+  // Whether the previous field ended cleanly, either at the end of the line or at a separator.
+  bool atFieldEnd(const char *p) {
+    return p != nullptr && (*p == '\0' || *p == ',');
+  }
+
+  // Copies a "quoted" field into value. Returns nullptr if it doesn't parse, setting result unless
+  // an earlier field already failed.
+  const char *parseQuoted(const char *p, char *value, const size_t size, AtParseResult &result) {
+    value[0] = '\0';
+
+    if (p == nullptr) {
+      return nullptr;
+    }
+
+    if (*p != '"') {
+      result = AtParseResult::Malformed;
+      return nullptr;
+    }
+
+    ++p;
+
+    size_t len = 0;
+
+    while (*p != '"') {
+      if (*p == '\0') {
+        value[0] = '\0';
+        result = AtParseResult::Malformed;
+        return nullptr;
+      }
+
+      if (len == size - 1) {
+        value[0] = '\0';
+        result = AtParseResult::FieldTooLong;
+        return nullptr;
+      }
+
+      value[len++] = *p++;
+    }
+
+    value[len] = '\0';
+    return p + 1;
+  }
+}
+
+AtParseResult parseClcc(const char *line, ClccRecord &record) {
+  AtParseResult result = AtParseResult::Malformed;
+  const char *p = parsePrefix(line, "+CLCC");
+
+  p = parseInt(p, record.id);
+  p = parseInt(parseComma(p), record.direction);
+  p = parseInt(parseComma(p), record.status);
+  p = parseInt(parseComma(p), record.mode);
+  p = parseInt(parseComma(p), record.mpty);
+
+  if (!atFieldEnd(p)) {
+    return AtParseResult::Malformed;
+  }
+
+  record.number[0] = '\0';
+
+  // The number (and everything after it) is optional.
+  if (*p == '\0') {
+    return AtParseResult::Ok;
+  }
+
+  p = parseQuoted(parseComma(p), record.number, sizeof(record.number), result);
+
+  if (p == nullptr) {
+    return result;
+  }
+
+  return atFieldEnd(p) ? AtParseResult::Ok : AtParseResult::Malformed;
+}
+
+AtParseResult parseCpas(const char *line, CpasStatus &status) {
+  int value = -1;
+  const char *p = parseInt(parsePrefix(line, "+CPAS"), value);
+
+  if (p == nullptr || *p != '\0') {
+    return AtParseResult::Malformed;
+  }
+
+  if (value < static_cast<int>(CpasStatus::Ready) || value > static_cast<int>(CpasStatus::Asleep)) {
+    return AtParseResult::Unsupported;
+  }
+
+  status = static_cast<CpasStatus>(value);
+  return AtParseResult::Ok;
+}
+
+AtParseResult parseRegistration(const char *line, RegistrationStatus &status) {
+  const char *p = parsePrefix(line, "+CGREG");
+
+  p = parseInt(p, status.mode);
+  p = parseInt(parseComma(p), status.stat);
+
+  return atFieldEnd(p) ? AtParseResult::Ok : AtParseResult::Malformed;
+}
+
+AtParseResult parseCpbr(const char *line, CpbrRecord &record) {
+  AtParseResult result = AtParseResult::Malformed;
+  const char *p = parseInt(parsePrefix(line, "+CPBR"), record.index);
+
+  p = parseQuoted(parseComma(p), record.number, sizeof(record.number), result);
+  p = parseInt(parseComma(p), record.type);
+  p = parseQuoted(parseComma(p), record.text, sizeof(record.text), result);
+
+  if (p == nullptr) {
+    record.number[0] = '\0';
+    return result;
+  }
+
+  // Newer modems may append hidden entry fields, which we don't need.
+  return atFieldEnd(p) ? AtParseResult::Ok : AtParseResult::Malformed;
+}
+
+AtParseResult parseCpbs(const char *line, CpbsStatus &status) {
+  AtParseResult result = AtParseResult::Malformed;
+  const char *p = parsePrefix(line, "+CPBS");
+
+  p = parseQuoted(p, status.storage, sizeof(status.storage), result);
+  p = parseInt(parseComma(p), status.used);
+  p = parseInt(parseComma(p), status.total);
+
+  if (p == nullptr) {
+    return result;
+  }
+
+  return *p == '\0' ? AtParseResult::Ok : AtParseResult::Malformed;
+}
+
+AtParseResult parseIccid(const char *line, char *iccid, const size_t size) {
+  const char *p = parsePrefix(line, "+ICCID");
+  size_t len = 0;
+
+  if (p == nullptr || *p == '\0') {
+    return AtParseResult::Malformed;
+  }
+
+  // Digits, and the F some SIMs pad it with.
+  for (; *p != '\0'; ++p) {
+    if (!isalnum(static_cast<unsigned char>(*p))) {
+      return AtParseResult::Malformed;
+    }
+
+    if (len == size - 1) {
+      iccid[0] = '\0';
+      return AtParseResult::FieldTooLong;
+    }
+
+    iccid[len++] = *p;
+  }
+
+  iccid[len] = '\0';
+  return AtParseResult::Ok;
+}
+
+const __FlashStringHelper *atParseResultToString(const AtParseResult result) {
+  switch (result) {
+  case AtParseResult::Ok:
+    return F("Ok");
+  case AtParseResult::Malformed:
+    return F("Malformed");
+  case AtParseResult::FieldTooLong:
+    return F("FieldTooLong");
+  case AtParseResult::Unsupported:
+    return F("Unsupported");
+  default:
+    return F("Unknown");
+  }
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "consts.h"
+#include <Arduino.h>
+
+// Unsupported means the line is well formed, but holds a value we don't know, like a modem's own
+// extension of a status.
+enum class AtParseResult { Ok, Malformed, FieldTooLong, Unsupported };
+
+// As per 3GPP TS 27.007 +CLCC: <id>,<dir>,<stat>,<mode>,<mpty>[,<number>,<type>[,<alpha>]]
+struct ClccRecord {
+  int id = -1;
+  int direction = -1;
+  int status = -1;
+  int mode = -1;
+  int mpty = -1;
+  char number[kMediumBufferSize] = "";
+};
+
+// As per 3GPP TS 27.007 +CPAS: <pas>
+enum class CpasStatus : uint8_t {
+  Ready = 0,
+  Unavailable = 1,
+  Unknown = 2,
+  Ringing = 3,
+  CallInProgress = 4,
+  Asleep = 5,
+};
+
+// As per 3GPP TS 27.007 +CGREG: <n>,<stat>
+struct RegistrationStatus {
+  int mode = -1;
+  int stat = -1;
+
+  bool isRegisteredHome() const {
+    return stat == 1;
+  }
+};
+
+// As per 3GPP TS 27.007 +CPBR: <index>,<number>,<type>,<text>
+struct CpbrRecord {
+  int index = -1;
+  char number[kMediumBufferSize] = "";
+  int type = -1;
+  char text[kMediumBufferSize] = "";
+};
+
+// As per 3GPP TS 27.007 +CPBS: <storage>,<used>,<total>
+struct CpbsStatus {
+  char storage[kSmallBufferSize] = "";
+  int used = -1;
+  int total = -1;
+};
+
+// Single-pass parsers for the call-status lines. They never allocate and never truncate: a quoted
+// field that doesn't fit is reported as AtParseResult::FieldTooLong.
+AtParseResult parseClcc(const char *line, ClccRecord &record);
+AtParseResult parseCpas(const char *line, CpasStatus &status);
+AtParseResult parseRegistration(const char *line, RegistrationStatus &status);
+AtParseResult parseCpbr(const char *line, CpbrRecord &record);
+AtParseResult parseCpbs(const char *line, CpbsStatus &status);
+// SIMCom's +ICCID: <iccid>, the answer to AT+CICCID.
+AtParseResult parseIccid(const char *line, char *iccid, const size_t size);
+
+const __FlashStringHelper *atParseResultToString(const AtParseResult result);
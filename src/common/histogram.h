@@ -0,0 +1,92 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Counts samples in power-of-two buckets: bucket 0 holds 0, bucket i holds [2^(i-1), 2^i), and
+// the last bucket also takes everything above. Cheap enough to record from any hot path.
+template <size_t N> class Histogram {
+  static_assert(N >= 2 && N <= 33, "Histogram needs between 2 and 33 buckets");
+
+public:
+  void record(const uint32_t value) {
+    size_t bucket = 0;
+
+    for (uint32_t remaining = value; remaining != 0 && bucket < N - 1; remaining >>= 1) {
+      ++bucket;
+    }
+
+    ++_buckets[bucket];
+    ++_count;
+    _sum += value;
+
+    if (_count == 1 || value < _min) {
+      _min = value;
+    }
+
+    if (value > _max) {
+      _max = value;
+    }
+  }
+
+  void clear() {
+    *this = Histogram();
+  }
+
+  size_t bucketCount() const {
+    return N;
+  }
+
+  uint32_t bucket(const size_t index) const {
+    return _buckets[index];
+  }
+
+  // The smallest value that falls into the bucket.
+  static uint32_t bucketLowerBound(const size_t index) {
+    return index == 0 ? 0 : 1UL << (index - 1);
+  }
+
+  uint32_t count() const {
+    return _count;
+  }
+
+  uint32_t smallest() const {
+    return _min;
+  }
+
+  uint32_t largest() const {
+    return _max;
+  }
+
+  uint32_t mean() const {
+    return _count == 0 ? 0 : static_cast<uint32_t>(_sum / _count);
+  }
+
+  // An upper bound on the given percentile (0-100): the top of the bucket it falls into, clamped
+  // to the largest value seen.
+  uint32_t percentile(const uint8_t percent) const {
+    if (_count == 0) {
+      return 0;
+    }
+
+    const uint64_t rank = (static_cast<uint64_t>(_count) * percent + 99) / 100;
+    uint64_t seen = 0;
+
+    for (size_t i = 0; i < N - 1; ++i) {
+      seen += _buckets[i];
+
+      if (seen >= rank && seen > 0) {
+        const uint32_t upper = bucketLowerBound(i + 1) - 1;
+        return upper < _max ? upper : _max;
+      }
+    }
+
+    return _max;
+  }
+
+private:
+  uint32_t _buckets[N] = {};
+  uint32_t _count = 0;
+  uint64_t _sum = 0;
+  uint32_t _min = 0;
+  uint32_t _max = 0;
+};
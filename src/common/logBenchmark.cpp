@@ -0,0 +1,41 @@
+#include "logBenchmark.h"
+#include "logger.h"
+#include <algorithm>
+
+namespace {
+  // A batch fits in the logger's queue, so no record is dropped and every call does its full work.
+  const constexpr uint32_t kBatchIterations = 32;
+  const constexpr uint32_t kBatches = 32;
+}
+
+void LogBenchmark::run() {
+  const LogLevel level = Logger::currentLogLevel;
+  Logger::setLogLevel(LogLevel::Debug);
+  Logger::flush();
+
+  uint32_t best = UINT32_MAX;
+  uint64_t total = 0;
+
+  for (uint32_t batch = 0; batch < kBatches; batch++) {
+    const uint32_t start = ESP.getCycleCount();
+
+    // What an iteration of PhoneApp::loop() logs: a debug line with a couple of arguments.
+    for (uint32_t i = 0; i < kBatchIterations; i++) {
+      LOG_DEBUGLN(F("Benchmark batch %lu, iteration %lu"), batch, i);
+    }
+
+    const uint32_t cycles = ESP.getCycleCount() - start;
+
+    // The records are printed outside the timed part, on the device that's the logger task's work.
+    Logger::flush();
+
+    best = std::min(best, cycles);
+    total += cycles;
+  }
+
+  Logger::setLogLevel(level);
+
+  Serial.printf("Log benchmark: %lu cycles/iteration, mean %lu\n",
+                static_cast<unsigned long>(best / kBatchIterations),
+                static_cast<unsigned long>(total / (kBatches * kBatchIterations)));
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Times, in CPU cycles, what the loop's logging costs the loop task, so builds with different log
+// floors can be compared. Only in builds with -DLOG_BENCHMARK, see benchmark/README.md.
+namespace LogBenchmark {
+  // Prints "Log benchmark: <best> cycles/iteration, mean <mean>" straight to Serial, so it shows
+  // whatever the floor.
+  void run();
+}
@@ -0,0 +1,117 @@
+#ifdef LOG_TOKENIZED
+
+#include "logTokenizer.h"
+#include <cstring>
+#include <esp_ota_ops.h>
+#include <soc/soc.h>
+
+namespace {
+  const constexpr uint8_t kLogFrameSof0 = 0xA5;
+  const constexpr uint8_t kLogFrameSof1 = 0x4C;
+  const constexpr size_t kLogFrameCrcSize = 2;
+
+  // Format strings in flash are read through the data cache, at a fixed address per build.
+  const constexpr uintptr_t kLogFlashBase = SOC_DROM_LOW;
+  const constexpr uintptr_t kLogFlashEnd = SOC_DROM_HIGH;
+
+  uint16_t crc16(const uint8_t *data, const size_t length, uint16_t crc = 0xFFFF) {
+    for (size_t i = 0; i < length; i++) {
+      crc ^= static_cast<uint16_t>(data[i]) << 8;
+
+      for (int bit = 0; bit < 8; bit++) {
+        crc = (crc & 0x8000) ? static_cast<uint16_t>((crc << 1) ^ 0x1021) : crc << 1;
+      }
+    }
+
+    return crc;
+  }
+}
+
+bool isInLogFlash(const void *pointer) {
+  const uintptr_t address = reinterpret_cast<uintptr_t>(pointer);
+  return address >= kLogFlashBase && address < kLogFlashEnd;
+}
+
+void LogTokenWriter::writeHeader(const LogFrameKind kind,
+                                 const uint8_t level,
+                                 const bool newline,
+                                 const uint32_t timeMs) {
+  writeByte((level & 0x03) | (newline ? 0x04 : 0) | (static_cast<uint8_t>(kind) << 4));
+  writeVarint(timeMs);
+}
+
+void LogTokenWriter::writeByte(const uint8_t value) {
+  writeBytes(&value, 1);
+}
+
+void LogTokenWriter::writeBytes(const void *data, const size_t size) {
+  const size_t room = _capacity - _size;
+  const size_t length = size <= room ? size : room;
+
+  memcpy(_buffer + _size, data, length);
+  _size += length;
+  _overflowed |= length < size;
+}
+
+void LogTokenWriter::writeVarint(uint64_t value) {
+  uint8_t bytes[10];
+  size_t length = 0;
+
+  do {
+    bytes[length] = value & 0x7F;
+    value >>= 7;
+
+    if (value != 0) {
+      bytes[length] |= 0x80;
+    }
+
+    ++length;
+  } while (value != 0);
+
+  writeBytes(bytes, length);
+}
+
+void LogTokenWriter::writeToken(const void *flashString) {
+  writeVarint(reinterpret_cast<uintptr_t>(flashString) - kLogFlashBase);
+}
+
+void LogTokenWriter::writeString(const char *value) {
+  const size_t length = strlen(value);
+
+  writeVarint(static_cast<uint64_t>(length) << 1);
+  writeBytes(value, length);
+}
+
+void LogTokenWriter::writeFlashString(const __FlashStringHelper *value) {
+  if (!isInLogFlash(value)) {
+    writeString(value != nullptr ? reinterpret_cast<const char *>(value) : "(null)");
+    return;
+  }
+
+  const uint64_t offset = reinterpret_cast<uintptr_t>(value) - kLogFlashBase;
+  writeVarint((offset << 1) | 1);
+}
+
+void writeLogFrame(Print &out, const uint8_t *payload, const size_t length) {
+  const uint8_t header[] = {kLogFrameSof0, kLogFrameSof1, static_cast<uint8_t>(length)};
+  const uint16_t crc = crc16(payload, length, crc16(header + 2, 1));
+  const uint8_t trailer[kLogFrameCrcSize] = {static_cast<uint8_t>(crc & 0xFF),
+                                             static_cast<uint8_t>(crc >> 8)};
+
+  out.write(header, sizeof(header));
+  out.write(payload, length);
+  out.write(trailer, sizeof(trailer));
+}
+
+void writeLogSessionFrame(Print &out) {
+  uint8_t payload[kLogFrameMaxPayload];
+  LogTokenWriter writer(payload, sizeof(payload));
+
+  writer.writeHeader(LogFrameKind::Session, 0, false, millis());
+  writer.writeVarint(kLogFlashBase);
+  writer.writeBytes(esp_ota_get_app_description()->app_elf_sha256, kLogElfShaPrefixSize);
+
+  writeLogFrame(out, payload, writer.size());
+}
+
+#endif
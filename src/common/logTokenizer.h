@@ -0,0 +1,59 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Log frames for builds with LOG_TOKENIZED, decoded on the host by logDecoder/decode.py.
+//
+// Every frame is 0xA5 0x4C, payload length (8 bit), payload, and a CRC16-CCITT (LE) over the
+// length and the payload. Anything else on the port (the boot ROM, echoed input) is plain text,
+// which the decoder passes through while looking for the next frame.
+//
+// A payload starts with a byte holding the level (bits 0-1), whether the record ends its line
+// (bit 2) and the frame kind (bits 4-7), then the millis() of the call as a varint:
+// - Token: the format string's offset into flash (a varint), then the arguments. Integers go as
+//   the varint of their bits, and the conversion decides how they're read back, as with printf.
+//   Strings are a varint of length << 1 followed by the text, or of flash offset << 1 | 1 for
+//   strings in flash.
+// - Text: a record whose format string isn't in flash, formatted on the device.
+// - Session: sent once at startup, the flash base address and the first bytes of the ELF's
+//   SHA-256, so the decoder can tell it has the right ELF.
+enum class LogFrameKind : uint8_t { Token = 0, Text, Session };
+
+const constexpr size_t kLogFrameMaxPayload = 255;
+const constexpr size_t kLogElfShaPrefixSize = 8;
+
+bool isInLogFlash(const void *pointer);
+
+class LogTokenWriter {
+public:
+  LogTokenWriter(uint8_t *buffer, const size_t size) : _buffer(buffer), _capacity(size) {}
+
+  void writeHeader(const LogFrameKind kind,
+                   const uint8_t level,
+                   const bool newline,
+                   const uint32_t timeMs);
+  void writeByte(const uint8_t value);
+  void writeBytes(const void *data, const size_t size);
+  void writeVarint(uint64_t value);
+  void writeToken(const void *flashString);
+  void writeString(const char *value);
+  void writeFlashString(const __FlashStringHelper *value);
+
+  size_t size() const {
+    return _size;
+  }
+
+  // Set when something didn't fit, the frame is then cut short and shouldn't be sent.
+  bool overflowed() const {
+    return _overflowed;
+  }
+
+private:
+  uint8_t *_buffer;
+  size_t _capacity;
+  size_t _size = 0;
+  bool _overflowed = false;
+};
+
+void writeLogFrame(Print &out, const uint8_t *payload, const size_t length);
+void writeLogSessionFrame(Print &out);
@@ -1,3 +1,228 @@
 #include "logger.h"
+#include <atomic>
 
-LogLevel Logger::currentLogLevel = LogLevel::Debug;
\ No newline at end of file
+#ifdef WEB_SERIAL
+#include <WebSerial.h>
+#endif
+
+namespace {
+  // A power of two, so tickets map to slots with a mask.
+  const constexpr uint32_t kLogRingSize = 64;
+  const constexpr uint32_t kLogRingMask = kLogRingSize - 1;
+
+  const constexpr uint32_t kLoggerTaskStackSize = 4096;
+  // Below the loop, so printing only ever takes time the loop doesn't need.
+  const constexpr UBaseType_t kLoggerTaskPriority = tskIDLE_PRIORITY;
+  // Producers don't wake the task, that would cost them a kernel call per record.
+  const constexpr TickType_t kLoggerTaskPollTicks = pdMS_TO_TICKS(20);
+
+  // A bounded multi-producer queue after Dmitry Vyukov's: each slot's sequence tells whose turn it
+  // is. A producer owns a slot once it moves the enqueue ticket past it, and hands it to the
+  // consumer by publishing ticket + 1. The consumer hands it back with ticket + kLogRingSize.
+  struct LogSlot {
+    std::atomic<uint32_t> sequence;
+    LogRecord record;
+  };
+
+  LogSlot ring[kLogRingSize];
+  std::atomic<uint32_t> enqueueTicket{0};
+  uint32_t dequeueTicket = 0;
+
+  std::atomic<uint32_t> recorded{0};
+  std::atomic<uint32_t> dropped{0};
+  uint32_t reportedDropped = 0;
+  uint32_t peakBacklog = 0;
+
+  // Keeps the logger task and flush() from both consuming at once.
+  SemaphoreHandle_t consumerLock = nullptr;
+
+  const __FlashStringHelper *logLevelPrefix(const LogLevel level) {
+    switch (level) {
+    case LogLevel::Debug:
+      return F("[DEBUG]");
+    case LogLevel::Info:
+      return F("[INFO]");
+    case LogLevel::Warn:
+      return F("[WARN]");
+    case LogLevel::Error:
+    default:
+      return F("[ERROR]");
+    }
+  }
+
+#ifdef LOG_TOKENIZED
+  void emitFrame(const LogRecord &record) {
+    uint8_t payload[kLogFrameMaxPayload];
+    int length = -1;
+
+    if (isInLogFlash(record.format)) {
+      length = record.encoder(record, reinterpret_cast<char *>(payload), sizeof(payload));
+    }
+
+    // The decoder can't look the format string up, so it gets the text instead.
+    if (length < 0) {
+      char buffer[kBigBufferSize];
+      record.formatter(record, buffer, sizeof(buffer));
+
+      LogTokenWriter writer(payload, sizeof(payload));
+      writer.writeHeader(LogFrameKind::Text,
+                         static_cast<uint8_t>(record.level),
+                         record.newline,
+                         record.timeMs);
+      writer.writeBytes(buffer, strlen(buffer));
+      length = writer.size();
+    }
+
+    writeLogFrame(Serial, payload, length);
+  }
+#endif
+
+  bool popRecord(LogRecord &record) {
+    LogSlot &slot = ring[dequeueTicket & kLogRingMask];
+
+    if (slot.sequence.load(std::memory_order_acquire) != dequeueTicket + 1) {
+      return false;
+    }
+
+    record = slot.record;
+    slot.sequence.store(dequeueTicket + kLogRingSize, std::memory_order_release);
+    ++dequeueTicket;
+
+    return true;
+  }
+
+  void drain() {
+    const uint32_t backlog = enqueueTicket.load(std::memory_order_relaxed) - dequeueTicket;
+
+    if (backlog > peakBacklog) {
+      peakBacklog = backlog;
+    }
+
+    LogRecord record;
+
+    while (popRecord(record)) {
+      Logger::emit(record);
+    }
+
+    const uint32_t droppedNow = dropped.load(std::memory_order_relaxed);
+
+    // Recorded like any other line, it goes out with the next drain.
+    if (droppedNow != reportedDropped) {
+      LOG_WARNLN(F("Dropped %lu log records"), droppedNow - reportedDropped);
+      reportedDropped = droppedNow;
+    }
+  }
+
+  void runLoggerTask(void *param) {
+    for (;;) {
+      xSemaphoreTake(consumerLock, portMAX_DELAY);
+      drain();
+      xSemaphoreGive(consumerLock);
+
+      vTaskDelay(kLoggerTaskPollTicks);
+    }
+  }
+}
+
+LogLevel Logger::currentLogLevel = LogLevel::Debug;
+bool Logger::deferred = false;
+
+void Logger::init() {
+  if (deferred) {
+    return;
+  }
+
+  for (uint32_t i = 0; i < kLogRingSize; i++) {
+    ring[i].sequence.store(i, std::memory_order_relaxed);
+  }
+
+  consumerLock = xSemaphoreCreateMutex();
+
+#ifdef LOG_TOKENIZED
+  writeLogSessionFrame(Serial);
+#endif
+
+  // Not pinned, so it mostly runs on the core the loop doesn't.
+  xTaskCreatePinnedToCore(&runLoggerTask,
+                          "logger",
+                          kLoggerTaskStackSize,
+                          nullptr,
+                          kLoggerTaskPriority,
+                          nullptr,
+                          tskNO_AFFINITY);
+
+  deferred = true;
+}
+
+void Logger::flush() {
+  if (!deferred) {
+    return;
+  }
+
+  xSemaphoreTake(consumerLock, portMAX_DELAY);
+  drain();
+  xSemaphoreGive(consumerLock);
+
+  Serial.flush();
+}
+
+void Logger::logStats() {
+  LOG_INFOLN(F("Log records: %lu, dropped %lu, peak backlog %lu of %lu"),
+             recorded.load(std::memory_order_relaxed),
+             dropped.load(std::memory_order_relaxed),
+             peakBacklog,
+             kLogRingSize);
+}
+
+LogRecord *Logger::claimRecord(uint32_t &ticket) {
+  ticket = enqueueTicket.load(std::memory_order_relaxed);
+
+  for (;;) {
+    LogSlot &slot = ring[ticket & kLogRingMask];
+    const int32_t turn =
+        static_cast<int32_t>(slot.sequence.load(std::memory_order_acquire) - ticket);
+
+    if (turn == 0) {
+      // On failure the ticket is reloaded, and the slot it points at checked again.
+      if (enqueueTicket.compare_exchange_weak(ticket, ticket + 1, std::memory_order_relaxed)) {
+        return &slot.record;
+      }
+    } else if (turn < 0) {
+      // The consumer hasn't freed this slot yet: the ring is full.
+      dropped.fetch_add(1, std::memory_order_relaxed);
+      return nullptr;
+    } else {
+      ticket = enqueueTicket.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+void Logger::publishRecord(const uint32_t ticket) {
+  recorded.fetch_add(1, std::memory_order_relaxed);
+  ring[ticket & kLogRingMask].sequence.store(ticket + 1, std::memory_order_release);
+}
+
+void Logger::emit(const LogRecord &record) {
+#ifdef LOG_TOKENIZED
+  emitFrame(record);
+#endif
+
+#if !defined(LOG_TOKENIZED) || defined(WEB_SERIAL)
+  char buffer[kBigBufferSize];
+  record.formatter(record, buffer, sizeof(buffer));
+
+  // Flash is memory mapped on the ESP32, so the prefix prints like any other string.
+  PGM_P prefix = reinterpret_cast<PGM_P>(logLevelPrefix(record.level));
+  const unsigned long timeMs = record.timeMs;
+  const char *end = record.newline ? "\n" : "";
+#endif
+
+#ifndef LOG_TOKENIZED
+  Serial.printf("%s %lu %s%s", prefix, timeMs, buffer, end);
+#endif
+
+  // WebSerial is read in a browser, which has no decoder, so it always gets text.
+#ifdef WEB_SERIAL
+  WebSerial.printf("%s %lu %s%s", prefix, timeMs, buffer, end);
+#endif
+}
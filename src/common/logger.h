@@ -4,157 +4,349 @@
 
 #include "consts.h"
 #include <Arduino.h>
+#include <cstring>
 #include <stdio.h>
+#include <tuple>
+#include <type_traits>
 
-#ifdef WEB_SERIAL
-#include <WebSerial.h>
+#ifdef LOG_TOKENIZED
+#include "logTokenizer.h"
 #endif
 
-enum class LogLevel { Debug = 0, Info, Warn, Error };
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_ERROR 3
+
+enum class LogLevel {
+  Debug = LOG_LEVEL_DEBUG,
+  Info = LOG_LEVEL_INFO,
+  Warn = LOG_LEVEL_WARN,
+  Error = LOG_LEVEL_ERROR
+};
+
+// The lowest level a build keeps, e.g. -DLOG_LEVEL_FLOOR=LOG_LEVEL_WARN. The LOG_* macros at the
+// end of this file expand to nothing below it: no format string in flash, no record, no runtime
+// level check, and none of the arguments evaluated.
+#ifndef LOG_LEVEL_FLOOR
+#define LOG_LEVEL_FLOOR LOG_LEVEL_DEBUG
+#endif
+
+struct LogRecord;
+
+// Formats a record's arguments with its format string. One is instantiated per argument type list,
+// so a record knows how to unpack its own payload.
+using LogFormatter = int (*)(const LogRecord &record, char *buffer, const size_t size);
+
+const constexpr size_t kLogPayloadSize = 104;
+
+// A log call as it was made: a timestamp, the format string and the raw arguments. Strings are
+// copied in, since they often live on the caller's stack. Formatting happens later, on the logger
+// task.
+struct LogRecord {
+  uint32_t timeMs;
+  LogFormatter formatter;
+#ifdef LOG_TOKENIZED
+  // Writes the record as a frame payload instead, see logTokenizer.h.
+  LogFormatter encoder;
+#endif
+  PGM_P format;
+  LogLevel level;
+  bool newline;
+  uint8_t payload[kLogPayloadSize];
+};
+
+// Appends arguments to a record's payload. Every argument's fixed part is reserved up front, so a
+// long string is cut short rather than leaving no room for the arguments after it.
+class LogPayloadWriter {
+public:
+  LogPayloadWriter(uint8_t *payload, const size_t reserved)
+      : _payload(payload), _reserved(reserved) {}
+
+  void writeValue(const void *value, const size_t size) {
+    _reserved -= size;
+    memcpy(_payload + _size, value, size);
+    _size += size;
+  }
+
+  void writeString(const char *value) {
+    const char *text = value != nullptr ? value : "(null)";
+    _reserved -= 1;
+
+    const size_t room = kLogPayloadSize - _size - _reserved - 1;
+    const size_t length = strnlen(text, room);
+
+    memcpy(_payload + _size, text, length);
+    _payload[_size + length] = '\0';
+    _size += length + 1;
+  }
+
+private:
+  uint8_t *_payload;
+  size_t _size = 0;
+  size_t _reserved;
+};
+
+class LogPayloadReader {
+public:
+  explicit LogPayloadReader(const uint8_t *payload) : _payload(payload) {}
+
+  void readValue(void *value, const size_t size) {
+    memcpy(value, _payload + _offset, size);
+    _offset += size;
+  }
+
+  const char *readString() {
+    const char *value = reinterpret_cast<const char *>(_payload + _offset);
+    _offset += strlen(value) + 1;
+    return value;
+  }
+
+private:
+  const uint8_t *_payload;
+  size_t _offset = 0;
+};
+
+// Scalars and pointers to flash (__FlashStringHelper) are stored as they are.
+template <typename T> struct LogArg {
+  using Type = T;
+  static const constexpr size_t kFixedSize = sizeof(T);
+
+  static void write(LogPayloadWriter &writer, const T value) {
+    writer.writeValue(&value, sizeof(value));
+  }
+
+  static T read(LogPayloadReader &reader) {
+    T value;
+    reader.readValue(&value, sizeof(value));
+    return value;
+  }
+};
+
+// Strings in RAM are copied, the fixed part being their terminator.
+template <> struct LogArg<const char *> {
+  using Type = const char *;
+  static const constexpr size_t kFixedSize = 1;
+
+  static void write(LogPayloadWriter &writer, const char *value) {
+    writer.writeString(value);
+  }
+
+  static const char *read(LogPayloadReader &reader) {
+    return reader.readString();
+  }
+};
+
+template <> struct LogArg<char *> : LogArg<const char *> {};
+
+template <typename... Types>
+int formatLogRecord(const LogRecord &record, char *buffer, const size_t size) {
+  LogPayloadReader reader(record.payload);
+  // A braced list is evaluated left to right, the order the arguments were written in.
+  const std::tuple<Types...> values{LogArg<Types>::read(reader)...};
+
+  return std::apply(
+      [&](const Types... args) { return snprintf_P(buffer, size, record.format, args...); },
+      values);
+}
+
+#ifdef LOG_TOKENIZED
+template <typename T> void encodeLogArg(LogTokenWriter &writer, const T value) {
+  if constexpr (std::is_same_v<T, const char *>) {
+    writer.writeString(value);
+  } else if constexpr (std::is_same_v<T, const __FlashStringHelper *>) {
+    writer.writeFlashString(value);
+  } else if constexpr (std::is_floating_point_v<T>) {
+    const double promoted = value;
+    writer.writeBytes(&promoted, sizeof(promoted));
+  } else if constexpr (std::is_pointer_v<T>) {
+    writer.writeVarint(reinterpret_cast<uintptr_t>(value));
+  } else {
+    // The bits as printf would see them, the conversion decides whether they're signed.
+    using Bits = std::conditional_t<(sizeof(T) > sizeof(uint32_t)), uint64_t, uint32_t>;
+    writer.writeVarint(static_cast<Bits>(value));
+  }
+}
+
+// Returns the payload's length, or -1 if it doesn't fit in a frame.
+template <typename... Types>
+int encodeLogRecord(const LogRecord &record, char *buffer, const size_t size) {
+  LogPayloadReader reader(record.payload);
+  const std::tuple<Types...> values{LogArg<Types>::read(reader)...};
+  LogTokenWriter writer(reinterpret_cast<uint8_t *>(buffer), size);
+
+  writer.writeHeader(
+      LogFrameKind::Token, static_cast<uint8_t>(record.level), record.newline, record.timeMs);
+  writer.writeToken(record.format);
+  std::apply([&](const Types... args) { (encodeLogArg(writer, args), ...); }, values);
+
+  return writer.overflowed() ? -1 : static_cast<int>(writer.size());
+}
+#endif
 
 namespace Logger {
   extern LogLevel currentLogLevel;
+  // Set by init(), once the logger task is there to print records.
+  extern bool deferred;
 
+  // Levels below the floor stay off, their calls aren't in the build.
   inline void setLogLevel(const LogLevel level) {
     currentLogLevel = level;
   }
 
-  template <typename... Args>
-  inline void logln(const __FlashStringHelper *prefix, const char *format, const Args... args) {
-    char buffer[kBigBufferSize];
-    snprintf(buffer, sizeof(buffer), format, args...);
-    Serial.printf("%S %s\n", prefix, buffer);
+  // Starts the logger task. Until then, and in programs that never call it, every call formats and
+  // prints right away.
+  void init();
+  // Prints everything recorded so far before returning, e.g. before a restart.
+  void flush();
+  void logStats();
 
-#ifdef WEB_SERIAL
-    WebSerial.printf("%S %s\n", prefix, buffer);
-#endif
-  }
+  // Claims a record in the ring. Returns nullptr if the ring is full, in which case the record is
+  // counted as dropped.
+  LogRecord *claimRecord(uint32_t &ticket);
+  void publishRecord(const uint32_t ticket);
+  void emit(const LogRecord &record);
 
   template <typename... Args>
-  inline void log(const char *prefix, const char *format, const Args... args) {
-    char buffer[kBigBufferSize];
-    snprintf(buffer, sizeof(buffer), format, args...);
-    Serial.printf("%s %s", prefix, buffer);
+  inline void fillRecord(LogRecord &record,
+                         const LogLevel level,
+                         const bool newline,
+                         PGM_P format,
+                         const Args... args) {
+    static_assert((LogArg<Args>::kFixedSize + ... + 0) <= kLogPayloadSize,
+                  "Log arguments don't fit in a record");
 
-#ifdef WEB_SERIAL
-    WebSerial.printf("%s %s", prefix, buffer);
+    record.timeMs = millis();
+    record.formatter = &formatLogRecord<typename LogArg<Args>::Type...>;
+#ifdef LOG_TOKENIZED
+    record.encoder = &encodeLogRecord<typename LogArg<Args>::Type...>;
 #endif
-  }
+    record.format = format;
+    record.level = level;
+    record.newline = newline;
 
-  template <typename... Args>
-  inline void
-  logln(const __FlashStringHelper *prefix, const __FlashStringHelper *format, const Args... args) {
-    char buffer[kBigBufferSize];
-    snprintf_P(buffer, sizeof(buffer), reinterpret_cast<PGM_P>(format), args...);
-    Serial.printf("%S %s\n", prefix, buffer);
-
-#ifdef WEB_SERIAL
-    WebSerial.printf("%S %s\n", prefix, buffer);
-#endif
+    LogPayloadWriter writer(record.payload, (LogArg<Args>::kFixedSize + ... + 0));
+    (LogArg<Args>::write(writer, args), ...);
   }
 
   template <typename... Args>
-  inline void log(const char *prefix, const __FlashStringHelper *format, const Args... args) {
-    char buffer[kBigBufferSize];
-    snprintf_P(buffer, sizeof(buffer), reinterpret_cast<PGM_P>(format), args...);
-    Serial.printf("%s %s", prefix, buffer);
+  inline void record(const LogLevel level, const bool newline, PGM_P format, const Args... args) {
+    if (!deferred) {
+      LogRecord immediate;
+      fillRecord(immediate, level, newline, format, args...);
+      emit(immediate);
+      return;
+    }
 
-#ifdef WEB_SERIAL
-    WebSerial.printf("%s %s", prefix, buffer);
-#endif
+    uint32_t ticket;
+    LogRecord *claimed = claimRecord(ticket);
+
+    if (claimed != nullptr) {
+      fillRecord(*claimed, level, newline, format, args...);
+      publishRecord(ticket);
+    }
   }
 
-  template <typename... Args> inline void debugln(const char *format, const Args... args) {
-    if (currentLogLevel <= LogLevel::Debug) {
-      logln(F("[DEBUG]"), format, args...);
+  // Call sites go through the LOG_* macros below, which leave out the levels under the floor.
+  template <LogLevel level, typename... Args>
+  inline void log(const bool newline, PGM_P format, const Args... args) {
+    if (currentLogLevel <= level) {
+      record(level, newline, format, args...);
     }
   }
+
+  template <typename... Args> inline void debugln(const char *format, const Args... args) {
+    log<LogLevel::Debug>(true, format, args...);
+  }
   template <typename... Args> inline void debug(const char *format, const Args... args) {
-    if (currentLogLevel <= LogLevel::Debug) {
-      log(F("[DEBUG]"), format, args...);
-    }
+    log<LogLevel::Debug>(false, format, args...);
   }
   template <typename... Args>
   inline void debugln(const __FlashStringHelper *format, const Args... args) {
-    if (currentLogLevel <= LogLevel::Debug) {
-      logln(F("[DEBUG]"), format, args...);
-    }
+    log<LogLevel::Debug>(true, reinterpret_cast<PGM_P>(format), args...);
   }
   template <typename... Args>
   inline void debug(const __FlashStringHelper *format, const Args... args) {
-    if (currentLogLevel <= LogLevel::Debug) {
-      log(F("[DEBUG]"), format, args...);
-    }
+    log<LogLevel::Debug>(false, reinterpret_cast<PGM_P>(format), args...);
   }
 
   template <typename... Args> inline void infoln(const char *format, const Args... args) {
-    if (currentLogLevel <= LogLevel::Info) {
-      logln(F("[INFO]"), format, args...);
-    }
+    log<LogLevel::Info>(true, format, args...);
   }
   template <typename... Args> inline void info(const char *format, const Args... args) {
-    if (currentLogLevel <= LogLevel::Info) {
-      log(F("[INFO]"), format, args...);
-    }
+    log<LogLevel::Info>(false, format, args...);
   }
   template <typename... Args>
   inline void infoln(const __FlashStringHelper *format, const Args... args) {
-    if (currentLogLevel <= LogLevel::Info) {
-      logln(F("[INFO]"), format, args...);
-    }
+    log<LogLevel::Info>(true, reinterpret_cast<PGM_P>(format), args...);
   }
   template <typename... Args>
   inline void info(const __FlashStringHelper *format, const Args... args) {
-    if (currentLogLevel <= LogLevel::Info) {
-      log(F("[INFO]"), format, args...);
-    }
+    log<LogLevel::Info>(false, reinterpret_cast<PGM_P>(format), args...);
   }
 
   template <typename... Args> inline void warnln(const char *format, const Args... args) {
-    if (currentLogLevel <= LogLevel::Warn) {
-      logln(F("[WARN]"), format, args...);
-    }
+    log<LogLevel::Warn>(true, format, args...);
   }
   template <typename... Args> inline void warn(const char *format, const Args... args) {
-    if (currentLogLevel <= LogLevel::Warn) {
-      log(F("[WARN]"), format, args...);
-    }
+    log<LogLevel::Warn>(false, format, args...);
   }
   template <typename... Args>
   inline void warnln(const __FlashStringHelper *format, const Args... args) {
-    if (currentLogLevel <= LogLevel::Warn) {
-      logln(F("[WARN]"), format, args...);
-    }
+    log<LogLevel::Warn>(true, reinterpret_cast<PGM_P>(format), args...);
   }
   template <typename... Args>
   inline void warn(const __FlashStringHelper *format, const Args... args) {
-    if (currentLogLevel <= LogLevel::Warn) {
-      log(F("[WARN]"), format, args...);
-    }
+    log<LogLevel::Warn>(false, reinterpret_cast<PGM_P>(format), args...);
   }
 
   template <typename... Args> inline void errorln(const char *format, const Args... args) {
-    if (currentLogLevel <= LogLevel::Error) {
-      logln(F("[ERROR]"), format, args...);
-    }
+    log<LogLevel::Error>(true, format, args...);
   }
   template <typename... Args> inline void error(const char *format, const Args... args) {
-    if (currentLogLevel <= LogLevel::Error) {
-      log(F("[ERROR]"), format, args...);
-    }
+    log<LogLevel::Error>(false, format, args...);
   }
   template <typename... Args>
   inline void errorln(const __FlashStringHelper *format, const Args... args) {
-    if (currentLogLevel <= LogLevel::Error) {
-      logln(F("[ERROR]"), format, args...);
-    }
+    log<LogLevel::Error>(true, reinterpret_cast<PGM_P>(format), args...);
   }
   template <typename... Args>
   inline void error(const __FlashStringHelper *format, const Args... args) {
-    if (currentLogLevel <= LogLevel::Error) {
-      log(F("[ERROR]"), format, args...);
-    }
+    log<LogLevel::Error>(false, reinterpret_cast<PGM_P>(format), args...);
   }
 }
 
-#pragma GCC diagnostic pop
\ No newline at end of file
+// Below the floor, a call is ((void)0): its arguments aren't compiled, let alone evaluated.
+#if LOG_LEVEL_FLOOR <= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) Logger::debug(__VA_ARGS__)
+#define LOG_DEBUGLN(...) Logger::debugln(__VA_ARGS__)
+#else
+#define LOG_DEBUG(...) ((void)0)
+#define LOG_DEBUGLN(...) ((void)0)
+#endif
+
+#if LOG_LEVEL_FLOOR <= LOG_LEVEL_INFO
+#define LOG_INFO(...) Logger::info(__VA_ARGS__)
+#define LOG_INFOLN(...) Logger::infoln(__VA_ARGS__)
+#else
+#define LOG_INFO(...) ((void)0)
+#define LOG_INFOLN(...) ((void)0)
+#endif
+
+#if LOG_LEVEL_FLOOR <= LOG_LEVEL_WARN
+#define LOG_WARN(...) Logger::warn(__VA_ARGS__)
+#define LOG_WARNLN(...) Logger::warnln(__VA_ARGS__)
+#else
+#define LOG_WARN(...) ((void)0)
+#define LOG_WARNLN(...) ((void)0)
+#endif
+
+#if LOG_LEVEL_FLOOR <= LOG_LEVEL_ERROR
+#define LOG_ERROR(...) Logger::error(__VA_ARGS__)
+#define LOG_ERRORLN(...) Logger::errorln(__VA_ARGS__)
+#else
+#define LOG_ERROR(...) ((void)0)
+#define LOG_ERRORLN(...) ((void)0)
+#endif
+
+#pragma GCC diagnostic pop
@@ -1,111 +1,116 @@
 #include "phoneBook.h"
 #include "config.h"
+#include "consts.h"
 #include "generated/phoneBook.h"
+#include "phoneBookStore.h"
 #include "string.h"
 #include <cstring>
 
-// TODO: This entire thing can become generated by some template.
+namespace {
+  // For a digit that isn't one. The generated table has its own dead state for numbers that just
+  // don't fit the plan.
+  const constexpr uint16_t kDialPlanInvalidState = 0xFFFF;
+}
 
-DialedNumberValidationResult validateDialedNumber(const char *number) {
-  DialedNumberValidationResult res = DialedNumberValidationResult::Invalid;
-  int len = strlen(number);
+void PhoneBookCursor::reset() {
+  _first = 0;
+  _last = PhoneBookStore::view().size();
+  _length = 0;
+}
 
-  if (len == 0) {
-    res = DialedNumberValidationResult::Pending;
-  } else if (isPhoneBookEntry(number)) {
-    res = DialedNumberValidationResult::Valid;
-  } else if (isPartialOfFullPhoneBookEntry(number)) {
-    res = DialedNumberValidationResult::Pending;
+void PhoneBookCursor::advance(const int digit) {
+  if (_first == _last) {
+    return;
   }
-  // Handle numbers starting with '0'
-  else if (number[0] == '0') {
-    if (len < 2) {
-      res = DialedNumberValidationResult::Pending;
-    } else {
-      const char second = number[1];
-
-      // Landline patterns: 9-digit numbers starting with 02,03,04,08,09.
-      if (second == '2' || second == '3' || second == '4' || second == '8' || second == '9') {
-        if (len == 9) {
-          res = DialedNumberValidationResult::Valid;
-        } else if (len < 9) {
-          res = DialedNumberValidationResult::Pending;
-        }
-      }
-      // Mobile patterns: 10-digit numbers starting with 05 or 07.
-      else if (second == '5' || second == '7') {
-        if (len == 10) {
-          res = DialedNumberValidationResult::Valid;
-        } else if (len < 10) {
-          res = DialedNumberValidationResult::Pending;
-        }
-      }
-    }
+
+  if (digit < 0 || digit > 9) {
+    _first = _last;
+    return;
   }
-  // Handle numbers starting with '1'
-  else if (number[0] == '1') {
-    if (len < 3) {
-      res = DialedNumberValidationResult::Pending;
-    } else {
-      // Patterns "10X" and "11X": exactly 3 digits.
-      if (strStartsWith(number, "10") || strStartsWith(number, "11")) {
-        if (len == 3) {
-          res = DialedNumberValidationResult::Valid;
-        } else if (len < 3) {
-          res = DialedNumberValidationResult::Pending;
-        }
-      }
-      // Pattern "12XX"
-      else if (strStartsWith(number, "12")) {
-        // Special case: "1222XXXX" must be exactly 8 digits.
-        if (strStartsWith(number, "1222")) {
-          if (len == 8) {
-            res = DialedNumberValidationResult::Valid;
-          } else if (len < 8) {
-            res = DialedNumberValidationResult::Pending;
-          }
-        } else {
-          if (len == 4) {
-            res = DialedNumberValidationResult::Valid;
-          } else if (len < 4) {
-            res = DialedNumberValidationResult::Pending;
-          }
-        }
-      }
-      // Special case: numbers starting with "14"
-      else if (strStartsWith(number, "14")) {
-        // Check for prefix "145"
-        if (strStartsWith(number, "145")) {
-          if (len == 3) {
-            res = DialedNumberValidationResult::Pending;
-          } else {
-            // Check for prefix "1455"
-            if (strStartsWith(number, "1455")) {
-              if (len == 4) {
-                res = DialedNumberValidationResult::Valid;
-              }
-            }
-          }
-        }
-      }
-      // Pattern "1700XXXXXX": 10 digits starting with "17"
-      else if (strStartsWith(number, "17")) {
-        if (len == 10) {
-          res = DialedNumberValidationResult::Valid;
-        } else if (len < 10) {
-          res = DialedNumberValidationResult::Pending;
-        }
-      }
-      // Pattern "180XXXXXXX": 10 digits starting with "18"
-      else if (strStartsWith(number, "18")) {
-        if (len == 10) {
-          res = DialedNumberValidationResult::Valid;
-        } else if (len < 10) {
-          res = DialedNumberValidationResult::Pending;
-        }
+
+  PhoneBookStore::view().narrow(_first, _last, _length, static_cast<char>('0' + digit));
+  ++_length;
+}
+
+// Entries that end at the number sort before the ones that go on.
+bool PhoneBookCursor::isEntry() const {
+  return _first != _last && PhoneBookStore::view().getEntry(_first)[_length] == '\0';
+}
+
+bool PhoneBookCursor::isPrefix() const {
+  return _first != _last && PhoneBookStore::view().getEntry(_last - 1)[_length] != '\0';
+}
+
+const char *PhoneBookCursor::getNumber() const {
+  return isEntry() ? PhoneBookStore::view().getNumber(_first) : nullptr;
+}
+
+void DialPlanCursor::reset() {
+  _state = 0;
+}
+
+void DialPlanCursor::advance(const int digit) {
+  if (digit < 0 || digit > 9) {
+    _state = kDialPlanInvalidState;
+    return;
+  }
+
+  if (_state != kDialPlanInvalidState) {
+    _state = dialPlanStates[_state].next[digit];
+  }
+}
+
+DialedNumberValidationResult DialPlanCursor::getResult() const {
+  return _state == kDialPlanInvalidState ? DialedNumberValidationResult::Invalid
+                                         : dialPlanStates[_state].result;
+}
+
+DialedNumberValidationResult validateDialedNumber(
+    const PhoneBookCursor &phoneBookCursor, const DialPlanCursor &dialPlanCursor) {
+  if (phoneBookCursor.isEntry()) {
+    return DialedNumberValidationResult::Valid;
+  }
+
+  if (phoneBookCursor.isPrefix()) {
+    return DialedNumberValidationResult::Pending;
+  }
+
+  return dialPlanCursor.getResult();
+}
+
+bool normalizePhoneNumber(const char *number, char *normalized, const size_t size) {
+  char digits[kMediumBufferSize];
+  size_t length = 0;
+  bool international = false;
+
+  for (const char *c = number; *c != '\0'; c++) {
+    if (*c == '+' && length == 0 && !international) {
+      international = true;
+    } else if (isdigit(static_cast<unsigned char>(*c))) {
+      if (length == sizeof(digits) - 1) {
+        return false;
       }
+
+      digits[length++] = *c;
     }
   }
 
-  return res;
+  digits[length] = '\0';
+
+  const char *rest = digits;
+
+  if (!international && strStartsWith(digits, "00")) {
+    international = true;
+    rest += 2;
+  }
+
+  int written;
+
+  if (international && strStartsWith(rest, kCountryCallingCode)) {
+    written = snprintf(normalized, size, "0%s", rest + strlen(kCountryCallingCode));
+  } else {
+    written = snprintf(normalized, size, international ? "+%s" : "%s", rest);
+  }
+
+  return length > 0 && written > 0 && static_cast<size_t>(written) < size;
 }
@@ -4,4 +4,46 @@
 
 enum class DialedNumberValidationResult { Valid, Pending, Invalid };
 
-DialedNumberValidationResult validateDialedNumber(const char *number);
+// Follows the dialed number through the phone book one digit at a time. It keeps the range of
+// sorted entries that start with the number, and each digit narrows it with a binary search.
+class PhoneBookCursor {
+public:
+  // Must be called again whenever the phone book changes.
+  void reset();
+  // Once the number has left the phone book, the cursor stays off it until reset.
+  void advance(const int digit);
+
+  // The number is a whole entry.
+  bool isEntry() const;
+  // Some entry starts with the number, and is longer.
+  bool isPrefix() const;
+  // What the entry dials, or nullptr if the number isn't an entry.
+  const char *getNumber() const;
+
+private:
+  size_t _first = 0;
+  size_t _last = 0;
+  size_t _length = 0;
+};
+
+// Follows the dialed number through the dial plan (phoneBook/dialPlan.txt), compiled into a DFA
+// by phoneBook/generate.py.
+class DialPlanCursor {
+public:
+  void reset();
+  void advance(const int digit);
+
+  DialedNumberValidationResult getResult() const;
+
+private:
+  uint16_t _state = 0;
+};
+
+// Phone book entries come first, then the dial plan.
+DialedNumberValidationResult validateDialedNumber(
+    const PhoneBookCursor &phoneBookCursor, const DialPlanCursor &dialPlanCursor);
+
+// Turns a number into national format: separators are dropped, and the country calling code, given
+// as "+<code>" or "00<code>", becomes a leading 0. Other international numbers keep their "+".
+// Returns false if the number is empty or doesn't fit.
+bool normalizePhoneNumber(const char *number, char *normalized, const size_t size);
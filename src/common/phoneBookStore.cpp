@@ -0,0 +1,295 @@
+#include "phoneBookStore.h"
+#include "generated/phoneBook.h"
+#include "logger.h"
+#include <LittleFS.h>
+#include <cstring>
+
+namespace {
+  const constexpr char *kPhoneBookPath = "/phonebook.bin";
+  const constexpr char *kPhoneBookUpdatePath = "/phonebook.tmp";
+  const constexpr char kImageMagic[] = {'T', 'P', 'B', '1'};
+  const constexpr size_t kImageHeaderSize = 8;
+  const constexpr size_t kImageIndexEntrySize = 4;
+  // Far more contacts than a rotary dial is pleasant for, and still a small part of the heap.
+  const constexpr size_t kMaxImageSize = 64 * 1024;
+
+  bool mounted = false;
+  PhoneBookView phoneBookView;
+  // The heap copy behind phoneBookView, or nullptr while it's the built-in image.
+  uint8_t *loadedImage = nullptr;
+
+  File updateFile;
+  size_t updateSize = 0;
+  bool updateFailed = false;
+
+  // Returns a heap copy of the file, or nullptr. The caller frees it.
+  uint8_t *readImage(const char *path, size_t &size) {
+    // Opening a missing file logs an error, and no uploaded phone book is the usual case.
+    if (!LittleFS.exists(path)) {
+      return nullptr;
+    }
+
+    File file = LittleFS.open(path, FILE_READ);
+
+    if (!file) {
+      return nullptr;
+    }
+
+    size = file.size();
+    uint8_t *image = nullptr;
+
+    if (size > 0 && size <= kMaxImageSize) {
+      image = static_cast<uint8_t *>(malloc(size));
+    }
+
+    if (image != nullptr && file.read(image, size) != size) {
+      free(image);
+      image = nullptr;
+    }
+
+    file.close();
+    return image;
+  }
+
+  void useImage(const PhoneBookView &view, uint8_t *image) {
+    phoneBookView = view;
+    free(loadedImage);
+    loadedImage = image;
+  }
+
+  void useBuiltInImage() {
+    PhoneBookView view;
+
+    if (view.attach(phoneBookImage, sizeof(phoneBookImage))) {
+      useImage(view, nullptr);
+    } else {
+      LOG_ERRORLN(F("Built-in phone book is invalid"));
+    }
+  }
+}
+
+bool PhoneBookView::attach(const uint8_t *image, const size_t size) {
+  if (size < kImageHeaderSize || memcmp(image, kImageMagic, sizeof(kImageMagic)) != 0) {
+    return false;
+  }
+
+  PhoneBookView view;
+  view._image = image;
+  view._size = view.readU16(4);
+
+  const size_t poolSize = view.readU16(6);
+  const size_t poolOffset = kImageHeaderSize + view._size * kImageIndexEntrySize;
+
+  // The pool ending in a NUL keeps every string in it terminated.
+  if (size != poolOffset + poolSize || (poolSize == 0 && view._size > 0) ||
+      (poolSize > 0 && image[size - 1] != '\0')) {
+    return false;
+  }
+
+  for (size_t i = 0; i < view._size; i++) {
+    const size_t indexOffset = kImageHeaderSize + i * kImageIndexEntrySize;
+
+    if (view.readU16(indexOffset) >= poolSize || view.readU16(indexOffset + 2) >= poolSize) {
+      return false;
+    }
+
+    const char *entry = view.getEntry(i);
+
+    if (entry[0] == '\0') {
+      return false;
+    }
+
+    for (const char *c = entry; *c != '\0'; c++) {
+      if (!isdigit(static_cast<unsigned char>(*c))) {
+        return false;
+      }
+    }
+
+    if (i > 0 && strcmp(view.getEntry(i - 1), entry) >= 0) {
+      return false;
+    }
+  }
+
+  *this = view;
+  return true;
+}
+
+size_t PhoneBookView::size() const {
+  return _size;
+}
+
+const char *PhoneBookView::getEntry(const size_t index) const {
+  return getString(kImageHeaderSize + index * kImageIndexEntrySize);
+}
+
+const char *PhoneBookView::getNumber(const size_t index) const {
+  return getString(kImageHeaderSize + index * kImageIndexEntrySize + 2);
+}
+
+void PhoneBookView::narrow(size_t &first, size_t &last, const size_t length, const char c) const {
+  const unsigned char target = static_cast<unsigned char>(c);
+  size_t low = first;
+  size_t high = last;
+
+  while (low < high) {
+    const size_t middle = low + (high - low) / 2;
+
+    if (static_cast<unsigned char>(getEntry(middle)[length]) < target) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+
+  first = low;
+  high = last;
+
+  while (low < high) {
+    const size_t middle = low + (high - low) / 2;
+
+    if (static_cast<unsigned char>(getEntry(middle)[length]) <= target) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+
+  last = low;
+}
+
+size_t PhoneBookView::find(const char *entry) const {
+  size_t low = 0;
+  size_t high = _size;
+
+  while (low < high) {
+    const size_t middle = low + (high - low) / 2;
+    const int comparison = strcmp(getEntry(middle), entry);
+
+    if (comparison == 0) {
+      return middle;
+    }
+
+    if (comparison < 0) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+
+  return _size;
+}
+
+uint16_t PhoneBookView::readU16(const size_t offset) const {
+  return static_cast<uint16_t>(_image[offset] | (_image[offset + 1] << 8));
+}
+
+const char *PhoneBookView::getString(const size_t indexOffset) const {
+  const size_t poolOffset = kImageHeaderSize + _size * kImageIndexEntrySize;
+  return reinterpret_cast<const char *>(_image + poolOffset + readU16(indexOffset));
+}
+
+void PhoneBookStore::init() {
+  LOG_INFOLN(F("Loading phone book..."));
+
+  useBuiltInImage();
+
+  // Formats the partition on the first boot, when there's nothing on it yet.
+  mounted = LittleFS.begin(true);
+
+  if (!mounted) {
+    LOG_ERRORLN(F("Failed to mount LittleFS, using the built-in phone book"));
+    return;
+  }
+
+  size_t size = 0;
+  uint8_t *image = readImage(kPhoneBookPath, size);
+  PhoneBookView view;
+
+  if (image == nullptr) {
+    LOG_INFOLN(F("No uploaded phone book, using the built-in one"));
+  } else if (!view.attach(image, size)) {
+    LOG_ERRORLN(F("Uploaded phone book is invalid, using the built-in one"));
+    free(image);
+  } else {
+    useImage(view, image);
+  }
+
+  LOG_INFOLN(F("Phone book loaded, %u entries"), static_cast<unsigned>(phoneBookView.size()));
+}
+
+const PhoneBookView &PhoneBookStore::view() {
+  return phoneBookView;
+}
+
+void PhoneBookStore::beginUpdate() {
+  abortUpdate();
+
+  updateSize = 0;
+  updateFailed = !mounted;
+
+  if (mounted) {
+    updateFile = LittleFS.open(kPhoneBookUpdatePath, FILE_WRITE);
+    updateFailed = !updateFile;
+  }
+
+  if (updateFailed) {
+    LOG_ERRORLN(F("Failed to start the phone book update"));
+  }
+}
+
+void PhoneBookStore::writeUpdate(const uint8_t *data, const size_t size) {
+  if (updateFailed || !updateFile) {
+    return;
+  }
+
+  if (updateSize + size > kMaxImageSize || updateFile.write(data, size) != size) {
+    LOG_ERRORLN(F("Phone book update failed after %u bytes"), static_cast<unsigned>(updateSize));
+    updateFailed = true;
+    return;
+  }
+
+  updateSize += size;
+}
+
+bool PhoneBookStore::commitUpdate() {
+  if (updateFailed || !updateFile) {
+    abortUpdate();
+    return false;
+  }
+
+  updateFile.close();
+
+  size_t size = 0;
+  uint8_t *image = readImage(kPhoneBookUpdatePath, size);
+  PhoneBookView view;
+
+  if (image == nullptr || !view.attach(image, size)) {
+    LOG_ERRORLN(F("Uploaded phone book is invalid, keeping the current one"));
+    free(image);
+    LittleFS.remove(kPhoneBookUpdatePath);
+    return false;
+  }
+
+  // LittleFS renames over an existing file atomically, so a reset here leaves one of the two.
+  if (!LittleFS.rename(kPhoneBookUpdatePath, kPhoneBookPath)) {
+    LOG_ERRORLN(F("Failed to store the uploaded phone book"));
+    free(image);
+    LittleFS.remove(kPhoneBookUpdatePath);
+    return false;
+  }
+
+  useImage(view, image);
+
+  LOG_INFOLN(F("Phone book updated, %u entries"), static_cast<unsigned>(view.size()));
+  return true;
+}
+
+void PhoneBookStore::abortUpdate() {
+  if (updateFile) {
+    updateFile.close();
+    LittleFS.remove(kPhoneBookUpdatePath);
+  }
+
+  updateSize = 0;
+  updateFailed = false;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <Arduino.h>
+
+// A read-only view over a phone book image, as phoneBook/generate.py writes it: an 8 byte header
+// ("TPB1", entry count, pool size), an index of (entry offset, number offset) pairs sorted by
+// entry, then a pool of NUL terminated strings. All little endian, offsets are into the pool.
+class PhoneBookView {
+public:
+  // Checks the image before using it, and keeps the view as it was if it's malformed. The image
+  // must outlive the view.
+  bool attach(const uint8_t *image, const size_t size);
+
+  size_t size() const;
+  const char *getEntry(const size_t index) const;
+  const char *getNumber(const size_t index) const;
+
+  // Narrows [first, last), whose entries all share their first `length` characters, to the ones
+  // followed by `c`. Entries that end there sort first, so c is '\0' for those.
+  void narrow(size_t &first, size_t &last, const size_t length, const char c) const;
+
+  // Returns the entry's index, or size() if it isn't in the phone book.
+  size_t find(const char *entry) const;
+
+private:
+  uint16_t readU16(const size_t offset) const;
+  const char *getString(const size_t indexOffset) const;
+
+  const uint8_t *_image = nullptr;
+  size_t _size = 0;
+};
+
+// Keeps the phone book on LittleFS, so it can change without a reflash. The image is loaded into
+// RAM once, and the built-in one (pb.txt at build time) is used until a valid image is uploaded.
+namespace PhoneBookStore {
+  void init();
+
+  const PhoneBookView &view();
+
+  // An upload arrives in chunks and only replaces the phone book if it's a valid image, in which
+  // case the view changes and cursors over the old one must be reset.
+  void beginUpdate();
+  void writeUpdate(const uint8_t *data, const size_t size);
+  bool commitUpdate();
+  void abortUpdate();
+}
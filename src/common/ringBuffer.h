@@ -1,6 +1,7 @@
 #pragma once
 
 #include <Arduino.h>
+#include <atomic>
 
 template <typename T, size_t N> class RingBuffer {
 public:
@@ -58,6 +59,15 @@ public:
     return _buffer[_tail];
   }
 
+  // Indexed from the oldest item, so [0] is front().
+  T &operator[](const size_t index) {
+    return _buffer[(_tail + index) % N];
+  }
+
+  const T &operator[](const size_t index) const {
+    return _buffer[(_tail + index) % N];
+  }
+
   void clear() {
     _head = _tail;
     _full = false;
@@ -69,3 +79,74 @@ private:
   size_t _tail;
   bool _full;
 };
+
+// Lock-free variant of RingBuffer for exactly one producer and one consumer, which may run on
+// different cores. Only the producer may call push() and full(), only the consumer may call pop(),
+// front() and clear().
+template <typename T, size_t N> class SpscRingBuffer {
+  // Head and tail run freely and are only reduced modulo N on access, which stays correct across
+  // their wrap-around as long as N divides the counter range.
+  static_assert((N & (N - 1)) == 0, "SpscRingBuffer size must be a power of two");
+
+public:
+  SpscRingBuffer() : _buffer(), _head(0), _tail(0) {}
+
+  bool empty() const {
+    return _head.load(std::memory_order_acquire) == _tail.load(std::memory_order_acquire);
+  }
+
+  bool full() const {
+    return size() == N;
+  }
+
+  size_t capacity() const {
+    return N;
+  }
+
+  size_t size() const {
+    return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire);
+  }
+
+  bool push(const T &item) {
+    const size_t head = _head.load(std::memory_order_relaxed);
+
+    if (head - _tail.load(std::memory_order_acquire) == N) {
+      return false;
+    }
+
+    _buffer[head % N] = item;
+    _head.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  T pop() {
+    const size_t tail = _tail.load(std::memory_order_relaxed);
+
+    if (tail == _head.load(std::memory_order_acquire)) {
+      return T();
+    }
+
+    T item = _buffer[tail % N];
+    _tail.store(tail + 1, std::memory_order_release);
+    return item;
+  }
+
+  T front() const {
+    const size_t tail = _tail.load(std::memory_order_relaxed);
+
+    if (tail == _head.load(std::memory_order_acquire)) {
+      return T();
+    }
+
+    return _buffer[tail % N];
+  }
+
+  void clear() {
+    _tail.store(_head.load(std::memory_order_acquire), std::memory_order_release);
+  }
+
+private:
+  T _buffer[N];
+  std::atomic<size_t> _head;
+  std::atomic<size_t> _tail;
+};
@@ -0,0 +1,301 @@
+#include "simContacts.h"
+#include "logger.h"
+#include "phoneBook.h"
+#include "string.h"
+#include <LittleFS.h>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+  const constexpr char *kSimContactsPath = "/simcontacts.bin";
+  const constexpr char kSimContactsMagic[] = {'T', 'S', 'C', '2'};
+  // SIMs hold 250 entries at most in practice, this is only a sanity check on the stored counts.
+  const constexpr size_t kMaxSimContacts = 1000;
+  const constexpr size_t kMaxSimContactRanges = kMaxSimContacts / kSimContactsRangeSize;
+  // 32-bit FNV-1a. A range without entries keeps the offset basis.
+  const constexpr uint32_t kChecksumBasis = 0x811C9DC5u;
+  const constexpr uint32_t kChecksumPrime = 0x01000193u;
+
+  // Followed by the range checksums, then the contacts.
+  struct SimContactsHeader {
+    char magic[sizeof(kSimContactsMagic)];
+    uint16_t count;
+    uint16_t rangeCount;
+    char iccid[kIccidSize];
+  };
+
+  // By number, and the lowest slot first among entries with the same number.
+  bool compareContacts(const SimContact &a, const SimContact &b) {
+    const int order = strcmp(a.number, b.number);
+    return order < 0 || (order == 0 && a.index < b.index);
+  }
+
+  bool compareNumbers(const SimContact &a, const SimContact &b) {
+    return strcmp(a.number, b.number) < 0;
+  }
+}
+
+void SimContactCache::init() {
+  load();
+
+  LOG_INFOLN(F("SIM contacts loaded, %u cached"), static_cast<unsigned>(_count));
+}
+
+bool SimContactCache::beginSync(const char *iccid, const size_t total) {
+  abortSync();
+
+  const size_t rangeCount = (total + kSimContactsRangeSize - 1) / kSimContactsRangeSize;
+
+  if (rangeCount > kMaxSimContactRanges) {
+    return false;
+  }
+
+  if (!strEqual(_iccid, iccid) || rangeCount != _rangeCount) {
+    clear();
+
+    if (!resizeRanges(rangeCount)) {
+      return false;
+    }
+
+    snprintf(_iccid, sizeof(_iccid), "%s", iccid);
+    _dirty = true;
+  }
+
+  _syncing = true;
+  _nextRange = 0;
+
+  return true;
+}
+
+void SimContactCache::beginRange(const size_t first) {
+  _range = (first - 1) / kSimContactsRangeSize;
+  _rangeChecksum = kChecksumBasis;
+  _rangeContactCount = 0;
+}
+
+// The line ends are part of the checksum, so entries can't run into each other.
+void SimContactCache::addLine(const char *line) {
+  for (const char *c = line; *c != '\0'; c++) {
+    _rangeChecksum = (_rangeChecksum ^ static_cast<uint8_t>(*c)) * kChecksumPrime;
+  }
+
+  _rangeChecksum = (_rangeChecksum ^ '\n') * kChecksumPrime;
+}
+
+void SimContactCache::add(const size_t index, const char *number, const char *name) {
+  if (!_syncing || _rangeContactCount == kSimContactsRangeSize) {
+    return;
+  }
+
+  SimContact &contact = _rangeContacts[_rangeContactCount];
+
+  if (!normalizePhoneNumber(number, contact.number, sizeof(contact.number))) {
+    return;
+  }
+
+  snprintf(contact.name, sizeof(contact.name), "%s", name);
+  contact.index = static_cast<uint16_t>(index);
+  ++_rangeContactCount;
+}
+
+bool SimContactCache::endRange() {
+  if (!_syncing || _range >= _rangeCount) {
+    return false;
+  }
+
+  _nextRange = _range + 1;
+
+  if (_rangeChecksum == _checksums[_range]) {
+    return false;
+  }
+
+  // The checksum stays as it was, so the range is read again next time.
+  if (!replaceRange(_range)) {
+    return false;
+  }
+
+  _checksums[_range] = _rangeChecksum;
+  _dirty = true;
+
+  return true;
+}
+
+void SimContactCache::commitSync() {
+  if (!_syncing) {
+    return;
+  }
+
+  _rangeContactCount = 0;
+
+  for (size_t range = _nextRange; range < _rangeCount; range++) {
+    if (_checksums[range] != kChecksumBasis && replaceRange(range)) {
+      _checksums[range] = kChecksumBasis;
+      _dirty = true;
+    }
+  }
+
+  _syncing = false;
+
+  if (_dirty && save()) {
+    _dirty = false;
+  }
+}
+
+// Ranges that were already replaced stay that way, and are written with the next commit.
+void SimContactCache::abortSync() {
+  _syncing = false;
+  _rangeContactCount = 0;
+}
+
+const char *SimContactCache::findName(const char *number) const {
+  SimContact key;
+
+  if (_count == 0 || !normalizePhoneNumber(number, key.number, sizeof(key.number))) {
+    return nullptr;
+  }
+
+  const SimContact *found = std::lower_bound(_contacts, _contacts + _count, key, compareNumbers);
+
+  if (found == _contacts + _count || !strEqual(found->number, key.number)) {
+    return nullptr;
+  }
+
+  return found->name;
+}
+
+size_t SimContactCache::size() const {
+  return _count;
+}
+
+void SimContactCache::clear() {
+  free(_contacts);
+  _contacts = nullptr;
+  _count = 0;
+  _capacity = 0;
+  free(_checksums);
+  _checksums = nullptr;
+  _rangeCount = 0;
+  _iccid[0] = '\0';
+}
+
+bool SimContactCache::resizeRanges(const size_t rangeCount) {
+  if (rangeCount > 0) {
+    _checksums = static_cast<uint32_t *>(malloc(rangeCount * sizeof(uint32_t)));
+
+    if (_checksums == nullptr) {
+      return false;
+    }
+  }
+
+  std::fill(_checksums, _checksums + rangeCount, kChecksumBasis);
+  _rangeCount = rangeCount;
+
+  return true;
+}
+
+// Swaps the range's cached contacts for the ones just read, keeping the array sorted.
+bool SimContactCache::replaceRange(const size_t range) {
+  const size_t first = range * kSimContactsRangeSize + 1;
+  const size_t last = first + kSimContactsRangeSize - 1;
+
+  SimContact *end = std::remove_if(_contacts, _contacts + _count, [&](const SimContact &contact) {
+    return contact.index >= first && contact.index <= last;
+  });
+  _count = end - _contacts;
+
+  if (_count + _rangeContactCount > _capacity) {
+    const size_t capacity = _count + _rangeContactCount;
+    SimContact *contacts =
+        static_cast<SimContact *>(realloc(_contacts, capacity * sizeof(SimContact)));
+
+    if (contacts == nullptr) {
+      return false;
+    }
+
+    _contacts = contacts;
+    _capacity = capacity;
+  }
+
+  std::copy(_rangeContacts, _rangeContacts + _rangeContactCount, _contacts + _count);
+  _count += _rangeContactCount;
+  std::sort(_contacts, _contacts + _count, compareContacts);
+
+  return true;
+}
+
+void SimContactCache::load() {
+  if (!LittleFS.exists(kSimContactsPath)) {
+    return;
+  }
+
+  File file = LittleFS.open(kSimContactsPath, FILE_READ);
+  SimContactsHeader header;
+
+  if (!file || file.read(reinterpret_cast<uint8_t *>(&header), sizeof(header)) != sizeof(header) ||
+      memcmp(header.magic, kSimContactsMagic, sizeof(kSimContactsMagic)) != 0 ||
+      header.count > kMaxSimContacts || header.rangeCount > kMaxSimContactRanges ||
+      header.iccid[sizeof(header.iccid) - 1] != '\0') {
+    LOG_WARNLN(F("Cached SIM contacts are invalid, they will be read again"));
+    file.close();
+    return;
+  }
+
+  const size_t checksumsSize = header.rangeCount * sizeof(uint32_t);
+  const size_t contactsSize = header.count * sizeof(SimContact);
+  uint32_t *checksums = static_cast<uint32_t *>(malloc(checksumsSize));
+  SimContact *contacts = static_cast<SimContact *>(malloc(contactsSize));
+
+  if ((checksumsSize > 0 &&
+       (checksums == nullptr ||
+        file.read(reinterpret_cast<uint8_t *>(checksums), checksumsSize) != checksumsSize)) ||
+      (contactsSize > 0 &&
+       (contacts == nullptr ||
+        file.read(reinterpret_cast<uint8_t *>(contacts), contactsSize) != contactsSize))) {
+    LOG_WARNLN(F("Failed to read the cached SIM contacts"));
+    free(checksums);
+    free(contacts);
+    file.close();
+    return;
+  }
+
+  file.close();
+
+  for (size_t i = 0; i < header.count; i++) {
+    contacts[i].number[sizeof(contacts[i].number) - 1] = '\0';
+    contacts[i].name[sizeof(contacts[i].name) - 1] = '\0';
+  }
+
+  _contacts = contacts;
+  _count = header.count;
+  _capacity = header.count;
+  _checksums = checksums;
+  _rangeCount = header.rangeCount;
+  snprintf(_iccid, sizeof(_iccid), "%s", header.iccid);
+}
+
+bool SimContactCache::save() const {
+  SimContactsHeader header = {};
+  memcpy(header.magic, kSimContactsMagic, sizeof(kSimContactsMagic));
+  header.count = static_cast<uint16_t>(_count);
+  header.rangeCount = static_cast<uint16_t>(_rangeCount);
+  snprintf(header.iccid, sizeof(header.iccid), "%s", _iccid);
+
+  File file = LittleFS.open(kSimContactsPath, FILE_WRITE);
+  const size_t checksumsSize = _rangeCount * sizeof(uint32_t);
+  const size_t contactsSize = _count * sizeof(SimContact);
+
+  const bool saved =
+      file &&
+      file.write(reinterpret_cast<const uint8_t *>(&header), sizeof(header)) == sizeof(header) &&
+      (checksumsSize == 0 ||
+       file.write(reinterpret_cast<const uint8_t *>(_checksums), checksumsSize) == checksumsSize) &&
+      (contactsSize == 0 ||
+       file.write(reinterpret_cast<const uint8_t *>(_contacts), contactsSize) == contactsSize);
+
+  if (!saved) {
+    LOG_ERRORLN(F("Failed to save the SIM contacts"));
+  }
+
+  file.close();
+  return saved;
+}
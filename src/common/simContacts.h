@@ -0,0 +1,67 @@
+#pragma once
+
+#include "consts.h"
+#include <Arduino.h>
+
+const constexpr size_t kIccidSize = 24;
+// The SIM is read, and checked for changes, this many slots at a time. Small, so a call never
+// waits long behind a +CPBR.
+const constexpr size_t kSimContactsRangeSize = 10;
+
+struct SimContact {
+  // Normalized, see normalizePhoneNumber().
+  char number[kMediumBufferSize];
+  // As the SIM stores it, cut short if it doesn't fit.
+  char name[kMediumBufferSize];
+  // The SIM slot it was read from.
+  uint16_t index;
+};
+
+// The SIM phonebook, kept on LittleFS sorted by number so a caller's name is a binary search away.
+// It's tagged with the SIM's ICCID, and keeps a checksum of the +CPBR lines of every range of
+// slots. The SIM can't say what changed, so a sync still reads every used slot, but only the
+// ranges whose lines differ replace their contacts, and the file is only written if any did.
+class SimContactCache {
+public:
+  // LittleFS must already be mounted, PhoneBookStore::init() does that.
+  void init();
+
+  // A SIM other than the cached one, or one with a different number of slots, starts from empty.
+  bool beginSync(const char *iccid, const size_t total);
+  // Each range's +CPBR lines as they come, and the contacts parsed from them.
+  void beginRange(const size_t first);
+  void addLine(const char *line);
+  void add(const size_t index, const char *number, const char *name);
+  // Returns whether the range changed, in which case its contacts replace the cached ones.
+  bool endRange();
+  // The ranges after the last one read are empty.
+  void commitSync();
+  void abortSync();
+
+  // Returns the contact's name, or nullptr if the number isn't on the SIM.
+  const char *findName(const char *number) const;
+  size_t size() const;
+
+private:
+  void load();
+  bool save() const;
+  void clear();
+  bool resizeRanges(const size_t rangeCount);
+  bool replaceRange(const size_t range);
+
+  SimContact *_contacts = nullptr;
+  size_t _count = 0;
+  size_t _capacity = 0;
+  char _iccid[kIccidSize] = "";
+  uint32_t *_checksums = nullptr;
+  size_t _rangeCount = 0;
+
+  bool _syncing = false;
+  // Set once the contacts differ from the file, until it's written.
+  bool _dirty = false;
+  size_t _range = 0;
+  size_t _nextRange = 0;
+  uint32_t _rangeChecksum = 0;
+  SimContact _rangeContacts[kSimContactsRangeSize];
+  size_t _rangeContactCount = 0;
+};
@@ -23,7 +23,7 @@ struct CallState {
   bool playedCallWaitingTone = false;
   bool rangAtLeastOnce = false;
   bool otherPartyDropped = false;
-  char callNumber[kSmallBufferSize];
+  char callNumber[kMediumBufferSize];
 
   CallState()
       : callId(-1),
@@ -37,8 +37,8 @@ struct CallState {
   }
 
   void setcallNumber(const char *number) {
-    strncpy(callNumber, number, kSmallBufferSize - 1);
-    callNumber[kSmallBufferSize - 1] = '\0';
+    strncpy(callNumber, number, kMediumBufferSize - 1);
+    callNumber[kMediumBufferSize - 1] = '\0';
   }
 
   bool hasCallWaiting() const {
@@ -50,8 +50,6 @@ struct State {
   AppState newAppState;
   AppState prevAppState;
   CallState callState;
-  char lastModemMessage[kBigBufferSize];
-  bool messageHandled;
   bool isDnd;
 };
 
@@ -1,7 +1,67 @@
 #include "stream.h"
+#include "logger.h"
 
-size_t readLineFromStream(Stream &stream, char *buffer, const size_t bufferSize) {
-  size_t len = stream.readBytesUntil('\n', buffer, bufferSize - 1);
-  buffer[len] = '\0';
-  return len;
+size_t LineAssembler::poll(Stream &stream) {
+  size_t completed = 0;
+
+  // Once the queue is full we stop reading, so the remaining bytes wait in the UART FIFO instead of
+  // being dropped.
+  while (!_lines.full() && stream.available() > 0) {
+    const int c = stream.read();
+
+    if (c < 0) {
+      break;
+    }
+
+    if (c == '\n') {
+      completed += completeLine() ? 1 : 0;
+    } else if (c != '\r') {
+      if (_partialLength < sizeof(_partial) - 1) {
+        _partial[_partialLength++] = static_cast<char>(c);
+      } else {
+        _truncated = true;
+      }
+    }
+  }
+
+  return completed;
+}
+
+bool LineAssembler::completeLine() {
+  if (_truncated) {
+    LOG_WARNLN(F("Line longer than %u bytes, truncated"), sizeof(_partial) - 1);
+    _truncated = false;
+  }
+
+  if (_partialLength == 0) {
+    return false;
+  }
+
+  StreamLine line;
+  memcpy(line.text, _partial, _partialLength);
+  line.text[_partialLength] = '\0';
+  line.receivedMillis = millis();
+  _lines.push(line);
+
+  _partialLength = 0;
+  return true;
+}
+
+bool LineAssembler::hasLine() const {
+  return !_lines.empty();
+}
+
+bool LineAssembler::popLine(char *buffer, const size_t bufferSize, uint32_t *receivedMillis) {
+  if (_lines.empty()) {
+    return false;
+  }
+
+  const StreamLine line = _lines.pop();
+  snprintf(buffer, bufferSize, "%s", line.text);
+
+  if (receivedMillis != nullptr) {
+    *receivedMillis = line.receivedMillis;
+  }
+
+  return true;
 }
@@ -1,5 +1,34 @@
 #pragma once
 
+#include "consts.h"
+#include "ringBuffer.h"
 #include <Arduino.h>
 
-size_t readLineFromStream(Stream &stream, char *buffer, const size_t bufferSize);
+const constexpr size_t kLineQueueSize = 8;
+
+struct StreamLine {
+  char text[kBigBufferSize];
+  // When the terminating newline was read, so consumers can tell how long the line waited.
+  uint32_t receivedMillis;
+};
+
+// Assembles newline-terminated lines from a stream byte by byte. It never waits for more data:
+// whatever is available is consumed, and a partial line is kept until the rest of it arrives.
+// poll() and the line accessors may run on different tasks, one of each.
+class LineAssembler {
+public:
+  // Returns how many lines were completed.
+  size_t poll(Stream &stream);
+
+  bool hasLine() const;
+  bool popLine(char *buffer, const size_t bufferSize, uint32_t *receivedMillis = nullptr);
+
+private:
+  bool completeLine();
+
+  SpscRingBuffer<StreamLine, kLineQueueSize> _lines;
+
+  char _partial[kBigBufferSize] = "";
+  size_t _partialLength = 0;
+  bool _truncated = false;
+};
@@ -10,16 +10,16 @@ namespace {
 }
 
 void TimeManager::init() const {
-  Logger::infoln(F("Initializing time manager..."));
+  LOG_INFOLN(F("Initializing time manager..."));
 
   configTzTime(timeZone, kNtpServer);
 
-  Logger::infoln(F("Time manager initialized!"));
+  LOG_INFOLN(F("Time manager initialized!"));
 }
 
 bool TimeManager::fetchLocalTime(struct tm &timeinfo) const {
   if (!getLocalTime(&timeinfo)) {
-    Logger::errorln(F("Failed to obtain time"));
+    LOG_ERRORLN(F("Failed to obtain time"));
     return false;
   }
 
@@ -57,6 +57,6 @@ void TimeManager::process(State &state) {
 
   state.isDnd = isDnd;
 
-  Logger::debugln(F("Current time: %02d:%02d"), timeinfo.tm_hour, timeinfo.tm_min);
-  Logger::debugln(F("DND state: %s"), state.isDnd ? F("true") : F("false"));
+  LOG_DEBUGLN(F("Current time: %02d:%02d"), timeinfo.tm_hour, timeinfo.tm_min);
+  LOG_DEBUGLN(F("DND state: %s"), state.isDnd ? F("true") : F("false"));
 }
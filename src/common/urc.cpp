@@ -0,0 +1,143 @@
+#include "urc.h"
+#include <array>
+
+namespace {
+  struct UrcPattern {
+    const char *text;
+    UrcType type;
+    bool exact;
+  };
+
+  constexpr UrcPattern kUrcPatterns[] = {
+      {"OK", UrcType::Ok, true},
+      {"ERROR", UrcType::Error, true},
+      {"+CME ERROR:", UrcType::CmeError, false},
+      {"NO CARRIER", UrcType::NoCarrier, true},
+      {"RING", UrcType::Ring, false},
+      {"+CLCC", UrcType::CallList, false},
+      {"+CPAS", UrcType::PhoneActivity, false},
+      {"+CGREG", UrcType::Registration, false},
+      {"+AUDIOSTATE: audio play", UrcType::AudioPlaying, true},
+      {"+AUDIOSTATE: audio play stop", UrcType::AudioStopped, true},
+      {"+AUDIOSTATE: ", UrcType::AudioStateOther, false},
+      {"+STTONE: 0", UrcType::ToneStopped, true},
+      {"CONNECT", UrcType::Connect, false},
+      {"+FSOPEN: ", UrcType::FileOpened, false},
+      {"+ICCID: ", UrcType::Iccid, false},
+      {"+CPBS: ", UrcType::SimStorage, false},
+      {"+CPBR: ", UrcType::SimContact, false},
+      {"+CPIN: ", UrcType::SimState, false},
+      {"PB DONE", UrcType::SimState, true},
+
+      // Chatter that needs no handling at all.
+      {"AT", UrcType::Ignored, true},
+      {"ATE0", UrcType::Ignored, true},
+      {"+CCMXPLAY:", UrcType::Ignored, true},
+      {"+CCMXSTOP:", UrcType::Ignored, true},
+      {"+CSMS: 1,1,1", UrcType::Ignored, true},
+      {"SMS DONE", UrcType::Ignored, true},
+      {"VOICE CALL:", UrcType::Ignored, false},
+      {"+CCWA", UrcType::Ignored, false},
+  };
+
+  // The trie is stored as first-child/next-sibling links, index 0 being the root. Since the root
+  // is never anyone's child or sibling, 0 doubles as "no link".
+  struct UrcTrieNode {
+    char c = '\0';
+    uint16_t firstChild = 0;
+    uint16_t nextSibling = 0;
+    UrcType prefixType = UrcType::Unknown;
+    UrcType exactType = UrcType::Unknown;
+  };
+
+  template <size_t N> struct UrcTrie {
+    std::array<UrcTrieNode, N> nodes{};
+    size_t size = 1;
+  };
+
+  constexpr size_t maxUrcTrieSize() {
+    size_t size = 1;
+
+    for (const UrcPattern &pattern : kUrcPatterns) {
+      for (const char *c = pattern.text; *c != '\0'; ++c) {
+        ++size;
+      }
+    }
+
+    return size;
+  }
+
+  template <size_t N> constexpr UrcTrie<N> buildUrcTrie() {
+    UrcTrie<N> trie{};
+
+    for (const UrcPattern &pattern : kUrcPatterns) {
+      uint16_t node = 0;
+
+      for (const char *c = pattern.text; *c != '\0'; ++c) {
+        uint16_t child = trie.nodes[node].firstChild;
+
+        while (child != 0 && trie.nodes[child].c != *c) {
+          child = trie.nodes[child].nextSibling;
+        }
+
+        if (child == 0) {
+          child = static_cast<uint16_t>(trie.size++);
+          trie.nodes[child].c = *c;
+          trie.nodes[child].nextSibling = trie.nodes[node].firstChild;
+          trie.nodes[node].firstChild = child;
+        }
+
+        node = child;
+      }
+
+      if (pattern.exact) {
+        trie.nodes[node].exactType = pattern.type;
+      } else {
+        trie.nodes[node].prefixType = pattern.type;
+      }
+    }
+
+    return trie;
+  }
+
+  // Built twice: once to learn how many nodes the patterns share, then again at the exact size.
+  constexpr size_t kUrcTrieSize = buildUrcTrie<maxUrcTrieSize()>().size;
+  constexpr UrcTrie<kUrcTrieSize> kUrcTrie = buildUrcTrie<kUrcTrieSize>();
+
+  static_assert(kUrcTrieSize <= UINT16_MAX, "URC trie indices must fit in 16 bits");
+}
+
+UrcType classifyUrc(const char *line) {
+  UrcType match = UrcType::Unknown;
+  uint16_t node = 0;
+
+  for (const char *c = line;; ++c) {
+    const UrcTrieNode &current = kUrcTrie.nodes[node];
+
+    if (current.prefixType != UrcType::Unknown) {
+      match = current.prefixType;
+    }
+
+    if (*c == '\0') {
+      if (current.exactType != UrcType::Unknown) {
+        match = current.exactType;
+      }
+
+      break;
+    }
+
+    uint16_t child = current.firstChild;
+
+    while (child != 0 && kUrcTrie.nodes[child].c != *c) {
+      child = kUrcTrie.nodes[child].nextSibling;
+    }
+
+    if (child == 0) {
+      break;
+    }
+
+    node = child;
+  }
+
+  return match;
+}
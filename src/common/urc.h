@@ -0,0 +1,32 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Every modem line we know about, as classified by classifyUrc.
+enum class UrcType : uint8_t {
+  Unknown,
+  Ignored,
+  Ok,
+  Error,
+  CmeError,
+  NoCarrier,
+  Ring,
+  CallList,
+  PhoneActivity,
+  Registration,
+  AudioPlaying,
+  AudioStopped,
+  AudioStateOther,
+  ToneStopped,
+  Connect,
+  FileOpened,
+  Iccid,
+  SimStorage,
+  SimContact,
+  // The SIM was inserted, removed or its phonebook became ready.
+  SimState,
+};
+
+// Classifies a trimmed modem line in a single pass over its characters. Exact patterns win over
+// prefix patterns, and longer prefixes win over shorter ones.
+UrcType classifyUrc(const char *line);
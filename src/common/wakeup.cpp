@@ -0,0 +1,36 @@
+#include "wakeup.h"
+
+namespace {
+  TaskHandle_t loopTask = nullptr;
+}
+
+void Wakeup::init() {
+  loopTask = xTaskGetCurrentTaskHandle();
+}
+
+void Wakeup::notify() {
+  if (loopTask != nullptr) {
+    xTaskNotifyGive(loopTask);
+  }
+}
+
+void IRAM_ATTR Wakeup::notifyFromIsr() {
+  if (loopTask == nullptr) {
+    return;
+  }
+
+  BaseType_t higherPriorityTaskWoken = pdFALSE;
+  vTaskNotifyGiveFromISR(loopTask, &higherPriorityTaskWoken);
+
+  if (higherPriorityTaskWoken == pdTRUE) {
+    portYIELD_FROM_ISR();
+  }
+}
+
+// A LOOP_POLLING build spins the way the loop did before it slept, as a baseline for its
+// iterations/s. See benchmark/README.md.
+void Wakeup::waitFor([[maybe_unused]] const uint32_t timeoutMs) {
+#ifndef LOOP_POLLING
+  ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(timeoutMs));
+#endif
+}
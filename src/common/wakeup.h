@@ -0,0 +1,15 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Lets the loop task sleep until something happens: a modem line arrives, a watched GPIO changes,
+// or the wait times out.
+namespace Wakeup {
+  // Must be called from the loop task.
+  void init();
+
+  void notify();
+  void IRAM_ATTR notifyFromIsr();
+
+  void waitFor(const uint32_t timeoutMs);
+}
@@ -1,6 +1,7 @@
 #include "wifi.h"
 #include "config.h"
 #include "logger.h"
+#include "phoneBookStore.h"
 
 #ifdef WEB_SERIAL
 #include <ESPAsyncWebServer.h>
@@ -9,11 +10,13 @@
 
 namespace {
   const constexpr int kWifiManagerPortalTimeout = 60 * 5;
+  const constexpr char *kPhoneBookUploadPath = "/phonebook";
+  const constexpr int kHttpOkStatus = 200;
+  const constexpr int kHttpBadRequestStatus = 400;
 
 #ifdef WEB_SERIAL
   const constexpr int kWebSerialPort = 32860;
   const constexpr int kWebSerialPrintInterval = 60000;
-  const constexpr int kHttpOkStatus = 200;
 #endif
 }
 
@@ -22,20 +25,21 @@ AsyncWebServer server(kWebSerialPort);
 #endif
 
 void Wifi::init() {
-  Logger::infoln(F("Initializing WiFi..."));
+  LOG_INFOLN(F("Initializing WiFi..."));
 
   WiFi.mode(WIFI_STA);
 
   _wifiManager.setConfigPortalTimeout(kWifiManagerPortalTimeout);
   _wifiManager.setSaveConfigCallback([this]() { onWifiConnected(); });
+  _wifiManager.setWebServerCallback([this]() { onWebServerStarted(); });
 
   if (_wifiManager.autoConnect(kWifiSsid)) {
     onWifiConnected();
   } else {
-    Logger::infoln(F("Config portal running"));
+    LOG_INFOLN(F("Config portal running"));
   }
 
-  Logger::infoln(F("WiFi initialized!"));
+  LOG_INFOLN(F("WiFi initialized!"));
 }
 
 #ifdef WEB_SERIAL
@@ -47,7 +51,7 @@ void Wifi::initWebSerial() {
   WebSerial.begin(&server);
 
   WebSerial.onMessage([&](uint8_t *data, size_t len) {
-    Logger::infoln(F("Received %lu bytes from WebSerial"), len);
+    LOG_INFOLN(F("Received %lu bytes from WebSerial"), len);
     Serial.write(data, len);
     Serial.println();
     SerialAT.write(data, len);
@@ -66,14 +70,58 @@ void Wifi::initWebSerial() {
 #endif
 
 void Wifi::onWifiConnected() {
-  Logger::infoln(F("Connected to WiFi"));
-  Logger::infoln(F("IP Address: %s"), WiFi.localIP().toString().c_str());
+  LOG_INFOLN(F("Connected to WiFi"));
+
+  LOG_INFOLN(F("IP Address: %s"), WiFi.localIP().toString().c_str());
 
 #ifdef WEB_SERIAL
   initWebSerial();
 #endif
 }
 
+// The portal's web server also takes phone book images (phoneBook/generate.py -b), e.g.
+// curl -F "file=@pb.bin" http://192.168.4.1/phonebook
+void Wifi::onWebServerStarted() {
+  _wifiManager.server->on(
+      kPhoneBookUploadPath,
+      HTTP_POST,
+      [this]() { onPhoneBookUploaded(); },
+      [this]() { onPhoneBookUpload(); });
+}
+
+void Wifi::onPhoneBookUpload() {
+  HTTPUpload &upload = _wifiManager.server->upload();
+
+  switch (upload.status) {
+  case UPLOAD_FILE_START:
+    LOG_INFOLN(F("Receiving phone book %s"), upload.filename.c_str());
+    _phoneBookUpdated = false;
+    PhoneBookStore::beginUpdate();
+    break;
+  case UPLOAD_FILE_WRITE:
+    PhoneBookStore::writeUpdate(upload.buf, upload.currentSize);
+    break;
+  case UPLOAD_FILE_END:
+    _phoneBookUpdated = PhoneBookStore::commitUpdate();
+    break;
+  case UPLOAD_FILE_ABORTED:
+  default:
+    PhoneBookStore::abortUpdate();
+    _phoneBookUpdated = false;
+    break;
+  }
+}
+
+void Wifi::onPhoneBookUploaded() {
+  if (_phoneBookUpdated) {
+    _wifiManager.server->send(kHttpOkStatus, "text/plain", F("Phone book updated\n"));
+  } else {
+    _wifiManager.server->send(kHttpBadRequestStatus, "text/plain", F("Invalid phone book\n"));
+  }
+
+  _phoneBookUpdated = false;
+}
+
 void Wifi::process() {
   _wifiManager.process();
 
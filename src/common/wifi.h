@@ -11,6 +11,9 @@ public:
 
 private:
   void onWifiConnected();
+  void onWebServerStarted();
+  void onPhoneBookUpload();
+  void onPhoneBookUploaded();
 
 #ifdef WEB_SERIAL
   void initWebSerial();
@@ -18,6 +21,7 @@ private:
 #endif
 
   WiFiManager _wifiManager;
+  bool _phoneBookUpdated = false;
 
 #ifdef WEB_SERIAL
   uint32_t _lastWebSerialPrint = 0UL;
@@ -0,0 +1,325 @@
+#include "audioScheduler.h"
+#include "common/logger.h"
+
+namespace {
+  struct AudioTagPolicy {
+    AudioPriority priority;
+    // A new clip makes older ones with the same tag stale, e.g. the previous dialed digit.
+    bool replacesSameTag;
+  };
+
+  AudioTagPolicy getTagPolicy(const AudioTag tag) {
+    switch (tag) {
+    case AudioTag::DialTone:
+    case AudioTag::CallWaiting:
+    case AudioTag::CallDropped:
+      return {AudioPriority::CallProgress, true};
+    case AudioTag::CallerAnnouncement:
+      return {AudioPriority::CallerAnnouncement, true};
+    case AudioTag::CallerDigits:
+      return {AudioPriority::CallerAnnouncement, false};
+    case AudioTag::DialedDigit:
+    case AudioTag::Feedback:
+      return {AudioPriority::DigitFeedback, true};
+    case AudioTag::Prompt:
+    default:
+      return {AudioPriority::SystemPrompt, false};
+    }
+  }
+}
+
+const __FlashStringHelper *audioTagToString(const AudioTag tag) {
+  switch (tag) {
+  case AudioTag::DialTone:
+    return F("dial tone");
+  case AudioTag::CallWaiting:
+    return F("call waiting");
+  case AudioTag::CallDropped:
+    return F("call dropped");
+  case AudioTag::CallerAnnouncement:
+    return F("caller announcement");
+  case AudioTag::CallerDigits:
+    return F("caller digits");
+  case AudioTag::DialedDigit:
+    return F("dialed digit");
+  case AudioTag::Feedback:
+    return F("feedback");
+  case AudioTag::Prompt:
+    return F("prompt");
+  default:
+    return F("unknown");
+  }
+}
+
+const __FlashStringHelper *audioEventTypeToString(const AudioEventType type) {
+  switch (type) {
+  case AudioEventType::Started:
+    return F("started");
+  case AudioEventType::Completed:
+    return F("completed");
+  case AudioEventType::Preempted:
+    return F("preempted");
+  case AudioEventType::Cancelled:
+    return F("cancelled");
+  case AudioEventType::Dropped:
+    return F("dropped");
+  default:
+    return F("unknown");
+  }
+}
+
+uint32_t AudioScheduler::enqueue(AudioItem item) {
+  const AudioTagPolicy policy = getTagPolicy(item.tag);
+
+  item.priority = policy.priority;
+  item.id = _nextId++;
+
+  if (_nextId == 0) {
+    _nextId = 1;
+  }
+
+  if (policy.replacesSameTag) {
+    for (size_t i = _queuedCount; i > 0; i--) {
+      if (_queued[i - 1].tag == item.tag) {
+        pushEvent(AudioEventType::Cancelled, _queued[i - 1]);
+        removeQueued(i - 1);
+      }
+    }
+  }
+
+  if (_queuedCount == kAudioQueueSize) {
+    const int victim = findVictim(item.priority);
+
+    if (victim < 0) {
+      LOG_WARNLN(F("Audio queue full, dropping %s"), audioTagToString(item.tag));
+      pushEvent(AudioEventType::Dropped, item);
+      return 0;
+    }
+
+    LOG_WARNLN(F("Audio queue full, dropping queued %s"), audioTagToString(_queued[victim].tag));
+    pushEvent(AudioEventType::Dropped, _queued[victim]);
+    removeQueued(victim);
+  }
+
+  _queued[_queuedCount++] = item;
+  return item.id;
+}
+
+bool AudioScheduler::hasPending() const {
+  return _queuedCount > 0;
+}
+
+bool AudioScheduler::isPlaying() const {
+  return _playing;
+}
+
+const AudioItem &AudioScheduler::current() const {
+  return _current;
+}
+
+bool AudioScheduler::shouldPreempt() const {
+  if (!_playing) {
+    return false;
+  }
+
+  const int next = findNext();
+
+  if (next >= 0 && _queued[next].priority > _current.priority) {
+    return true;
+  }
+
+  if (!getTagPolicy(_current.tag).replacesSameTag) {
+    return false;
+  }
+
+  for (size_t i = 0; i < _queuedCount; i++) {
+    if (_queued[i].tag == _current.tag) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+const AudioItem *AudioScheduler::peekNext() const {
+  const int next = findNext();
+  return next >= 0 ? &_queued[next] : nullptr;
+}
+
+bool AudioScheduler::isQueued(const uint32_t id) const {
+  for (size_t i = 0; i < _queuedCount; i++) {
+    if (_queued[i].id == id) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+const AudioItem &AudioScheduler::start() {
+  const int next = findNext();
+
+  if (next >= 0) {
+    _current = _queued[next];
+    _playing = true;
+    removeQueued(next);
+    pushEvent(AudioEventType::Started, _current);
+  }
+
+  return _current;
+}
+
+void AudioScheduler::finish() {
+  if (!_playing) {
+    return;
+  }
+
+  _playing = false;
+  pushEvent(AudioEventType::Completed, _current);
+}
+
+void AudioScheduler::preempt() {
+  if (!_playing) {
+    return;
+  }
+
+  _playing = false;
+  expectStaleStop();
+  pushEvent(AudioEventType::Preempted, _current);
+}
+
+// Keeps the id, so it still goes before anything of the same priority queued after it.
+bool AudioScheduler::requeue() {
+  if (!_playing) {
+    return false;
+  }
+
+  _playing = false;
+
+  if (_queuedCount == kAudioQueueSize) {
+    pushEvent(AudioEventType::Dropped, _current);
+    return false;
+  }
+
+  _queued[_queuedCount++] = _current;
+  return true;
+}
+
+bool AudioScheduler::cancel(const AudioTag tag) {
+  for (size_t i = _queuedCount; i > 0; i--) {
+    if (_queued[i - 1].tag == tag) {
+      pushEvent(AudioEventType::Cancelled, _queued[i - 1]);
+      removeQueued(i - 1);
+    }
+  }
+
+  if (!_playing || _current.tag != tag) {
+    return false;
+  }
+
+  _playing = false;
+  expectStaleStop();
+  pushEvent(AudioEventType::Cancelled, _current);
+  return true;
+}
+
+bool AudioScheduler::cancelAll() {
+  while (_queuedCount > 0) {
+    pushEvent(AudioEventType::Cancelled, _queued[_queuedCount - 1]);
+    removeQueued(_queuedCount - 1);
+  }
+
+  if (!_playing) {
+    return false;
+  }
+
+  _playing = false;
+  expectStaleStop();
+  pushEvent(AudioEventType::Cancelled, _current);
+  return true;
+}
+
+bool AudioScheduler::onPlaybackStopped(const AudioType type) {
+  uint8_t &staleStops = _staleStops[static_cast<size_t>(type)];
+
+  if (staleStops > 0) {
+    --staleStops;
+    return false;
+  }
+
+  if (!_playing || _current.type != type) {
+    return false;
+  }
+
+  finish();
+  return true;
+}
+
+void AudioScheduler::onPlaybackStarted(const AudioType type) {
+  _staleStops[static_cast<size_t>(type)] = 0;
+}
+
+bool AudioScheduler::popEvent(AudioEvent &event) {
+  if (_events.empty()) {
+    return false;
+  }
+
+  event = _events.pop();
+  return true;
+}
+
+// Ids grow with insertion order, so the lowest id is the oldest.
+int AudioScheduler::findNext() const {
+  int best = -1;
+
+  for (size_t i = 0; i < _queuedCount; i++) {
+    if (best < 0 || _queued[i].priority > _queued[best].priority ||
+        (_queued[i].priority == _queued[best].priority && _queued[i].id < _queued[best].id)) {
+      best = static_cast<int>(i);
+    }
+  }
+
+  return best;
+}
+
+// The newest of the lowest priority items, if it ranks below the given priority.
+int AudioScheduler::findVictim(const AudioPriority priority) const {
+  int victim = -1;
+
+  for (size_t i = 0; i < _queuedCount; i++) {
+    if (_queued[i].priority >= priority) {
+      continue;
+    }
+
+    if (victim < 0 || _queued[i].priority < _queued[victim].priority ||
+        (_queued[i].priority == _queued[victim].priority && _queued[i].id > _queued[victim].id)) {
+      victim = static_cast<int>(i);
+    }
+  }
+
+  return victim;
+}
+
+// Order doesn't matter, findNext() goes by priority and id.
+void AudioScheduler::removeQueued(const size_t index) {
+  _queued[index] = _queued[_queuedCount - 1];
+  --_queuedCount;
+}
+
+// The owner stops the current item's playback, and the modem will report that later.
+void AudioScheduler::expectStaleStop() {
+  uint8_t &staleStops = _staleStops[static_cast<size_t>(_current.type)];
+
+  if (staleStops < UINT8_MAX) {
+    ++staleStops;
+  }
+}
+
+// The oldest event gives way when nobody has been reading them.
+void AudioScheduler::pushEvent(const AudioEventType type, const AudioItem &item) {
+  if (_events.full()) {
+    _events.pop();
+  }
+
+  _events.push({type, item.tag, item.id});
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+#include "common/ringBuffer.h"
+#include <Arduino.h>
+
+// As per SIMCom's A76XX Series AT Command Manual
+enum class Tone {
+  DialTone = 1,
+  CalledSubscriberBusy = 2,
+  Congestion = 3,
+  RadioPathAcknowledge = 4,
+  RadioPathNotAvailableOrCallDropped = 5,
+  ErrorOrSpecialInformation = 6,
+  CallWaitingTone = 7,
+  RingingTone = 8,
+  GeneralBeep = 16,
+  PositiveAcknowledgeTone = 17,
+  NegativeAcknowledgeOrErrorTone = 18,
+  IndianDialTone = 19,
+  AmericanDialTone = 20,
+};
+
+enum class AudioType : uint8_t { Tone, Mp3 };
+
+const constexpr size_t kAudioTypeCount = 2;
+
+// Higher values preempt lower ones.
+enum class AudioPriority : uint8_t {
+  SystemPrompt,
+  DigitFeedback,
+  CallerAnnouncement,
+  CallProgress,
+};
+
+// What a clip is for. The tag decides its priority, and whether a new clip with the same tag
+// replaces the old one instead of queueing behind it.
+enum class AudioTag : uint8_t {
+  DialTone,
+  CallWaiting,
+  CallDropped,
+  CallerAnnouncement,
+  // The digits of an unknown caller's number, played one after the other.
+  CallerDigits,
+  DialedDigit,
+  Feedback,
+  Prompt,
+};
+
+struct AudioItem {
+  AudioType type;
+  Tone toneId;
+  int toneDuration;
+  const char *filename;
+  int repeat;
+  AudioTag tag;
+  // Filled in by the scheduler.
+  AudioPriority priority = AudioPriority::SystemPrompt;
+  uint32_t id = 0;
+};
+
+enum class AudioEventType : uint8_t { Started, Completed, Preempted, Cancelled, Dropped };
+
+struct AudioEvent {
+  AudioEventType type;
+  AudioTag tag;
+  uint32_t id = 0;
+};
+
+const constexpr size_t kAudioQueueSize = 10;
+const constexpr size_t kAudioEventQueueSize = 16;
+
+const __FlashStringHelper *audioTagToString(const AudioTag tag);
+const __FlashStringHelper *audioEventTypeToString(const AudioEventType type);
+
+// Decides what plays next. It knows nothing about the modem: the owner starts and stops the actual
+// playback and reports back through start(), preempt() and the onPlayback*() calls.
+class AudioScheduler {
+public:
+  // Returns the item's id, or 0 if it was dropped because everything queued outranks it.
+  uint32_t enqueue(AudioItem item);
+
+  bool hasPending() const;
+  bool isPlaying() const;
+  const AudioItem &current() const;
+  // What start() would pick, or nullptr if nothing is queued.
+  const AudioItem *peekNext() const;
+  // Whether the item is still waiting to play.
+  bool isQueued(const uint32_t id) const;
+
+  // Whether something queued outranks what's playing, or replaces it.
+  bool shouldPreempt() const;
+
+  // Moves the highest priority queued item, oldest first, to current.
+  const AudioItem &start();
+  void finish();
+  void preempt();
+  // Puts the playing item back at the head of its priority, for when the play command failed.
+  bool requeue();
+
+  // Drops everything with the tag. Returns true if the playing item was one of them, in which case
+  // the owner must stop the playback.
+  bool cancel(const AudioTag tag);
+  bool cancelAll();
+
+  // The modem reported that a clip of the type stopped. Every clip that preempt() or cancel() cut
+  // short owes one such report, which may come in after the next clip started, so those are
+  // matched first. Returns true if the report finished the playing item.
+  bool onPlaybackStopped(const AudioType type);
+  // The modem reported that a clip of the type started. Anything it stopped before has been
+  // reported by then, so no more stop reports are owed.
+  void onPlaybackStarted(const AudioType type);
+
+  bool popEvent(AudioEvent &event);
+
+private:
+  int findNext() const;
+  int findVictim(const AudioPriority priority) const;
+  void removeQueued(const size_t index);
+  void pushEvent(const AudioEventType type, const AudioItem &item);
+  void expectStaleStop();
+
+  AudioItem _queued[kAudioQueueSize];
+  size_t _queuedCount = 0;
+
+  AudioItem _current;
+  bool _playing = false;
+
+  // Stop reports still owed by clips that were cut short, per AudioType.
+  uint8_t _staleStops[kAudioTypeCount] = {};
+
+  uint32_t _nextId = 1;
+
+  RingBuffer<AudioEvent, kAudioEventQueueSize> _events;
+};
@@ -1,5 +1,6 @@
 #include "hookSwitch.h"
 #include "common/logger.h"
+#include "common/wakeup.h"
 #include "config.h"
 
 namespace {
@@ -10,11 +11,12 @@ HookSwitch::HookSwitch()
     : _state(HIGH), _statePrevious(HIGH), _stateChangeTime(0UL), _stateChanged(false) {}
 
 void HookSwitch::init() const {
-  Logger::infoln(F("Initializing hook switch..."));
+  LOG_INFOLN(F("Initializing hook switch..."));
 
   pinMode(kHookSwitchPin, INPUT_PULLUP);
+  attachInterrupt(digitalPinToInterrupt(kHookSwitchPin), Wakeup::notifyFromIsr, CHANGE);
 
-  Logger::infoln(F("Hook switch initialized!"));
+  LOG_INFOLN(F("Hook switch initialized!"));
 }
 
 void HookSwitch::process() {
@@ -34,9 +36,9 @@ void HookSwitch::process() {
       _stateChanged = true;
 
       if (_state == LOW) {
-        Logger::infoln(F("Off hook!"));
+        LOG_INFOLN(F("Off hook!"));
       } else {
-        Logger::infoln(F("On hook!"));
+        LOG_INFOLN(F("On hook!"));
       }
     }
   }
@@ -44,6 +46,11 @@ void HookSwitch::process() {
   _statePrevious = newState;
 }
 
+// No debounce in progress.
+bool HookSwitch::isIdle() const {
+  return _statePrevious == _state;
+}
+
 bool HookSwitch::isOffHook() const {
   return (_state == LOW);
 }
@@ -9,6 +9,7 @@ public:
   void init() const;
   void process();
 
+  bool isIdle() const;
   bool isOffHook() const;
   bool isOnHook() const;
   bool justChangedOffHook();
@@ -1,24 +1,28 @@
 #include "modem.h"
+#include "common/atParser.h"
 #include "common/logger.h"
-#include "common/stream.h"
+#include "common/phoneBook.h"
 #include "common/string.h"
+#include "common/urc.h"
+#include "common/wakeup.h"
+#include <algorithm>
 
 namespace {
-  constexpr std::array<const char *, 9> knownMessages = {"ATE0",
-                                                         "+CCMXPLAY:",
-                                                         "+CCMXSTOP:",
-                                                         "+CSMS: 1,1,1",
-                                                         "NO CARRIER",
-                                                         "+CPIN: READY",
-                                                         "SMS DONE",
-                                                         "PB DONE",
-                                                         "+CPIN: SIM REMOVED"};
-
   const constexpr uint16_t kModemResetDelay = 1500;
 
   const constexpr uint32_t kInitTimeoutMs = 5000UL;
-  const constexpr uint32_t kKeepAliveIntervalMs = 30000UL;
+  // How long the modem may stay silent before it is probed. Doubles after every answered probe,
+  // and drops back to the minimum on any trouble.
+  const constexpr uint32_t kKeepAliveMinIntervalMs = 30000UL;
+  const constexpr uint32_t kKeepAliveMaxIntervalMs = 240000UL;
   const constexpr uint32_t kKeepAliveTimeoutMs = 5000UL;
+  // The second probe after a miss. Longer, in case the modem is just busy.
+  const constexpr uint32_t kKeepAliveSoftTimeoutMs = 15000UL;
+  const constexpr uint32_t kKeepAliveStatsLogInterval = 20;
+
+  const constexpr uint32_t kCommandTimeoutMs = 5000UL;
+  const constexpr uint32_t kDialTimeoutMs = 60000UL;
+  const constexpr uint32_t kAnswerTimeoutMs = 20000UL;
 
   const constexpr uint16_t kModemHardResetRetries = 5;
   const constexpr uint32_t kModemHardResetRetryDelay = 500UL;
@@ -33,94 +37,315 @@ namespace {
   const constexpr uint16_t kProbeRespTimeoutMs = 200;
   const constexpr uint16_t kProbeRetryDelayMs = 150;
 
-  // A safety margin between audio plays to prevent conflicts.
-  const constexpr uint16_t kIntervalBetweenAudioPlaysMillis = 40;
-}
-
-bool Modem::probeOK(uint32_t timeoutMs) {
-  uint32_t start = millis();
-
-  unsigned long originalTimeout = SerialAT.getTimeout();
-  SerialAT.setTimeout(kProbeRespTimeoutMs);
-
-  bool found = false;
+  const constexpr uint32_t kReaderTaskStackSize = 4096;
+  const constexpr UBaseType_t kReaderTaskPriority = 3;
+  // The reader task is woken by the UART driver, this is only a safety net for a missed event.
+  const constexpr TickType_t kReaderTaskIdleTicks = pdMS_TO_TICKS(100);
+  const constexpr size_t kModemRxBufferSize = 1024;
+  // In UART symbols (~10 bits each), how long the line must be quiet before the driver reports
+  // a partial FIFO.
+  const constexpr uint8_t kModemRxTimeoutSymbols = 2;
+
+  // The gap between audio plays is learned per transition: it creeps down by a small step every
+  // time the modem accepts a play command, and doubles every time it rejects one. It starts at the
+  // old fixed safety margin.
+  const constexpr uint32_t kInitialAudioGapMs = 40;
+  const constexpr uint32_t kAudioGapDecreaseMs = 2;
+  const constexpr uint32_t kMinAudioGapBackoffMs = 10;
+  const constexpr uint32_t kMaxAudioGapMs = 320;
+  const constexpr uint8_t kMaxAudioPlayRetries = 3;
+
+  // How long the modem waits for the data of an FSWRITE, in seconds, and how long we wait for its
+  // final result.
+  const constexpr uint8_t kFileWriteDataTimeoutSec = 10;
+  const constexpr uint32_t kFileWriteTimeoutMs = 15000UL;
+  // The most a single FSWRITE accepts.
+  const constexpr size_t kMaxFileWriteChunk = 10240;
+
+  // SIM phonebook entries read per +CPBR. Small, so a call never waits long behind a batch.
+  const constexpr uint32_t kSimContactsReadTimeoutMs = 10000UL;
+
+  struct CommandClassPattern {
+    const char *prefix;
+    CommandClass commandClass;
+    bool exact;
+  };
+
+  const constexpr CommandClassPattern kCommandClassPatterns[] = {
+      {"", CommandClass::KeepAlive, true},
+      {"A", CommandClass::Answer, true},
+      {"H", CommandClass::HangUp, true},
+      {"D", CommandClass::Dial, false},
+      {"+CCMX", CommandClass::Mp3, false},
+      {"+STTONE", CommandClass::Tone, false},
+      {"+CHLD", CommandClass::CallHold, false},
+      {"+COUTGAIN", CommandClass::Gain, false},
+      {"+CMICGAIN", CommandClass::Gain, false},
+      {"+CPAS", CommandClass::Status, false},
+      {"+CLCC", CommandClass::Status, false},
+      {"+CGREG", CommandClass::Status, false},
+  };
+
+  CommandClass classifyCommand(const PendingCommand &command) {
+    if (command.batchSize > 1) {
+      return CommandClass::Batch;
+    }
 
-  while (millis() - start < timeoutMs) {
-    SerialAT.print(F("AT\r"));
+    for (const CommandClassPattern &pattern : kCommandClassPatterns) {
+      const bool matches = pattern.exact ? strEqual(command.text, pattern.prefix)
+                                         : strStartsWith(command.text, pattern.prefix);
 
-    if (SerialAT.find((char *)"OK")) {
-      Logger::infoln(F("Modem OK! Took %lu ms"), millis() - start);
-      found = true;
-      break;
+      if (matches) {
+        return pattern.commandClass;
+      }
     }
 
-    delay(kProbeRetryDelayMs);
+    return CommandClass::Other;
   }
 
-  SerialAT.setTimeout(originalTimeout);
+  const __FlashStringHelper *commandClassToString(const CommandClass commandClass) {
+    switch (commandClass) {
+    case CommandClass::KeepAlive:
+      return F("AT");
+    case CommandClass::Mp3:
+      return F("+CCMX*");
+    case CommandClass::Tone:
+      return F("+STTONE");
+    case CommandClass::Dial:
+      return F("ATD");
+    case CommandClass::Answer:
+      return F("ATA");
+    case CommandClass::HangUp:
+      return F("ATH");
+    case CommandClass::CallHold:
+      return F("+CHLD");
+    case CommandClass::Gain:
+      return F("+C*GAIN");
+    case CommandClass::Status:
+      return F("status");
+    case CommandClass::Batch:
+      return F("batch");
+    default:
+      return F("other");
+    }
+  }
 
-  return found;
+  const __FlashStringHelper *commandResultToString(const CommandResult result) {
+    switch (result) {
+    case CommandResult::Ok:
+      return F("OK");
+    case CommandResult::Error:
+      return F("ERROR");
+    case CommandResult::CmeError:
+      return F("CME ERROR");
+    case CommandResult::Timeout:
+      return F("timeout");
+    case CommandResult::Aborted:
+      return F("aborted");
+    default:
+      return F("unknown");
+    }
+  }
 }
 
-Modem::Modem() : _modemImpl(SerialAT), _waitingForKeepAlive(false), _lastKeepAliveSent(0UL) {}
+Modem::Modem() : _modemImpl(SerialAT), _waitingForKeepAlive(false), _lastModemTraffic(0UL) {
+  for (auto &from : _audioTransitions) {
+    for (AudioTransitionStats &transition : from) {
+      transition.gapMs = kInitialAudioGapMs;
+    }
+  }
+}
 
 void Modem::init() {
-  Logger::infoln(F("Initializing modem..."));
+  LOG_INFOLN(F("Initializing modem..."));
 
+  _announcements.init();
+  _simContacts.init();
+
+  // Must be set before begin(). Gives the reader task headroom during URC bursts.
+  SerialAT.setRxBufferSize(kModemRxBufferSize);
   SerialAT.begin(kModemBaudRate, SERIAL_8N1, kModemRxPin, kModemTxPin);
 
   pinMode(BOARD_POWERON_PIN, OUTPUT);
   digitalWrite(BOARD_POWERON_PIN, HIGH);
 
-  initModem();
+  // init() runs on the loop task, so the reader task gets the other core.
+  const BaseType_t readerCore = xPortGetCoreID() == 0 ? 1 : 0;
+
+  xTaskCreatePinnedToCore(&Modem::readerTask,
+                          "modemReader",
+                          kReaderTaskStackSize,
+                          this,
+                          kReaderTaskPriority,
+                          &_readerTask,
+                          readerCore);
+
+  // HardwareSerial already owns the ESP-IDF UART event queue and calls us from its event task on
+  // every receive event, so the reader task only runs when there is something to read.
+  SerialAT.setRxTimeout(kModemRxTimeoutSymbols);
+  SerialAT.onReceive([this]() { xTaskNotifyGive(_readerTask); });
+
+  startPowerUp();
+}
+
+// Owns all reads from SerialAT. Lines are handed to the loop through the assembler's lock-free
+// queue, so ingestion doesn't depend on how long the slowest component in the loop takes.
+void Modem::readerTask(void *param) {
+  Modem *modem = static_cast<Modem *>(param);
 
-  Logger::infoln(F("Modem initialized!"));
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, kReaderTaskIdleTicks);
+
+    if (modem->_lineAssembler.poll(SerialAT) > 0) {
+      Wakeup::notify();
+    }
+  }
+}
+
+void Modem::setPowerPhase(const ModemPowerPhase phase) {
+  _powerPhase = phase;
+  _powerPhaseStart = millis();
 }
 
-void Modem::initModem() {
-  bool modemUp = false;
-  uint8_t tries = 0;
+void Modem::startPowerUp() {
+  // Whatever was in flight is lost with the reset, and the modem owes us nothing afterwards.
+  failPendingCommands(CommandResult::Aborted);
+
+  _powerTimings = ModemPowerTimings{};
+  _powerUpStart = millis();
+
+  startPowerUpAttempt();
+}
 
-  while (!modemUp && tries < kModemHardResetRetries) {
-    ++tries;
-    Logger::infoln(F("Modem start attempt %u…\n"), tries);
+void Modem::startPowerUpAttempt() {
+  ++_powerTimings.attempts;
+  LOG_INFOLN(F("Modem start attempt %u…"), _powerTimings.attempts);
 
-    hardResetModem();
+  pinMode(kModemResetPin, OUTPUT);
+  digitalWrite(kModemResetPin, !kModemResetLevel);
+  setPowerPhase(ModemPowerPhase::ResetSettle);
+}
 
-    modemUp = probeOK(kModemHardResetTimeoutMs);
+// Replaces the old delay()-based hard reset and probe loop. Each phase only checks whether its time
+// is up, so the rest of the loop keeps running while the modem boots.
+void Modem::processPowerUp() {
+  const uint32_t elapsed = millis() - _powerPhaseStart;
 
-    if (!modemUp) {
-      Logger::warnln(F("No OK - retrying…"));
-      delay(kModemHardResetRetryDelay);
+  switch (_powerPhase) {
+  case ModemPowerPhase::ResetSettle:
+    if (elapsed >= kResetSettleMs) {
+      digitalWrite(kModemResetPin, kModemResetLevel);
+      setPowerPhase(ModemPowerPhase::ResetPull);
+    }
+    break;
+  case ModemPowerPhase::ResetPull:
+    if (elapsed >= kResetPullMs) {
+      digitalWrite(kModemResetPin, !kModemResetLevel);
+      _powerTimings.resetMs = millis() - _powerUpStart;
+
+      pinMode(kBoardPowerKeyPin, OUTPUT);
+      digitalWrite(kBoardPowerKeyPin, LOW);
+      setPowerPhase(ModemPowerPhase::PowerKeyLow);
+    }
+    break;
+  case ModemPowerPhase::PowerKeyLow:
+    if (elapsed >= kPwrKeyLowMs) {
+      digitalWrite(kBoardPowerKeyPin, HIGH);
+      setPowerPhase(ModemPowerPhase::PowerKeyHigh);
+    }
+    break;
+  case ModemPowerPhase::PowerKeyHigh:
+    if (elapsed >= kPwrKeyHighMs) {
+      digitalWrite(kBoardPowerKeyPin, LOW);
+      _powerTimings.powerKeyMs = millis() - _powerUpStart - _powerTimings.resetMs;
+      _probeStart = millis();
+      sendProbe();
+    }
+    break;
+  case ModemPowerPhase::ProbeWait:
+    if (elapsed >= kProbeRetryDelayMs) {
+      sendProbe();
+    }
+    break;
+  case ModemPowerPhase::RetryDelay:
+    if (elapsed >= kModemHardResetRetryDelay) {
+      startPowerUpAttempt();
     }
+    break;
+  default:
+    break;
+  }
+}
+
+void Modem::sendProbe() {
+  setPowerPhase(ModemPowerPhase::Probing);
+  queueCommand("", kProbeRespTimeoutMs, &Modem::onProbeComplete);
+}
+
+void Modem::onProbeComplete(const PendingCommand &command, const CommandResult result) {
+  if (_powerPhase != ModemPowerPhase::Probing || result == CommandResult::Aborted) {
+    return;
+  }
+
+  if (result == CommandResult::Ok) {
+    onModemReady();
+    return;
   }
 
-  if (modemUp) {
-    Logger::infoln(F("Modem ready!"));
+  if (millis() - _probeStart < kModemHardResetTimeoutMs) {
+    setPowerPhase(ModemPowerPhase::ProbeWait);
+    return;
+  }
+
+  if (_powerTimings.attempts < kModemHardResetRetries) {
+    LOG_WARNLN(F("No OK - retrying…"));
+    setPowerPhase(ModemPowerPhase::RetryDelay);
   } else {
-    Logger::errorln(F("Modem unreachable - rebooting MCU in 5 s"));
+    LOG_ERRORLN(F("Modem unreachable - rebooting MCU"));
+    Logger::flush();
     ESP.restart();
   }
+}
+
+void Modem::onModemReady() {
+  const uint32_t now = millis();
+
+  _powerTimings.probeMs = now - _probeStart;
+  _powerTimings.totalMs = now - _powerUpStart;
+  setPowerPhase(ModemPowerPhase::Ready);
+
+  LOG_INFOLN(F("Modem ready after %u attempts in %lu ms (reset %lu, power key %lu, probe %lu)"),
+             _powerTimings.attempts,
+             _powerTimings.totalMs,
+             _powerTimings.resetMs,
+             _powerTimings.powerKeyMs,
+             _powerTimings.probeMs);
+
+  _waitingForKeepAlive = false;
+  _keepAliveSuspect = false;
+  _keepAliveIntervalMs = kKeepAliveMinIntervalMs;
+  _lastModemTraffic = now;
 
+  beginBatch();
   disableUnneededFeatures();
   enableHangUp();
+  endBatch();
+
   stopAllAudio();
 }
 
-void Modem::hardResetModem() {
-  pinMode(kModemResetPin, OUTPUT);
-  digitalWrite(kModemResetPin, !kModemResetLevel);
-  delay(kResetSettleMs);
-  digitalWrite(kModemResetPin, kModemResetLevel);
-  delay(kResetPullMs);
-  digitalWrite(kModemResetPin, !kModemResetLevel);
+// Whether the loop may sleep: nothing here needs attention sooner than a modem line would bring.
+bool Modem::isIdle() const {
+  return isReady() && !_audio.hasPending() && _spelledNumber[_spelledDigit] == '\0' &&
+         _enqueuedCall[0] == '\0' && !_announcementStreaming;
+}
+
+bool Modem::isReady() const {
+  return _powerPhase == ModemPowerPhase::Ready;
+}
 
-  pinMode(kBoardPowerKeyPin, OUTPUT);
-  digitalWrite(kBoardPowerKeyPin, LOW);
-  delay(kPwrKeyLowMs);
-  digitalWrite(kBoardPowerKeyPin, HIGH);
-  delay(kPwrKeyHighMs);
-  digitalWrite(kBoardPowerKeyPin, LOW);
+const ModemPowerTimings &Modem::getPowerTimings() const {
+  return _powerTimings;
 }
 
 void Modem::disableUnneededFeatures() {
@@ -179,14 +404,20 @@ void Modem::setMicGain(const int gain) {
 
 void Modem::setEarpieceVolume() {
   _volumeMode = VolumeMode::Earpiece;
+
+  beginBatch();
   setVolume(kEarpieceVolume);
   setMicGain(kEarpieceMicGain);
+  endBatch();
 }
 
 void Modem::setSpeakerVolume() {
   _volumeMode = VolumeMode::Speaker;
+
+  beginBatch();
   setVolume(kSpeakerVolume);
   setMicGain(kSpeakerMicGain);
+  endBatch();
 }
 
 void Modem::toggleVolume() {
@@ -199,36 +430,51 @@ void Modem::toggleVolume() {
 
 void Modem::enqueueCall(const char *number) {
   if (_enqueuedCall[0] != '\0') {
-    Logger::warnln(F("Call already enqueued!"));
+    LOG_WARNLN(F("Call already enqueued!"));
     return;
   }
 
-  snprintf(_enqueuedCall, kSmallBufferSize, "%s", number);
+  snprintf(_enqueuedCall, sizeof(_enqueuedCall), "%s", number);
 }
 
 void Modem::call(const char *number) {
-  Logger::infoln(F("Dialing number: %s"), number);
+  LOG_INFOLN(F("Dialing number: %s"), number);
 
-  _modemImpl.callNumber(number);
-  verifyCallState();
+  char dialCmd[kBigBufferSize];
+  snprintf(dialCmd, sizeof(dialCmd), "D%s;", number);
+  submitCommand(dialCmd, kDialTimeoutMs, &Modem::onCallCommandComplete);
 }
 
 void Modem::hangUp() {
-  Logger::infoln(F("Hanging up..."));
+  LOG_INFOLN(F("Hanging up..."));
 
-  _modemImpl.callHangup();
-  verifyCallState();
+  // A dial or answer that is still running would swallow the hang up, so cancel it first. A file
+  // write just has to finish.
+  const PendingCommand *running = runningBlockingCommand();
+
+  if (running != nullptr && running->onConnect == nullptr) {
+    abortPendingCommands();
+  }
+
+  submitCommand("H", kCommandTimeoutMs, &Modem::onCallCommandComplete);
 }
 
 void Modem::answer() {
-  Logger::infoln(F("Answering call..."));
+  LOG_INFOLN(F("Answering call..."));
+
+  submitCommand("A", kAnswerTimeoutMs, &Modem::onCallCommandComplete);
+}
+
+void Modem::onCallCommandComplete(const PendingCommand &command, const CommandResult result) {
+  if (result != CommandResult::Ok) {
+    LOG_WARNLN(F("Call command AT%s ended with %s"), command.text, commandResultToString(result));
+  }
 
-  _modemImpl.callAnswer();
   verifyCallState();
 }
 
 void Modem::switchToCallWaiting() {
-  Logger::infoln(F("Switching to call waiting..."));
+  LOG_INFOLN(F("Switching to call waiting..."));
 
   sendCommand(F("+CHLD=2"));
   verifyCallState();
@@ -239,266 +485,437 @@ void Modem::verifyCallState() {
 }
 
 bool Modem::messageAvailable() const {
-  return SerialAT.available() > 0;
-}
-
-bool Modem::isKnownMessage(const char *msg) const {
-  return std::any_of(knownMessages.begin(), knownMessages.end(), [msg](const char *known) {
-    return strEqual(msg, known);
-  });
+  return _lineAssembler.hasLine();
 }
 
-void Modem::deriveStateFromMessage(State &state) {
+bool Modem::deriveStateFromMessage(State &state) {
   state.prevAppState = state.newAppState;
-  state.lastModemMessage[0] = '\0';
-  state.messageHandled = true;
 
   if (!messageAvailable()) {
-    return;
+    return false;
   }
 
   char msg[kBigBufferSize];
-  readLineFromStream(SerialAT, msg, kBigBufferSize);
+  _lineAssembler.popLine(msg, sizeof(msg), &_lastLineMillis);
   strTrim(msg);
 
   if (msg[0] == '\0') {
-    return;
+    return true;
   }
 
-  if (strEqual(msg, "OK") && _waitingForKeepAlive) {
-    _waitingForKeepAlive = false;
-    Logger::infoln(F("Keep-alive received after %lu ms"), millis() - _lastKeepAliveSent);
+  // Any line at all proves the modem is alive, so the watchdog doesn't need to ask.
+  _lastModemTraffic = _lastLineMillis;
+
+  const UrcType type = classifyUrc(msg);
+
+  switch (type) {
+  case UrcType::Ok:
+    completePendingCommand(CommandResult::Ok);
+    break;
+  case UrcType::Error:
+    completePendingCommand(CommandResult::Error);
+    break;
+  case UrcType::CmeError:
+    completePendingCommand(CommandResult::CmeError);
+    break;
+  case UrcType::NoCarrier:
+    // A final result only for dial and answer, otherwise it's just the end-of-call URC.
+    if (!_pendingCommands.empty() && _pendingCommands[0].blocksWrites &&
+        _pendingCommands[0].onConnect == nullptr) {
+      completePendingCommand(CommandResult::Error);
+    }
+    return true;
+  case UrcType::Connect:
+    if (!_pendingCommands.empty() && _pendingCommands[0].sent &&
+        _pendingCommands[0].onConnect != nullptr) {
+      (this->*_pendingCommands[0].onConnect)(_pendingCommands[0]);
+    } else {
+      LOG_WARNLN(F("CONNECT without a data command"));
+    }
+    return true;
+  case UrcType::FileOpened:
+    _announcementFileHandle = atoi(msg + strlen("+FSOPEN: "));
+    return true;
+  case UrcType::Iccid:
+  case UrcType::SimStorage:
+  case UrcType::SimContact:
+    handleSimContactsMessage(msg, type);
+    return true;
+  case UrcType::SimState:
+    LOG_INFOLN(F("SIM state: %s"), msg);
+    onSimStateChanged();
+    return true;
+  default:
+    break;
   }
 
-  if (Modem::isKnownMessage(msg) || strStartsWith(msg, "VOICE CALL:") ||
-      strStartsWith(msg, "+CCWA")) {
-    return;
+  if (type == UrcType::Ignored) {
+    return true;
   }
 
-  snprintf(state.lastModemMessage, kBigBufferSize, "%s", msg);
+  LOG_INFOLN(F("Received from modem: %s"), msg);
 
-  Logger::infoln(F("Received from modem: %s"), msg);
+  bool handled = true;
 
+  switch (type) {
+  case UrcType::Ok:
+    if (state.prevAppState == AppState::CheckHardware) {
+      state.newAppState = AppState::CheckLine;
+    }
+    break;
+  case UrcType::Registration:
+    handled = handleRegistrationMessage(msg, state);
+    break;
+  case UrcType::CallList:
+    handled = handleCallListMessage(msg, state);
+    break;
+  case UrcType::Ring:
+    handleRingMessage(state);
+    break;
+  case UrcType::PhoneActivity:
+    handled = handlePhoneActivityMessage(msg, state);
+    break;
+  case UrcType::AudioPlaying:
+    LOG_INFOLN(F("Audio playing..."));
+    _audio.onPlaybackStarted(AudioType::Mp3);
+    break;
+  case UrcType::AudioStopped:
+    LOG_INFOLN(F("Audio stopped."));
+    onPlaybackStopped(AudioType::Mp3);
+    break;
+  case UrcType::ToneStopped:
+    LOG_INFOLN(F("Tone stopped."));
+    onPlaybackStopped(AudioType::Tone);
+    break;
+  case UrcType::AudioStateOther:
+  case UrcType::Error:
+  case UrcType::CmeError:
+    break;
+  default:
+    handled = false;
+    break;
+  }
+
+  if (!handled) {
+    LOG_INFOLN(F("Unknown message: %s"), msg);
+  }
+
+  return true;
+}
+
+bool Modem::handleRegistrationMessage(const char *msg, State &state) {
+  if (state.prevAppState != AppState::CheckLine) {
+    return false;
+  }
+
+  RegistrationStatus registration;
+  const AtParseResult result = parseRegistration(msg, registration);
+
+  if (result != AtParseResult::Ok) {
+    LOG_ERRORLN(F("Failed to parse registration (%s): %s"), atParseResultToString(result), msg);
+    return true;
+  }
+
+  // 0,1 means registered, home network
+  if (registration.mode == 0 && registration.isRegisteredHome()) {
+    state.newAppState = AppState::Idle;
+
+    // The modem was reset or lost the network, the SIM may not be the one that was synced.
+    onSimStateChanged();
+
+    // TODO: I didn't want to add side effects to this function, but this is kinda tame.
+    // The "correct" way would be to do this from the main loop - onStateIdle should do this
+    // if the previous state was AppState::CheckLine.
+    disableUnneededFeaturesAfterInit();
+  }
+
+  return true;
+}
+
+bool Modem::handleCallListMessage(const char *msg, State &state) {
   const AppState prevAppState = state.prevAppState;
+
+  if (prevAppState != AppState::Idle && prevAppState != AppState::IncomingCall &&
+      prevAppState != AppState::IncomingCallRing && prevAppState != AppState::InCall &&
+      prevAppState != AppState::Dialing) {
+    return false;
+  }
+
   CallState &callState = state.callState;
 
-  if (strEqual(msg, "OK") && prevAppState == AppState::CheckHardware) {
-    state.newAppState = AppState::CheckLine;
-  } else if (strStartsWith(msg, "+CGREG") && prevAppState == AppState::CheckLine) {
-    int status = -1;
-    int n = -1;
+  ClccRecord call;
+  const AtParseResult result = parseClcc(msg, call);
+
+  if (result != AtParseResult::Ok) {
+    LOG_ERRORLN(F("Failed to parse call list (%s): %s"), atParseResultToString(result), msg);
+    return true;
+  }
 
-    sscanf(msg, "+CGREG: %d,%d", &status, &n);
+  LOG_DEBUGLN(F("Call ID: %d, Call Direction: %d, Call Status: %d, Call Mode: %d, "
+                "Call Mpty: %d, Call Number: %s"),
+              call.id,
+              call.direction,
+              call.status,
+              call.mode,
+              call.mpty,
+              call.number);
+
+  const int callId = call.id;
+  const char *callNumber = call.number;
+
+  switch (call.status) {
+  case 0:
+    // Active
+    state.newAppState = AppState::InCall;
+    callState.setcallNumber(callNumber);
+    callState.callId = callId;
+    break;
+  case 1:
+    // Held
+    callState.isCallWaitingOnHold = true;
+    callState.callWaitingId = callId;
+    break;
+  case 2:
+    // Dialing
+    state.newAppState = AppState::Dialing;
+    break;
+  case 3:
+    // Alerting (other party needs to pick up)
+    break;
+  case 4:
+    // Incoming (doesn't include call waiting)
+    state.newAppState = AppState::IncomingCall;
+    callState.setcallNumber(callNumber);
+    callState.callId = callId;
+    break;
+  case 5:
+    // Waiting
+    callState.callWaitingId = callId;
+    break;
+  case 6:
+    // Since at least one party dropped, reset the call waiting tone state.
+    callState.playedCallWaitingTone = false;
 
-    // 0,1 means registered, home network
-    if (status == 0 && n == 1) {
-      state.newAppState = AppState::Idle;
+    // Disconnected (by the other party)
+    // TODO: I have chosen not to handle the very rare case of having the other party disconnect
+    // the incoming call, all the while there's a call waiting (not on hold).
+    if (callState.callId == callId) {
+      LOG_INFOLN(F("Current call %d was disconnected by the other party."), callId);
+
+      if (callState.isCallWaitingOnHold) {
+        LOG_INFOLN(F("Switching to call waiting %d..."), callState.callWaitingId);
 
-      // TODO: I didn't want to add side effects to this function, but this is kinda tame.
-      // The "correct" way would be to do this from the main loop - onStateIdle should do this
-      // if the previous state was AppState::CheckLine.
-      disableUnneededFeaturesAfterInit();
-    }
-  } else if (strStartsWith(msg, "+CLCC") &&
-             (prevAppState == AppState::Idle || prevAppState == AppState::IncomingCall ||
-              prevAppState == AppState::IncomingCallRing || prevAppState == AppState::InCall ||
-              prevAppState == AppState::Dialing)) {
-    int callId = -1;
-    int callDirection = -1;
-    int callStatus = -1;
-    int callMode = -1;
-    int callMpty = -1;
-    char callNumber[kSmallBufferSize] = {0};
-
-    sscanf(msg,
-           "+CLCC: %d,%d,%d,%d,%d,\"%31[^\"]\"",
-           &callId,
-           &callDirection,
-           &callStatus,
-           &callMode,
-           &callMpty,
-           callNumber);
-
-    char buffer[kBigBufferSize];
-
-    snprintf(buffer,
-             sizeof(buffer),
-             "Call ID: %d, Call Direction: %d, Call Status: %d, Call Mode: %d, "
-             "Call Mpty: %d, Call Number: %s",
-             callId,
-             callDirection,
-             callStatus,
-             callMode,
-             callMpty,
-             callNumber);
-
-    Logger::infoln(buffer);
-
-    switch (callStatus) {
-    case 0:
-      // Active
-      state.newAppState = AppState::InCall;
-      callState.setcallNumber(callNumber);
-      callState.callId = callId;
-      break;
-    case 1:
-      // Held
-      callState.isCallWaitingOnHold = true;
-      callState.callWaitingId = callId;
-      break;
-    case 2:
-      // Dialing
-      state.newAppState = AppState::Dialing;
-      break;
-    case 3:
-      // Alerting (other party needs to pick up)
-      break;
-    case 4:
-      // Incoming (doesn't include call waiting)
-      state.newAppState = AppState::IncomingCall;
-      callState.setcallNumber(callNumber);
-      callState.callId = callId;
-      break;
-    case 5:
-      // Waiting
-      callState.callWaitingId = callId;
-      break;
-    case 6:
-      // Since at least one party dropped, reset the call waiting tone state.
-      callState.playedCallWaitingTone = false;
-
-      // Disconnected (by the other party)
-      // TODO: I have chosen not to handle the very rare case of having the other party disconnect
-      // the incoming call, all the while there's a call waiting (not on hold).
-      if (callState.callId == callId) {
-        Logger::infoln(F("Current call %d was disconnected by the other party."), callId);
-
-        if (callState.isCallWaitingOnHold) {
-          Logger::infoln(F("Switching to call waiting %d..."), callState.callWaitingId);
-
-          callState.isCallWaitingOnHold = false;
-          callState.callId = callState.callWaitingId;
-          callState.callWaitingId = -1;
-          switchToCallWaiting();
-        } else {
-          state.newAppState = AppState::Idle;
-          state.callState = CallState{};
-          state.callState.otherPartyDropped = prevAppState == AppState::InCall;
-        }
-      } else if (callState.callWaitingId == callId) {
-        Logger::infoln(F("Call waiting %d was disconnected by the other party."), callId);
-        callState.callWaitingId = -1;
         callState.isCallWaitingOnHold = false;
+        callState.callId = callState.callWaitingId;
+        callState.callWaitingId = -1;
+        switchToCallWaiting();
       } else {
         state.newAppState = AppState::Idle;
         state.callState = CallState{};
-        Logger::warnln(F("Unknown call %d was disconnected by the other party."), callId);
+        state.callState.otherPartyDropped = prevAppState == AppState::InCall;
       }
-      break;
-    default:
-      Logger::warnln(F("Unknown call status: %d"), callStatus);
-      break;
-    }
-  } else if (strStartsWith(msg, "RING")) {
-    if ((prevAppState == AppState::IncomingCall || prevAppState == AppState::Idle)) {
-      state.newAppState = AppState::IncomingCallRing;
-    } else if (prevAppState == AppState::IncomingCallRing) {
-      state.newAppState = AppState::IncomingCall;
+    } else if (callState.callWaitingId == callId) {
+      LOG_INFOLN(F("Call waiting %d was disconnected by the other party."), callId);
+      callState.callWaitingId = -1;
+      callState.isCallWaitingOnHold = false;
+    } else {
+      state.newAppState = AppState::Idle;
+      state.callState = CallState{};
+      LOG_WARNLN(F("Unknown call %d was disconnected by the other party."), callId);
     }
-  } else if (strStartsWith(msg, "+CPAS") &&
-             (prevAppState == AppState::IncomingCallRing ||
-              prevAppState == AppState::IncomingCall || prevAppState == AppState::InCall ||
-              prevAppState == AppState::Dialing)) {
-    int callStatus = -1;
+    break;
+  default:
+    LOG_WARNLN(F("Unknown call status: %d"), call.status);
+    break;
+  }
 
-    sscanf(msg, "+CPAS: %d", &callStatus);
+  return true;
+}
 
-    Logger::infoln(F("Call Status: %d"), callStatus);
+void Modem::handleRingMessage(State &state) {
+  const AppState prevAppState = state.prevAppState;
 
-    switch (callStatus) {
-    case 0:
-      // Ready
-      state.newAppState = AppState::Idle;
-      state.callState = CallState{};
-      break;
-    case 3:
-      // Ringing
-      break;
-    case 4:
-      // Call in progress
-      state.newAppState = AppState::InCall;
-      break;
-    default:
-      Logger::warnln(F("Unknown call status: %d"), callStatus);
-      break;
-    }
-  } else {
-    state.messageHandled = false;
+  if ((prevAppState == AppState::IncomingCall || prevAppState == AppState::Idle)) {
+    state.newAppState = AppState::IncomingCallRing;
+  } else if (prevAppState == AppState::IncomingCallRing) {
+    state.newAppState = AppState::IncomingCall;
+  }
+}
+
+bool Modem::handlePhoneActivityMessage(const char *msg, State &state) {
+  const AppState prevAppState = state.prevAppState;
+
+  if (prevAppState != AppState::IncomingCallRing && prevAppState != AppState::IncomingCall &&
+      prevAppState != AppState::InCall && prevAppState != AppState::Dialing) {
+    return false;
+  }
+
+  CpasStatus status;
+  const AtParseResult result = parseCpas(msg, status);
+
+  if (result == AtParseResult::Unsupported) {
+    LOG_WARNLN(F("Unknown call status: %s"), msg);
+    return true;
+  }
+
+  if (result != AtParseResult::Ok) {
+    LOG_ERRORLN(F("Failed to parse phone activity (%s): %s"), atParseResultToString(result), msg);
+    return true;
+  }
+
+  LOG_INFOLN(F("Call Status: %d"), static_cast<int>(status));
+
+  switch (status) {
+  case CpasStatus::Ready:
+    state.newAppState = AppState::Idle;
+    state.callState = CallState{};
+    break;
+  case CpasStatus::Ringing:
+    break;
+  case CpasStatus::CallInProgress:
+    state.newAppState = AppState::InCall;
+    break;
+  default:
+    LOG_WARNLN(F("Unknown call status: %d"), static_cast<int>(status));
+    break;
   }
+
+  return true;
 }
 
-void Modem::process(const State &state) {
+void Modem::process() {
+  expirePendingCommands();
+  processPowerUp();
+
+  if (!isReady()) {
+    return;
+  }
+
+  if (_announcementStreaming) {
+    streamAnnouncement();
+  }
+
   playNextAudioItem();
   callPending();
 
   // TODO: Maybe only call this when state is after AppState::CheckLine.
   keepAliveWatchdog();
+}
+
+const KeepAliveStats &Modem::getKeepAliveStats() const {
+  return _keepAliveStats;
+}
 
-  if (state.messageHandled || state.lastModemMessage[0] == '\0') {
+// Probes only after the modem has been silent for the current interval. A dial or answer has its
+// own timeout, and a probe couldn't be written while it runs anyway.
+void Modem::keepAliveWatchdog() {
+  if (_waitingForKeepAlive || runningBlockingCommand() != nullptr) {
     return;
   }
 
-  if (strStartsWith(state.lastModemMessage, "+AUDIOSTATE: ")) {
-    if (strEqual(state.lastModemMessage, "+AUDIOSTATE: audio play stop")) {
-      Logger::infoln(F("Audio stopped."));
-      _isPlayingAudio = false;
-      _lastAudioStopMillis = millis();
-    } else if (strEqual(state.lastModemMessage, "+AUDIOSTATE: audio play")) {
-      Logger::infoln(F("Audio playing..."));
-      _isPlayingAudio = true;
-    }
-  } else if (strEqual(state.lastModemMessage, "+STTONE: 0")) {
-    Logger::infoln(F("Tone stopped."));
-    _isPlayingAudio = false;
-    _lastAudioStopMillis = millis();
-  } else {
-    if (!strEqual(state.lastModemMessage, "OK")) {
-      Logger::infoln(F("Unknown message: %s"), state.lastModemMessage);
-    }
+  if (millis() - _lastModemTraffic >= _keepAliveIntervalMs) {
+    sendKeepAlive(kKeepAliveTimeoutMs);
   }
 }
 
-void Modem::keepAliveWatchdog() {
-  uint32_t now = millis();
-  uint32_t timeSinceLastKeepAlive = now - _lastKeepAliveSent;
+void Modem::sendKeepAlive(const uint32_t timeoutMs) {
+  LOG_INFOLN(F("Sending keep-alive after %lu ms of silence. (Watchdog resets so far: %lu)"),
+             millis() - _lastModemTraffic,
+             _keepAliveStats.hardResets);
 
-  if (_waitingForKeepAlive) {
-    if (timeSinceLastKeepAlive > kKeepAliveTimeoutMs) {
-      Logger::warnln(F("No keep-alive response, resetting modem..."));
-      reset();
-    }
+  if (submitCommand("", timeoutMs, &Modem::onKeepAliveComplete)) {
+    _waitingForKeepAlive = true;
+    ++_keepAliveStats.probes;
+  }
+}
+
+void Modem::onKeepAliveComplete(const PendingCommand &command, const CommandResult result) {
+  _waitingForKeepAlive = false;
+
+  switch (result) {
+  case CommandResult::Ok:
+  case CommandResult::Error:
+  case CommandResult::CmeError:
+    onKeepAliveAnswered(_lastLineMillis - command.sentMillis);
+    break;
+  case CommandResult::Timeout:
+    onKeepAliveMissed(command);
+    break;
+  default:
+    break;
+  }
+}
+
+void Modem::onKeepAliveAnswered(const uint32_t roundTripMs) {
+  _keepAliveStats.roundTrip.record(roundTripMs);
+
+  if (_keepAliveSuspect) {
+    LOG_INFOLN(F("Modem answered the second keep-alive after %lu ms"), roundTripMs);
+    ++_keepAliveStats.softRecoveries;
+    _keepAliveSuspect = false;
+    _keepAliveIntervalMs = kKeepAliveMinIntervalMs;
   } else {
-    if (timeSinceLastKeepAlive >= kKeepAliveIntervalMs) {
-      sendKeepAlive();
-      _lastKeepAliveSent = now;
-      _waitingForKeepAlive = true;
-    }
+    LOG_INFOLN(F("Keep-alive received after %lu ms"), roundTripMs);
+    _keepAliveIntervalMs = std::min(_keepAliveIntervalMs * 2, kKeepAliveMaxIntervalMs);
+  }
+
+  if (_keepAliveStats.roundTrip.count() % kKeepAliveStatsLogInterval == 0) {
+    logKeepAliveStats();
+  }
+}
+
+// Escalates softly first: a single lost OK must not cost a full power cycle.
+void Modem::onKeepAliveMissed(const PendingCommand &command) {
+  _keepAliveIntervalMs = kKeepAliveMinIntervalMs;
+
+  if (static_cast<int32_t>(_lastModemTraffic - command.sentMillis) >= 0) {
+    LOG_WARNLN(F("Keep-alive missed, but the modem has been talking since - ignoring"));
+    return;
+  }
+
+  // A dial, answer or data command went out behind the probe. The CR would cancel the first two, or
+  // be written to the file as data. They time out on their own, and the watchdog probes after.
+  if (runningBlockingCommand() != nullptr) {
+    LOG_WARNLN(F("Keep-alive missed while a blocking command runs - not probing again"));
+    return;
+  }
+
+  if (!_keepAliveSuspect) {
+    LOG_WARNLN(F("Keep-alive missed, probing again..."));
+    ++_keepAliveStats.softEscalations;
+    _keepAliveSuspect = true;
+
+    // Clears whatever partial command line the modem may be holding before asking again.
+    SerialAT.write('\r');
+    sendKeepAlive(kKeepAliveSoftTimeoutMs);
+    return;
   }
+
+  _keepAliveSuspect = false;
+  reset();
 }
 
-void Modem::sendKeepAlive() {
-  Logger::infoln(F("Sending keep-alive. (Watchdog resets so far: %lu)"), _watchdogResetCounter);
-  _modemImpl.sendAT("");
+void Modem::logKeepAliveStats() const {
+  [[maybe_unused]] const Histogram<kKeepAliveHistogramBuckets> &roundTrip =
+      _keepAliveStats.roundTrip;
+
+  LOG_INFOLN(F("Keep-alive: %lu probes, %lu soft escalations, %lu recovered, %lu resets"),
+             _keepAliveStats.probes,
+             _keepAliveStats.softEscalations,
+             _keepAliveStats.softRecoveries,
+             _keepAliveStats.hardResets);
+  LOG_INFOLN(F("Keep-alive RTT ms: min %lu, p50 %lu, p90 %lu, p99 %lu, max %lu"),
+             roundTrip.smallest(),
+             roundTrip.percentile(50),
+             roundTrip.percentile(90),
+             roundTrip.percentile(99),
+             roundTrip.largest());
 }
 
 void Modem::reset() {
-  Logger::warnln(F("No keep-alive - resetting modem (%lu)..."), ++_watchdogResetCounter);
-
-  initModem();
-  _waitingForKeepAlive = false;
-  _lastKeepAliveSent = millis();
+  LOG_WARNLN(F("No keep-alive - resetting modem (%lu)..."), ++_keepAliveStats.hardResets);
 
-  Logger::warnln(F("Modem has been reset via keep-alive watchdog."));
+  startPowerUp();
 }
 
 template <typename... Args>
@@ -509,115 +926,996 @@ inline void Modem::sendCommand(const __FlashStringHelper *command, Args... args)
 }
 
 void Modem::sendCommand(const StringSumHelper &command) {
-  Logger::infoln(F("Sending command: AT%s"), command.c_str());
-  _modemImpl.sendAT(command);
+  sendCommand(command.c_str());
 }
 
 void Modem::sendCommand(const __FlashStringHelper *command) {
-  Logger::infoln(F("Sending command: AT%s"), command);
-  _modemImpl.sendAT(command);
+  sendCommand(reinterpret_cast<PGM_P>(command));
 }
 
 void Modem::sendCommand(const char *command) {
-  Logger::infoln(F("Sending command: AT%s"), command);
-  _modemImpl.sendAT(command);
-}
-
-void Modem::sendCheckHardwareCommand() {
-  sendCommand(F(""));
-}
-
-void Modem::sendCheckLineCommand() {
-  sendCommand(F("+CGREG?"));
-}
+  if (_batchDepth > 0 && appendToBatch(command)) {
+    return;
+  }
 
-void Modem::enqueueTone(const Tone toneId, const int duration) {
-  AudioItem item{AudioType::Tone, toneId, duration, nullptr, 0};
-  _audioQueue.push(item);
+  submitCommand(command, kCommandTimeoutMs);
 }
 
-void Modem::stopTone() {
-  sendCommand(F("+STTONE=0"));
-}
+bool Modem::submitCommand(const char *command,
+                          const uint32_t timeoutMs,
+                          const CommandCallback onComplete,
+                          const DataCallback onConnect) {
+  // Until the modem answers its probe, nothing but the probe itself may be written.
+  if (!isReady()) {
+    LOG_DEBUGLN(F("Modem not ready, dropping: AT%s"), command);
+    return false;
+  }
 
-void Modem::enqueueMp3(const char *file, const int repeat) {
-  AudioItem item{AudioType::Mp3, Tone::DialTone, 0, file, repeat};
-  _audioQueue.push(item);
+  return queueCommand(command, timeoutMs, onComplete, onConnect);
 }
 
-void Modem::stopMp3() {
-  sendCommand(F("+CCMXSTOP"));
-}
+bool Modem::queueCommand(const char *command,
+                         const uint32_t timeoutMs,
+                         const CommandCallback onComplete,
+                         const DataCallback onConnect) {
+  if (_pendingCommands.full()) {
+    LOG_ERRORLN(F("Command queue full, dropping: AT%s"), command);
+    return false;
+  }
 
-void Modem::stopAllAudio() {
-  _audioQueue.clear();
-  stopTone();
-  stopMp3();
-  _isPlayingAudio = false;
-  _lastAudioStopMillis = 0UL;
+  PendingCommand pending;
+  snprintf(pending.text, sizeof(pending.text), "%s", command);
+  pending.sentMillis = 0UL;
+  pending.timeoutMs = timeoutMs;
+  pending.onComplete = onComplete;
+  pending.onConnect = onConnect;
+  pending.batchSize = 0;
+  pending.audio = {};
+  pending.sent = false;
+  pending.aborted = false;
+  pending.blocksWrites = command[0] == 'D' || strEqual(command, "A") || onConnect != nullptr;
+
+  _pendingCommands.push(pending);
+  flushPendingCommands();
+
+  return true;
 }
 
-void Modem::playTone(const Tone toneId, const int duration) {
-  // We set this right away so the next item won't start
-  _isPlayingAudio = true;
-  sendCommand(F("+STTONE=1,%d,%d"), toneId, duration);
-}
+void Modem::flushPendingCommands() {
+  // Aborted commands that were never written have nothing to wait for.
+  while (!_pendingCommands.empty() && _pendingCommands[0].aborted && !_pendingCommands[0].sent) {
+    _pendingCommands.pop();
+  }
 
-void Modem::playMp3(const char *fileName, const int repeat) {
-  // We set this right away so the next item won't start
-  _isPlayingAudio = true;
+  for (size_t i = 0; i < _pendingCommands.size(); i++) {
+    PendingCommand &pending = _pendingCommands[i];
 
-  Logger::infoln(F("Playing MP3: %s"), fileName);
+    if (pending.aborted && !pending.sent) {
+      continue;
+    }
 
-  if (fileName != nullptr) {
-    char playCmd[kBigBufferSize];
-    snprintf(playCmd, sizeof(playCmd), "+CCMXPLAY=\"%s/%s\",0,%d", kMp3Dir, fileName, repeat);
-    sendCommand(playCmd);
+    if (!pending.sent) {
+      LOG_INFOLN(F("Sending command: AT%s"), pending.text);
+      _modemImpl.sendAT(pending.text);
+      pending.sent = true;
+      pending.sentMillis = millis();
+    }
 
-    Logger::infoln(F("Playing MP3: %s success!"), fileName);
+    if (pending.blocksWrites && !pending.aborted) {
+      break;
+    }
+  }
+}
+
+void Modem::completePendingCommand(const CommandResult result) {
+  if (_pendingCommands.empty()) {
+    LOG_DEBUGLN(F("Final result %s without a pending command"), commandResultToString(result));
+
+    return;
+  }
+
+  // The modem answers strictly in order, so the oldest command is the one that just finished.
+  const PendingCommand completed = _pendingCommands.pop();
+
+  if (result != CommandResult::Ok && !completed.aborted) {
+    LOG_WARNLN(F("Command AT%s failed: %s"), completed.text, commandResultToString(result));
+  }
+
+  recordCommandLatency(completed, result);
+
+  if (completed.onComplete != nullptr) {
+    (this->*completed.onComplete)(completed, result);
+  }
+
+  flushPendingCommands();
+}
+
+// A command that timed out gets its callback right away, but stays queued without one for a grace
+// period, like an aborted command: the modem may still send its result, and that must not be
+// matched to a newer command.
+void Modem::expirePendingCommands() {
+  bool changed = false;
+
+  for (size_t i = 0; i < _pendingCommands.size(); i++) {
+    PendingCommand &pending = _pendingCommands[i];
+
+    if (!pending.sent || pending.aborted || millis() - pending.sentMillis < pending.timeoutMs) {
+      continue;
+    }
+
+    const PendingCommand expired = pending;
+
+    pending.aborted = true;
+    pending.onComplete = nullptr;
+    pending.sentMillis = millis();
+    pending.timeoutMs = kCommandTimeoutMs;
+    changed = true;
+
+    LOG_WARNLN(F("Command AT%s failed: %s"),
+               expired.text,
+               commandResultToString(CommandResult::Timeout));
+    recordCommandLatency(expired, CommandResult::Timeout);
+
+    // May queue new commands, or fail all of them.
+    if (expired.onComplete != nullptr) {
+      (this->*expired.onComplete)(expired, CommandResult::Timeout);
+    }
+  }
+
+  // Results come in order, so only the oldest tombstone can be given up on.
+  while (!_pendingCommands.empty()) {
+    const PendingCommand &oldest = _pendingCommands[0];
+
+    if (!oldest.aborted || !oldest.sent || millis() - oldest.sentMillis < oldest.timeoutMs) {
+      break;
+    }
+
+    _pendingCommands.pop();
+    changed = true;
+  }
+
+  // A command that blocked writes doesn't anymore.
+  if (changed) {
+    flushPendingCommands();
+  }
+}
+
+void Modem::failPendingCommands(const CommandResult result) {
+  while (!_pendingCommands.empty()) {
+    const PendingCommand failed = _pendingCommands.pop();
+
+    if (failed.onComplete != nullptr) {
+      (this->*failed.onComplete)(failed, result);
+    }
+  }
+}
+
+// Measured up to when the final result line was read off the UART, not when the loop got to it.
+void Modem::recordCommandLatency(const PendingCommand &command, const CommandResult result) {
+  if (!command.sent || command.aborted) {
+    return;
+  }
+
+  CommandLatencyStats &stats = _commandLatencies[static_cast<size_t>(classifyCommand(command))];
+
+  if (result == CommandResult::Timeout) {
+    ++stats.timeouts;
+    return;
+  }
+
+  if (result != CommandResult::Ok) {
+    ++stats.failures;
+  }
+
+  stats.latency.record(_lastLineMillis - command.sentMillis);
+}
+
+const CommandLatencyStats &Modem::getCommandLatencyStats(const CommandClass commandClass) const {
+  return _commandLatencies[static_cast<size_t>(commandClass)];
+}
+
+void Modem::logStats() const {
+  LOG_INFOLN(F("Modem power-up: %u attempts, %lu ms"),
+             _powerTimings.attempts,
+             _powerTimings.totalMs);
+  LOG_INFOLN(F("Batches: %lu, %lu commands, %lu round trips saved, %lu failed"),
+             _batchStats.batches,
+             _batchStats.batchedCommands,
+             _batchStats.roundTripsSaved,
+             _batchStats.failedBatches);
+
+  LOG_INFOLN(F("SIM contacts: %u cached"), static_cast<unsigned>(_simContacts.size()));
+
+  logKeepAliveStats();
+  logAudioTransitionStats();
+
+  LOG_INFOLN(F("Command latency ms (count, p50, p90, p99, max, failed, timed out):"));
+
+  for (size_t i = 0; i < kCommandClassCount; i++) {
+    const CommandLatencyStats &stats = _commandLatencies[i];
+    const Histogram<kCommandHistogramBuckets> &latency = stats.latency;
+
+    if (latency.count() == 0 && stats.timeouts == 0) {
+      continue;
+    }
+
+    LOG_INFOLN(F("  %-8s %5lu %5lu %5lu %5lu %5lu %3lu %3lu"),
+               commandClassToString(static_cast<CommandClass>(i)),
+               latency.count(),
+               latency.percentile(50),
+               latency.percentile(90),
+               latency.percentile(99),
+               latency.largest(),
+               stats.failures,
+               stats.timeouts);
+  }
+}
+
+// The written command that holds back the ones after it, or nullptr. It isn't always the oldest:
+// commands that timed out or were aborted stay queued ahead of it until their results come in.
+const PendingCommand *Modem::runningBlockingCommand() const {
+  for (size_t i = 0; i < _pendingCommands.size(); i++) {
+    const PendingCommand &pending = _pendingCommands[i];
+
+    if (pending.sent && pending.blocksWrites && !pending.aborted) {
+      return &pending;
+    }
+  }
+
+  return nullptr;
+}
+
+void Modem::abortPendingCommands() {
+  if (_pendingCommands.empty()) {
+    return;
+  }
+
+  LOG_WARNLN(F("Aborting %u pending commands"), _pendingCommands.size());
+
+  // Any character cancels a running dial or answer (ITU-T V.250 5.6.1). A data command can't be
+  // cancelled that way, it would just take the character as data.
+  const PendingCommand *running = runningBlockingCommand();
+
+  if (running != nullptr && running->onConnect == nullptr) {
+    SerialAT.write('\r');
+  }
+
+  // Commands that were already written stay queued without a callback, so that the results the
+  // modem still owes for them don't get matched to newer commands. Unsent ones are never written.
+  const size_t count = _pendingCommands.size();
+
+  for (size_t i = 0; i < count; i++) {
+    PendingCommand &pending = _pendingCommands[i];
+    const PendingCommand aborted = pending;
+
+    pending.aborted = true;
+    pending.onComplete = nullptr;
+    pending.sentMillis = millis();
+    pending.timeoutMs = kCommandTimeoutMs;
+
+    if (aborted.onComplete != nullptr) {
+      (this->*aborted.onComplete)(aborted, CommandResult::Aborted);
+    }
+  }
+}
+
+void Modem::beginBatch() {
+  if (_batchDepth++ == 0) {
+    _batch.text[0] = '\0';
+    _batch.batchSize = 0;
+  }
+}
+
+void Modem::endBatch() {
+  if (_batchDepth == 0 || --_batchDepth > 0) {
+    return;
+  }
+
+  submitBatch();
+}
+
+// Sub-commands are chained per ITU-T V.250 5.2.1: basic commands (E0, &D0) follow each other
+// directly, and a ';' is only needed after an extended (+) command.
+bool Modem::appendToBatch(const char *command) {
+  // Call control and bare probes need their own result, and can't share a command line.
+  if (command[0] == '\0' || command[0] == 'D' || command[0] == 'A' || command[0] == 'H') {
+    submitBatch();
+    return false;
+  }
+
+  if (_batch.batchSize == kMaxBatchedCommands ||
+      strlen(_batch.text) + 1 + strlen(command) >= sizeof(_batch.text)) {
+    submitBatch();
+  }
+
+  size_t len = strlen(_batch.text);
+
+  if (_batch.batchSize > 0 && _batch.text[_batch.batchOffsets[_batch.batchSize - 1]] == '+') {
+    _batch.text[len++] = ';';
+  }
+
+  _batch.batchOffsets[_batch.batchSize++] = static_cast<uint8_t>(len);
+  snprintf(_batch.text + len, sizeof(_batch.text) - len, "%s", command);
+
+  return true;
+}
+
+void Modem::submitBatch() {
+  const uint8_t batchSize = _batch.batchSize;
+
+  if (batchSize == 0) {
+    return;
+  }
+
+  _batch.batchSize = 0;
+
+  if (batchSize == 1) {
+    submitCommand(_batch.text, kCommandTimeoutMs);
+    _batch.text[0] = '\0';
+    return;
+  }
+
+  ++_batchStats.batches;
+  _batchStats.batchedCommands += batchSize;
+  _batchStats.roundTripsSaved += batchSize - 1;
+
+  LOG_INFOLN(F("Batching %u commands, saved %u round trips (%lu so far)"),
+             batchSize,
+             batchSize - 1,
+             _batchStats.roundTripsSaved);
+
+  // submitCommand copies the text only, so the offsets are patched into the queued entry.
+  if (submitCommand(_batch.text, kCommandTimeoutMs, &Modem::onBatchComplete)) {
+    PendingCommand &queued = _pendingCommands[_pendingCommands.size() - 1];
+    memcpy(queued.batchOffsets, _batch.batchOffsets, sizeof(queued.batchOffsets));
+    queued.batchSize = batchSize;
+  }
+
+  _batch.text[0] = '\0';
+}
+
+void Modem::onBatchComplete(const PendingCommand &command, const CommandResult result) {
+  if (result != CommandResult::Error && result != CommandResult::CmeError) {
+    return;
+  }
+
+  // The modem stops at the first failing sub-command without saying which one it was, so each one
+  // is retried on its own to attribute the error. They are all idempotent settings.
+  ++_batchStats.failedBatches;
+
+  LOG_WARNLN(F("Batch failed, retrying its %u commands one by one (%lu failed batches)"),
+             command.batchSize,
+             _batchStats.failedBatches);
+
+  for (uint8_t i = 0; i < command.batchSize; i++) {
+    const uint8_t start = command.batchOffsets[i];
+    const size_t end =
+        i + 1 < command.batchSize ? command.batchOffsets[i + 1] : strlen(command.text);
+
+    char subCommand[kBigBufferSize];
+    snprintf(subCommand,
+             sizeof(subCommand),
+             "%.*s",
+             static_cast<int>(end - start),
+             command.text + start);
+
+    const size_t subLen = strlen(subCommand);
+
+    if (subLen > 0 && subCommand[subLen - 1] == ';') {
+      subCommand[subLen - 1] = '\0';
+    }
+
+    submitCommand(subCommand, kCommandTimeoutMs);
+  }
+}
+
+void Modem::sendCheckHardwareCommand() {
+  sendCommand(F(""));
+}
+
+void Modem::sendCheckLineCommand() {
+  sendCommand(F("+CGREG?"));
+}
+
+void Modem::enqueueTone(const Tone toneId, const int duration, const AudioTag tag) {
+  _audio.enqueue({AudioType::Tone, toneId, duration, nullptr, 0, tag});
+}
+
+void Modem::enqueueMp3(const char *file, const AudioTag tag, const int repeat) {
+  if (file == nullptr) {
+    LOG_ERRORLN(F("Error: MP3File has a null fileName!"));
+    return;
+  }
+
+  _audio.enqueue({AudioType::Mp3, Tone::DialTone, 0, file, repeat, tag});
+}
+
+void Modem::cancelAudio(const AudioTag tag) {
+  if (tag == AudioTag::CallerDigits) {
+    stopSpelling();
+  }
+
+  if (_audio.cancel(tag)) {
+    stopPlayback(_audio.current().type);
+  }
+}
+
+void Modem::stopAllAudio() {
+  stopSpelling();
+  _audio.cancelAll();
+  stopTone();
+  stopMp3();
+  _lastAudioStopMillis = 0UL;
+}
+
+bool Modem::popAudioEvent(AudioEvent &event) {
+  return _audio.popEvent(event);
+}
+
+void Modem::stopTone() {
+  sendCommand(F("+STTONE=0"));
+}
+
+void Modem::stopMp3() {
+  sendCommand(F("+CCMXSTOP"));
+}
+
+void Modem::stopPlayback(const AudioType type) {
+  _lastStoppedAudioType = type;
+
+  if (type == AudioType::Tone) {
+    stopTone();
   } else {
-    Logger::errorln(F("Error: MP3File has a null fileName!"));
-    _isPlayingAudio = false;
+    stopMp3();
   }
+
+  _lastAudioStopMillis = millis();
+}
+
+// The stop report of a clip we cut short may still be on its way when the next one starts, the
+// scheduler tells it apart from the one that ends the playing clip.
+void Modem::onPlaybackStopped(const AudioType type) {
+  _lastAudioStopMillis = millis();
+  _lastStoppedAudioType = type;
+  _audio.onPlaybackStopped(type);
+}
+
+void Modem::playTone(const Tone toneId, const int duration, const AudioPlayContext &context) {
+  char playCmd[kMediumBufferSize];
+  snprintf(playCmd, sizeof(playCmd), "+STTONE=1,%d,%d", static_cast<int>(toneId), duration);
+  submitPlayCommand(playCmd, context);
 }
 
-bool Modem::hasAudioToPlay() {
-  return !_audioQueue.empty();
+void Modem::playMp3(const char *fileName, const int repeat, const AudioPlayContext &context) {
+  LOG_INFOLN(F("Playing MP3: %s"), fileName);
+
+  char playCmd[kBigBufferSize];
+  snprintf(playCmd, sizeof(playCmd), "+CCMXPLAY=\"%s/%s\",0,%d", kMp3Dir, fileName, repeat);
+  submitPlayCommand(playCmd, context);
+}
+
+// A play command's result may come in after the next one was sent, so each keeps its own context.
+void Modem::submitPlayCommand(const char *command, const AudioPlayContext &context) {
+  // submitCommand copies the text only, so the context is patched into the queued entry.
+  if (submitCommand(command, kCommandTimeoutMs, &Modem::onPlayCommandComplete)) {
+    _pendingCommands[_pendingCommands.size() - 1].audio = context;
+  }
 }
 
 void Modem::playNextAudioItem() {
-  if (_isPlayingAudio) {
-    return;
+  spellNextDigit();
+
+  if (_audio.shouldPreempt()) {
+    LOG_INFOLN(F("Preempting %s"), audioTagToString(_audio.current().tag));
+    _audio.preempt();
+    stopPlayback(_audio.current().type);
   }
 
-  if (!hasAudioToPlay()) {
+  if (_audio.isPlaying() || !_audio.hasPending()) {
     return;
   }
 
-  // Wait a bit between audio plays to prevent conflicts
-  if (millis() - _lastAudioStopMillis < kIntervalBetweenAudioPlaysMillis) {
+  const AudioType nextType = _audio.peekNext()->type;
+  const uint32_t gap = millis() - _lastAudioStopMillis;
+
+  // Wait as long as this kind of transition has proven to need, and not longer.
+  if (gap < getAudioTransition(_lastStoppedAudioType, nextType).gapMs) {
     return;
   }
 
-  const AudioItem &nextItem = _audioQueue.front();
+  const AudioItem &nextItem = _audio.start();
+
+  if (nextItem.id != _playingAudioId) {
+    _audioPlayRetries = 0;
+  }
+
+  _playingAudioId = nextItem.id;
+
+  const AudioPlayContext context = {nextItem.id, gap, _lastStoppedAudioType, nextItem.type};
+
+  LOG_INFOLN(F("Playing queued %s..."), audioTagToString(nextItem.tag));
 
   switch (nextItem.type) {
   case AudioType::Tone:
-    Logger::infoln(F("Playing queued tone..."));
-    playTone(nextItem.toneId, nextItem.toneDuration);
+    playTone(nextItem.toneId, nextItem.toneDuration, context);
     break;
   case AudioType::Mp3:
-    Logger::infoln(F("Playing queued MP3..."));
-    playMp3(nextItem.filename, nextItem.repeat);
+    playMp3(nextItem.filename, nextItem.repeat, context);
     break;
   }
+}
 
-  // Once we've initiated play, pop it from the queue
-  _audioQueue.pop();
+// The play command's final result tells whether the gap before it was long enough: the modem
+// rejects a play that comes too soon after the previous clip stopped.
+void Modem::onPlayCommandComplete(const PendingCommand &command, const CommandResult result) {
+  const AudioPlayContext &context = command.audio;
+  AudioTransitionStats &transition = getAudioTransition(context.from, context.to);
+  const bool stillPlaying = _audio.isPlaying() && _audio.current().id == context.itemId;
+
+  switch (result) {
+  case CommandResult::Ok:
+    ++transition.plays;
+    transition.acceptedGaps.record(context.gapMs);
+    transition.gapMs -= std::min(transition.gapMs, kAudioGapDecreaseMs);
+    _audioPlayRetries = 0;
+
+    // Tones don't report their start, the modem accepting one is the closest thing. Mp3s do, with
+    // +AUDIOSTATE: audio play.
+    if (context.to == AudioType::Tone) {
+      _audio.onPlaybackStarted(AudioType::Tone);
+    }
+    break;
+  case CommandResult::Error:
+  case CommandResult::CmeError:
+    ++transition.rejections;
+    transition.gapMs = std::min(std::max(transition.gapMs * 2, kMinAudioGapBackoffMs),
+                                kMaxAudioGapMs);
+
+    LOG_WARNLN(F("Play rejected after a %lu ms gap, now waiting %lu ms"),
+               context.gapMs,
+               transition.gapMs);
+
+    if (!stillPlaying) {
+      break;
+    }
+
+    // No stop report will come for a clip that never started.
+    _lastAudioStopMillis = millis();
+
+    if (++_audioPlayRetries <= kMaxAudioPlayRetries) {
+      _audio.requeue();
+    } else {
+      LOG_ERRORLN(F("Giving up on %s"), audioTagToString(_audio.current().tag));
+      _audioPlayRetries = 0;
+      _audio.finish();
+    }
+    break;
+  default:
+    break;
+  }
+}
+
+AudioTransitionStats &Modem::getAudioTransition(const AudioType from, const AudioType to) {
+  return _audioTransitions[static_cast<size_t>(from)][static_cast<size_t>(to)];
+}
+
+void Modem::logAudioTransitionStats() const {
+  LOG_INFOLN(F("Audio gaps ms (gap now, plays, rejected, p50, p90, max):"));
+
+  for (size_t from = 0; from < kAudioTypeCount; from++) {
+    for (size_t to = 0; to < kAudioTypeCount; to++) {
+      [[maybe_unused]] const AudioTransitionStats &transition = _audioTransitions[from][to];
+
+      LOG_INFOLN(F("  %-4s -> %-4s %4lu %5lu %3lu %4lu %4lu %4lu"),
+                 from == static_cast<size_t>(AudioType::Tone) ? "tone" : "mp3",
+                 to == static_cast<size_t>(AudioType::Tone) ? "tone" : "mp3",
+                 transition.gapMs,
+                 transition.plays,
+                 transition.rejections,
+                 transition.acceptedGaps.percentile(50),
+                 transition.acceptedGaps.percentile(90),
+                 transition.acceptedGaps.largest());
+    }
+  }
+}
+
+// Known announcements play as a single clip. Unknown ones are spelled out digit by digit this
+// time, and rendered into the cache once the phone is idle again. Either way the number is brought
+// to national format first, so the same caller always finds the same announcement.
+void Modem::announceCaller(const char *number) {
+  char normalized[kMediumBufferSize];
+
+  if (!normalizePhoneNumber(number, normalized, sizeof(normalized))) {
+    LOG_WARNLN(F("Can't announce %s"), number);
+    return;
+  }
+
+  const char *cached = _announcements.find(normalized);
+
+  if (cached != nullptr) {
+    LOG_INFOLN(F("Playing cached announcement for %s: %s"), normalized, cached);
+    enqueueMp3(cached, AudioTag::CallerAnnouncement);
+    return;
+  }
+
+  LOG_INFOLN(F("No announcement for %s, spelling it out"), normalized);
+
+  snprintf(_spelledNumber, sizeof(_spelledNumber), "%s", normalized);
+  _spelledDigit = 0;
+  _spelledDigitId = 0;
+  spellNextDigit();
+
+  if (_announcementPhase == AnnouncementPhase::Idle) {
+    snprintf(_announcementNumber, sizeof(_announcementNumber), "%s", normalized);
+  }
+}
+
+// A number has more digits than the audio queue has room for, so only one waits in it at a time:
+// the next is queued once the one before it starts.
+void Modem::spellNextDigit() {
+  if (_audio.isQueued(_spelledDigitId)) {
+    return;
+  }
+
+  // A number in international format starts with a "+".
+  while (_spelledNumber[_spelledDigit] != '\0' && !isdigit(_spelledNumber[_spelledDigit])) {
+    ++_spelledDigit;
+  }
+
+  if (_spelledNumber[_spelledDigit] == '\0') {
+    return;
+  }
+
+  const char *file = dialedDigitsToMp3s[_spelledNumber[_spelledDigit] - '0'];
+  _spelledDigitId =
+      _audio.enqueue({AudioType::Mp3, Tone::DialTone, 0, file, 0, AudioTag::CallerDigits});
+  ++_spelledDigit;
+}
+
+void Modem::stopSpelling() {
+  _spelledNumber[0] = '\0';
+  _spelledDigit = 0;
+  _spelledDigitId = 0;
+}
+
+// The composite is the digit clips' MP3 frames back to back, which is itself a valid MP3.
+void Modem::renderPendingAnnouncement() {
+  if (_announcementPhase != AnnouncementPhase::Idle || _announcementNumber[0] == '\0') {
+    return;
+  }
+
+  _announcementLength = getAnnouncementLength();
+
+  if (_announcementLength == 0) {
+    _announcementNumber[0] = '\0';
+    return;
+  }
+
+  _announcementSlot = _announcements.reserve();
+  _announcementFileHandle = -1;
+  _announcementWritten = 0;
+
+  LOG_INFOLN(F("Rendering announcement for %s into %s (%u bytes)"),
+             _announcementNumber,
+             _announcements.getFileName(_announcementSlot),
+             _announcementLength);
+
+  char openCmd[kMediumBufferSize];
+  snprintf(openCmd,
+           sizeof(openCmd),
+           "+FSOPEN=%s/%s,1",
+           kMp3Dir,
+           _announcements.getFileName(_announcementSlot));
+
+  if (submitCommand(openCmd, kCommandTimeoutMs, &Modem::onAnnouncementOpenComplete)) {
+    _announcementPhase = AnnouncementPhase::Opening;
+  } else {
+    finishAnnouncement(false);
+  }
+}
+
+size_t Modem::getAnnouncementLength() const {
+  size_t length = 0;
+
+  for (const char *c = _announcementNumber; *c != '\0'; ++c) {
+    if (isdigit(*c)) {
+      length += dialedDigitsMp3Lengths[*c - '0'];
+    }
+  }
+
+  return length;
+}
+
+void Modem::finishAnnouncement(const bool success) {
+  if (success) {
+    _announcements.commit(_announcementSlot, _announcementNumber);
+    LOG_INFOLN(F("Announcement for %s rendered"), _announcementNumber);
+  } else {
+    LOG_WARNLN(F("Rendering announcement for %s failed"), _announcementNumber);
+  }
+
+  _announcementPhase = AnnouncementPhase::Idle;
+  _announcementNumber[0] = '\0';
+  _announcementFileHandle = -1;
+  _announcementStreaming = false;
+}
+
+void Modem::onAnnouncementOpenComplete(const PendingCommand &command, const CommandResult result) {
+  if (result != CommandResult::Ok || _announcementFileHandle < 0) {
+    finishAnnouncement(false);
+    return;
+  }
+
+  _announcementPhase = AnnouncementPhase::Writing;
+
+  if (!submitAnnouncementWrite()) {
+    abandonAnnouncement();
+  }
+}
+
+bool Modem::submitAnnouncementWrite() {
+  const size_t chunk = std::min(_announcementLength - _announcementWritten, kMaxFileWriteChunk);
+  _announcementChunkEnd = _announcementWritten + chunk;
+
+  char writeCmd[kMediumBufferSize];
+  snprintf(writeCmd,
+           sizeof(writeCmd),
+           "+FSWRITE=%d,%u,%u",
+           _announcementFileHandle,
+           static_cast<unsigned>(chunk),
+           kFileWriteDataTimeoutSec);
+
+  return submitCommand(writeCmd,
+                       kFileWriteTimeoutMs,
+                       &Modem::onAnnouncementWriteComplete,
+                       &Modem::onAnnouncementConnect);
+}
+
+void Modem::onAnnouncementConnect(const PendingCommand &command) {
+  _announcementStreaming = true;
+  streamAnnouncement();
+}
+
+// Writes only what fits in the UART's TX buffer, the rest goes out on the next loop iterations.
+void Modem::streamAnnouncement() {
+  while (_announcementWritten < _announcementChunkEnd) {
+    const int room = SerialAT.availableForWrite();
+
+    if (room <= 0) {
+      return;
+    }
+
+    size_t offset = _announcementWritten;
+
+    for (const char *c = _announcementNumber; *c != '\0'; ++c) {
+      if (!isdigit(*c)) {
+        continue;
+      }
+
+      const size_t length = dialedDigitsMp3Lengths[*c - '0'];
+
+      if (offset >= length) {
+        offset -= length;
+        continue;
+      }
+
+      const size_t count = std::min({length - offset,
+                                     _announcementChunkEnd - _announcementWritten,
+                                     static_cast<size_t>(room)});
+
+      SerialAT.write(dialedDigitsMp3Data[*c - '0'] + offset, count);
+      _announcementWritten += count;
+      break;
+    }
+  }
+
+  _announcementStreaming = false;
+}
+
+void Modem::onAnnouncementWriteComplete(const PendingCommand &command, const CommandResult result) {
+  _announcementStreaming = false;
+
+  if (result != CommandResult::Ok || _announcementWritten != _announcementChunkEnd) {
+    abandonAnnouncement();
+    return;
+  }
+
+  if (_announcementWritten < _announcementLength) {
+    if (!submitAnnouncementWrite()) {
+      abandonAnnouncement();
+    }
+    return;
+  }
+
+  char closeCmd[kSmallBufferSize];
+  snprintf(closeCmd, sizeof(closeCmd), "+FSCLOSE=%d", _announcementFileHandle);
+
+  if (submitCommand(closeCmd, kCommandTimeoutMs, &Modem::onAnnouncementCloseComplete)) {
+    _announcementPhase = AnnouncementPhase::Closing;
+  } else {
+    finishAnnouncement(false);
+  }
+}
+
+// The file is still closed, it just doesn't make it into the cache.
+void Modem::abandonAnnouncement() {
+  char closeCmd[kSmallBufferSize];
+  snprintf(closeCmd, sizeof(closeCmd), "+FSCLOSE=%d", _announcementFileHandle);
+  submitCommand(closeCmd, kCommandTimeoutMs);
+
+  finishAnnouncement(false);
+}
+
+void Modem::onAnnouncementCloseComplete(const PendingCommand &command, const CommandResult result) {
+  finishAnnouncement(result == CommandResult::Ok);
+}
+
+// Reads the SIM phonebook into the contact cache, replacing only the ranges of slots that changed.
+// Called whenever the phone goes idle, so a sync that failed, or was owed after a SIM change, is
+// simply tried again.
+void Modem::syncSimContacts() {
+  if (_simContactsPhase != SimContactsPhase::Idle) {
+    return;
+  }
+
+  _simIccid[0] = '\0';
+  _simContactsRestart = false;
+
+  if (submitCommand("+CICCID", kCommandTimeoutMs, &Modem::onSimIccidComplete)) {
+    _simContactsPhase = SimContactsPhase::ReadingIccid;
+  }
+}
+
+const char *Modem::getCallerName(const char *number) const {
+  return _simContacts.findName(number);
+}
+
+void Modem::handleSimContactsMessage(const char *msg, const UrcType type) {
+  AtParseResult result = AtParseResult::Ok;
+
+  switch (type) {
+  case UrcType::Iccid:
+    result = parseIccid(msg, _simIccid, sizeof(_simIccid));
+    break;
+  case UrcType::SimStorage:
+    result = parseCpbs(msg, _simStorage);
+    break;
+  case UrcType::SimContact: {
+    if (_simContactsPhase != SimContactsPhase::Reading) {
+      return;
+    }
+
+    _simContacts.addLine(msg);
+
+    CpbrRecord record;
+    result = parseCpbr(msg, record);
+
+    // Counted even if it can't be parsed, so the sync still knows when it has seen them all.
+    ++_simContactsSeen;
+
+    if (result == AtParseResult::Ok) {
+      _simContacts.add(record.index, record.number, record.text);
+    }
+    break;
+  }
+  default:
+    break;
+  }
+
+  if (result != AtParseResult::Ok) {
+    LOG_WARNLN(F("Failed to parse SIM line (%s): %s"), atParseResultToString(result), msg);
+  }
+}
+
+void Modem::onSimIccidComplete(const PendingCommand &command, const CommandResult result) {
+  if (result != CommandResult::Ok || _simIccid[0] == '\0') {
+    failSimContactsSync(F("no ICCID"));
+    return;
+  }
+
+  _simStorage = CpbsStatus{};
+
+  // Selects the SIM's own phonebook and asks how full it is, in one round trip.
+  if (submitCommand("+CPBS=\"SM\";+CPBS?", kCommandTimeoutMs, &Modem::onSimStorageComplete)) {
+    _simContactsPhase = SimContactsPhase::ReadingStorage;
+  } else {
+    _simContactsPhase = SimContactsPhase::Idle;
+  }
+}
+
+void Modem::onSimStorageComplete(const PendingCommand &command, const CommandResult result) {
+  if (result != CommandResult::Ok || _simStorage.used < 0 || _simStorage.total < 0) {
+    failSimContactsSync(F("no phonebook status"));
+    return;
+  }
+
+  const size_t total = static_cast<size_t>(_simStorage.total);
+
+  if (!_simContacts.beginSync(_simIccid, total)) {
+    LOG_ERRORLN(F("No room for %u SIM slots"), static_cast<unsigned>(total));
+    finishSimContactsSync();
+    return;
+  }
+
+  LOG_INFOLN(F("Checking %d SIM contacts..."), _simStorage.used);
+
+  _simContactsNextIndex = 1;
+  _simContactsSeen = 0;
+  _simContactsChangedRanges = 0;
+  readNextSimContacts();
+}
+
+// Goes through the SIM's slots a range at a time, and stops early once every used one was read.
+void Modem::readNextSimContacts() {
+  const size_t total = static_cast<size_t>(_simStorage.total);
+
+  if (_simContactsSeen >= static_cast<size_t>(_simStorage.used) || _simContactsNextIndex > total) {
+    _simContacts.commitSync();
+
+    LOG_INFOLN(F("SIM contacts synced, %u ranges changed, %u cached"),
+               static_cast<unsigned>(_simContactsChangedRanges),
+               static_cast<unsigned>(_simContacts.size()));
+    finishSimContactsSync();
+    return;
+  }
+
+  const size_t last = std::min(_simContactsNextIndex + kSimContactsRangeSize - 1, total);
+
+  char command[kSmallBufferSize];
+  snprintf(command,
+           sizeof(command),
+           "+CPBR=%u,%u",
+           static_cast<unsigned>(_simContactsNextIndex),
+           static_cast<unsigned>(last));
+
+  if (!submitCommand(command, kSimContactsReadTimeoutMs, &Modem::onSimContactsComplete)) {
+    failSimContactsSync(F("command not queued"));
+    return;
+  }
+
+  _simContacts.beginRange(_simContactsNextIndex);
+  _simContactsPhase = SimContactsPhase::Reading;
+  _simContactsNextIndex = last + 1;
+}
+
+void Modem::onSimContactsComplete(const PendingCommand &command, const CommandResult result) {
+  // Some modems answer a range without entries with +CME ERROR: not found.
+  if (result != CommandResult::Ok && result != CommandResult::CmeError) {
+    failSimContactsSync(F("read failed"));
+    return;
+  }
+
+  if (_simContacts.endRange()) {
+    ++_simContactsChangedRanges;
+  }
+
+  readNextSimContacts();
+}
+
+void Modem::failSimContactsSync(const __FlashStringHelper *reason) {
+  LOG_WARNLN(F("SIM contacts sync failed (%s), will retry when idle"), reason);
+
+  _simContacts.abortSync();
+  _simContactsPhase = SimContactsPhase::Idle;
+}
+
+// A sync that was under way when the SIM changed runs again from the start.
+void Modem::finishSimContactsSync() {
+  _simContactsPhase = _simContactsRestart ? SimContactsPhase::Idle : SimContactsPhase::Done;
+  _simContactsRestart = false;
+}
+
+// A swapped SIM, or the same one after the modem re-registered, may hold other contacts.
+void Modem::onSimStateChanged() {
+  if (_simContactsPhase == SimContactsPhase::Done) {
+    _simContactsPhase = SimContactsPhase::Idle;
+  } else if (_simContactsPhase != SimContactsPhase::Idle) {
+    _simContactsRestart = true;
+  }
 }
 
 void Modem::callPending() {
-  if (_isPlayingAudio) {
+  if (_audio.isPlaying()) {
     return;
   }
 
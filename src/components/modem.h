@@ -1,42 +1,22 @@
 #pragma once
 
+#include "audioScheduler.h"
+#include "common/announcementCache.h"
+#include "common/atParser.h"
+#include "common/histogram.h"
 #include "common/ringBuffer.h"
+#include "common/simContacts.h"
 #include "common/state.h"
+#include "common/stream.h"
+#include "common/urc.h"
 #include "config.h"
 #include "generated/mp3.h"
 #include <Arduino.h>
 #include <TinyGsmClient.h>
 #include <queue>
 
-// As per SIMCom's A76XX Series AT Command Manual
-enum class Tone {
-  DialTone = 1,
-  CalledSubscriberBusy = 2,
-  Congestion = 3,
-  RadioPathAcknowledge = 4,
-  RadioPathNotAvailableOrCallDropped = 5,
-  ErrorOrSpecialInformation = 6,
-  CallWaitingTone = 7,
-  RingingTone = 8,
-  GeneralBeep = 16,
-  PositiveAcknowledgeTone = 17,
-  NegativeAcknowledgeOrErrorTone = 18,
-  IndianDialTone = 19,
-  AmericanDialTone = 20,
-};
-
 enum class VolumeMode { Earpiece, Speaker };
 
-enum class AudioType { Tone, Mp3 };
-
-struct AudioItem {
-  AudioType type;
-  Tone toneId;
-  int toneDuration;
-  const char *filename;
-  int repeat;
-};
-
 struct PendingMp3 {
   PendingMp3() : filename(nullptr), repeat(0) {}
   PendingMp3(const char *filename, const int repeat = 0) : filename(filename), repeat(repeat) {}
@@ -45,51 +25,244 @@ struct PendingMp3 {
   int repeat;
 };
 
+enum class CommandResult { Ok, Error, CmeError, Timeout, Aborted };
+
+// What a command does, for latency accounting.
+enum class CommandClass : uint8_t {
+  KeepAlive,
+  Mp3,
+  Tone,
+  Dial,
+  Answer,
+  HangUp,
+  CallHold,
+  Gain,
+  Status,
+  Batch,
+  Other,
+  Count,
+};
+
+const constexpr size_t kCommandClassCount = static_cast<size_t>(CommandClass::Count);
+
+class Modem;
+struct PendingCommand;
+
+using CommandCallback = void (Modem::*)(const PendingCommand &command, const CommandResult result);
+// Called when the modem answers CONNECT and waits for the command's data.
+using DataCallback = void (Modem::*)(const PendingCommand &command);
+
+const constexpr size_t kMaxBatchedCommands = 16;
+
+// What a play command plays, so its result is judged against the transition it actually made.
+struct AudioPlayContext {
+  uint32_t itemId;
+  // How long after the previous clip stopped the command was queued.
+  uint32_t gapMs;
+  AudioType from;
+  AudioType to;
+};
+
+struct PendingCommand {
+  char text[kBigBufferSize];
+  // Where each sub-command of a batch starts in text, so a failed batch can be retried piecewise.
+  uint8_t batchOffsets[kMaxBatchedCommands];
+  uint8_t batchSize;
+  // Only set on play commands.
+  AudioPlayContext audio;
+  CommandClass commandClass;
+  uint32_t sentMillis;
+  uint32_t timeoutMs;
+  CommandCallback onComplete;
+  DataCallback onConnect;
+  bool sent;
+  bool aborted;
+  // Dial and answer are aborted by any character the modem receives while they run, and a data
+  // command takes everything written after it as data, so nothing else may be written until they
+  // complete.
+  bool blocksWrites;
+};
+
+enum class AnnouncementPhase : uint8_t { Idle, Opening, Writing, Closing };
+
+enum class SimContactsPhase : uint8_t { Idle, ReadingIccid, ReadingStorage, Reading, Done };
+
+enum class ModemPowerPhase {
+  Off,
+  ResetSettle,
+  ResetPull,
+  PowerKeyLow,
+  PowerKeyHigh,
+  Probing,
+  ProbeWait,
+  RetryDelay,
+  Ready,
+};
+
+// Durations of the last power-up, all relative to its first attempt.
+struct ModemPowerTimings {
+  uint8_t attempts = 0;
+  uint32_t resetMs = 0;
+  uint32_t powerKeyMs = 0;
+  uint32_t probeMs = 0;
+  uint32_t totalMs = 0;
+};
+
+struct BatchStats {
+  uint32_t batches = 0;
+  uint32_t batchedCommands = 0;
+  uint32_t roundTripsSaved = 0;
+  uint32_t failedBatches = 0;
+};
+
+// Power-of-two millisecond buckets, the last one collects everything from 16 s up.
+const constexpr size_t kKeepAliveHistogramBuckets = 16;
+// Up to 64 s, enough for a dial that waits for the other side to pick up.
+const constexpr size_t kCommandHistogramBuckets = 18;
+
+// Time from writing a command to reading its final result code.
+struct CommandLatencyStats {
+  Histogram<kCommandHistogramBuckets> latency;
+  uint32_t failures = 0;
+  uint32_t timeouts = 0;
+};
+
+struct KeepAliveStats {
+  uint32_t probes = 0;
+  uint32_t softEscalations = 0;
+  uint32_t softRecoveries = 0;
+  uint32_t hardResets = 0;
+  Histogram<kKeepAliveHistogramBuckets> roundTrip;
+};
+
+// Up to 512 ms, past the largest gap the learner will ever wait.
+const constexpr size_t kAudioGapHistogramBuckets = 11;
+
+// The gap the modem needs between one clip stopping and the next play command, learned
+// separately for each kind of transition (tone to MP3, MP3 to MP3, ...).
+struct AudioTransitionStats {
+  uint32_t gapMs = 0;
+  uint32_t plays = 0;
+  uint32_t rejections = 0;
+  // The actual gaps before plays the modem accepted.
+  Histogram<kAudioGapHistogramBuckets> acceptedGaps;
+};
+
 class Modem {
 public:
   Modem();
 
   void init();
-  void process(const State &state);
+  void process();
+
+  bool isReady() const;
+  bool isIdle() const;
+  const ModemPowerTimings &getPowerTimings() const;
+  const KeepAliveStats &getKeepAliveStats() const;
+  const CommandLatencyStats &getCommandLatencyStats(const CommandClass commandClass) const;
+  void logStats() const;
 
-  void deriveStateFromMessage(State &currState);
+  bool deriveStateFromMessage(State &currState);
 
   void enqueueCall(const char *number);
   void hangUp();
   void answer();
   void switchToCallWaiting();
 
-  void enqueueTone(const Tone toneId, const int duration);
-  void stopTone();
-  void enqueueMp3(const char *file, const int repeat = 0);
-  void stopMp3();
+  void enqueueTone(const Tone toneId, const int duration, const AudioTag tag);
+  void enqueueMp3(const char *file, const AudioTag tag, const int repeat = 0);
+  void cancelAudio(const AudioTag tag);
   void stopAllAudio();
+  bool popAudioEvent(AudioEvent &event);
+
+  void announceCaller(const char *number);
+  void renderPendingAnnouncement();
+
+  void syncSimContacts();
+  // The caller's name on the SIM, or nullptr. Answered from the cache, without asking the modem.
+  const char *getCallerName(const char *number) const;
 
   void sendCheckHardwareCommand();
   void sendCheckLineCommand();
 
+  void abortPendingCommands();
+
   void toggleVolume();
   void setEarpieceVolume();
   void setSpeakerVolume();
 
 private:
-  void initModem();
-  void hardResetModem();
-  bool probeOK(uint32_t timeoutMs);
+  void setPowerPhase(const ModemPowerPhase phase);
+  void startPowerUp();
+  void startPowerUpAttempt();
+  void processPowerUp();
+  void sendProbe();
+  void onProbeComplete(const PendingCommand &command, const CommandResult result);
+  void onModemReady();
 
   template <typename... Args> void sendCommand(const __FlashStringHelper *command, Args... args);
   void sendCommand(const StringSumHelper &command);
   void sendCommand(const __FlashStringHelper *command);
   void sendCommand(const char *command);
 
-  void playMp3(const char *fileName, const int repeat = 0);
-  void playTone(const Tone toneId, const int duration);
-  bool hasAudioToPlay();
+  bool submitCommand(const char *command,
+                     const uint32_t timeoutMs,
+                     const CommandCallback onComplete = nullptr,
+                     const DataCallback onConnect = nullptr);
+  bool queueCommand(const char *command,
+                    const uint32_t timeoutMs,
+                    const CommandCallback onComplete,
+                    const DataCallback onConnect = nullptr);
+  void flushPendingCommands();
+  void completePendingCommand(const CommandResult result);
+  void expirePendingCommands();
+  void failPendingCommands(const CommandResult result);
+  const PendingCommand *runningBlockingCommand() const;
+  void recordCommandLatency(const PendingCommand &command, const CommandResult result);
+
+  void beginBatch();
+  void endBatch();
+  bool appendToBatch(const char *command);
+  void submitBatch();
+  void onBatchComplete(const PendingCommand &command, const CommandResult result);
+
+  void playMp3(const char *fileName, const int repeat, const AudioPlayContext &context);
+  void playTone(const Tone toneId, const int duration, const AudioPlayContext &context);
+  void submitPlayCommand(const char *command, const AudioPlayContext &context);
+  void stopTone();
+  void stopMp3();
+  void stopPlayback(const AudioType type);
+  void onPlaybackStopped(const AudioType type);
   void playNextAudioItem();
+  void onPlayCommandComplete(const PendingCommand &command, const CommandResult result);
+  void spellNextDigit();
+  void stopSpelling();
+  AudioTransitionStats &getAudioTransition(const AudioType from, const AudioType to);
+  void logAudioTransitionStats() const;
+
+  size_t getAnnouncementLength() const;
+  void finishAnnouncement(const bool success);
+  void onAnnouncementOpenComplete(const PendingCommand &command, const CommandResult result);
+  bool submitAnnouncementWrite();
+  void abandonAnnouncement();
+  void onAnnouncementConnect(const PendingCommand &command);
+  void streamAnnouncement();
+  void onAnnouncementWriteComplete(const PendingCommand &command, const CommandResult result);
+  void onAnnouncementCloseComplete(const PendingCommand &command, const CommandResult result);
+
+  void handleSimContactsMessage(const char *msg, const UrcType type);
+  void onSimIccidComplete(const PendingCommand &command, const CommandResult result);
+  void onSimStorageComplete(const PendingCommand &command, const CommandResult result);
+  void readNextSimContacts();
+  void onSimContactsComplete(const PendingCommand &command, const CommandResult result);
+  void failSimContactsSync(const __FlashStringHelper *reason);
+  void finishSimContactsSync();
+  void onSimStateChanged();
 
   void callPending();
   void call(const char *number);
   void verifyCallState();
+  void onCallCommandComplete(const PendingCommand &command, const CommandResult result);
 
   void enableHangUp();
   void disableUnneededFeatures();
@@ -98,25 +271,79 @@ private:
   void setVolume(const int volume);
   void setMicGain(const int gain);
 
+  static void readerTask(void *param);
   bool messageAvailable() const;
-  bool isKnownMessage(const char *msg) const;
+
+  bool handleRegistrationMessage(const char *msg, State &state);
+  bool handleCallListMessage(const char *msg, State &state);
+  void handleRingMessage(State &state);
+  bool handlePhoneActivityMessage(const char *msg, State &state);
 
   void keepAliveWatchdog();
-  void sendKeepAlive();
+  void sendKeepAlive(const uint32_t timeoutMs);
+  void onKeepAliveComplete(const PendingCommand &command, const CommandResult result);
+  void onKeepAliveAnswered(const uint32_t roundTripMs);
+  void onKeepAliveMissed(const PendingCommand &command);
+  void logKeepAliveStats() const;
   void reset();
 
-  RingBuffer<AudioItem, 10> _audioQueue;
+  AudioScheduler _audio;
+  AudioTransitionStats _audioTransitions[kAudioTypeCount][kAudioTypeCount];
+  AudioType _lastStoppedAudioType = AudioType::Tone;
+  // The last item a play command was sent for, to count retries of the same item.
+  uint32_t _playingAudioId = 0;
+  uint8_t _audioPlayRetries = 0;
+
+  // An unknown caller's number, spelled out one digit at a time as the audio queue drains.
+  char _spelledNumber[kMediumBufferSize] = "";
+  size_t _spelledDigit = 0;
+  uint32_t _spelledDigitId = 0;
+
+  AnnouncementCache _announcements;
+  AnnouncementPhase _announcementPhase = AnnouncementPhase::Idle;
+  char _announcementNumber[kMediumBufferSize] = "";
+  size_t _announcementSlot = 0;
+  int _announcementFileHandle = -1;
+  size_t _announcementLength = 0;
+  size_t _announcementWritten = 0;
+  size_t _announcementChunkEnd = 0;
+  bool _announcementStreaming = false;
+
+  SimContactCache _simContacts;
+  SimContactsPhase _simContactsPhase = SimContactsPhase::Idle;
+  char _simIccid[kIccidSize] = "";
+  CpbsStatus _simStorage;
+  size_t _simContactsNextIndex = 0;
+  size_t _simContactsSeen = 0;
+  size_t _simContactsChangedRanges = 0;
+  // Set when the SIM changed during a sync, so it's run again once it's done.
+  bool _simContactsRestart = false;
+  RingBuffer<PendingCommand, 16> _pendingCommands;
+  PendingCommand _batch;
+  BatchStats _batchStats;
+  uint8_t _batchDepth = 0;
+  LineAssembler _lineAssembler;
+  TaskHandle_t _readerTask = nullptr;
 
   VolumeMode _volumeMode = VolumeMode::Earpiece;
   TinyGsm _modemImpl;
 
-  char _enqueuedCall[kSmallBufferSize] = "";
+  char _enqueuedCall[kMediumBufferSize] = "";
 
-  bool _isPlayingAudio = false;
   bool _lastTimeCheckedLine = false;
   bool _waitingForKeepAlive = false;
+  bool _keepAliveSuspect = false;
 
   uint32_t _lastAudioStopMillis = 0UL;
-  uint32_t _lastKeepAliveSent = 0UL;
-  uint32_t _watchdogResetCounter = 0;
+  uint32_t _lastModemTraffic = 0UL;
+  uint32_t _keepAliveIntervalMs = 0UL;
+  KeepAliveStats _keepAliveStats;
+  CommandLatencyStats _commandLatencies[kCommandClassCount];
+  uint32_t _lastLineMillis = 0UL;
+
+  ModemPowerPhase _powerPhase = ModemPowerPhase::Off;
+  ModemPowerTimings _powerTimings;
+  uint32_t _powerPhaseStart = 0UL;
+  uint32_t _powerUpStart = 0UL;
+  uint32_t _probeStart = 0UL;
 };
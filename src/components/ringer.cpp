@@ -9,7 +9,7 @@ namespace {
 }
 
 void Ringer::init() const {
-  Logger::infoln(F("Initializing ringer..."));
+  LOG_INFOLN(F("Initializing ringer..."));
 
   pinMode(kRingerIn1Pin, OUTPUT);
   pinMode(kRingerIn2Pin, OUTPUT);
@@ -17,7 +17,7 @@ void Ringer::init() const {
 
   setRingerEnabled(false);
 
-  Logger::infoln(F("Ringer initialized!"));
+  LOG_INFOLN(F("Ringer initialized!"));
 }
 
 void Ringer::startRinging() {
@@ -62,6 +62,10 @@ void Ringer::process(State &state) {
   }
 }
 
+bool Ringer::isIdle() const {
+  return !_ringing;
+}
+
 void Ringer::stopRinging() {
   if (!_ringing) {
     return;
@@ -7,6 +7,8 @@ public:
   void init() const;
   void process(State &state);
 
+  bool isIdle() const;
+
   void startRinging();
   void stopRinging();
 
@@ -1,5 +1,6 @@
 #include "rotaryDial.h"
 #include "common/logger.h"
+#include "common/wakeup.h"
 #include "config.h"
 
 namespace {
@@ -7,12 +8,15 @@ namespace {
 }
 
 void RotaryDial::init() const {
-  Logger::infoln(F("Initializing rotary dial..."));
+  LOG_INFOLN(F("Initializing rotary dial..."));
 
   pinMode(kRotaryDialInDialPin, INPUT_PULLUP);
   pinMode(kRotaryDialPulsePin, INPUT_PULLUP);
 
-  Logger::infoln(F("Rotary dial initialized!"));
+  attachInterrupt(digitalPinToInterrupt(kRotaryDialInDialPin), Wakeup::notifyFromIsr, CHANGE);
+  attachInterrupt(digitalPinToInterrupt(kRotaryDialPulsePin), Wakeup::notifyFromIsr, CHANGE);
+
+  LOG_INFOLN(F("Rotary dial initialized!"));
 }
 
 void RotaryDial::process() {
@@ -29,10 +33,10 @@ void RotaryDial::process() {
       _inDialState = newInDialedState;
 
       if (_inDialState == LOW) {
-        Logger::infoln(F("Start of dial"));
+        LOG_INFOLN(F("Start of dial"));
         _counter = 0;
       } else {
-        Logger::infoln(F("End of dial"));
+        LOG_INFOLN(F("End of dial"));
 
         if (_counter > 0) {
           if (_counter == 10) {
@@ -66,10 +70,17 @@ void RotaryDial::process() {
   _pulsePreviousState = newPulseState;
 
   if (_dialedDigit != kInvalidDialedDigit) {
-    Logger::infoln(F("Dialed digit: %d"), _dialedDigit);
+    LOG_INFOLN(F("Dialed digit: %d"), _dialedDigit);
   }
 }
 
+// Not mid-dial, and no debounce in progress. Pulses are timed by sampling, so while the dial is
+// turning the loop must not sleep.
+bool RotaryDial::isIdle() const {
+  return _inDialState == HIGH && _inDialPreviousState == _inDialState &&
+         _pulsePreviousState == _pulseState;
+}
+
 int RotaryDial::getDialedDigit() const {
   return _dialedDigit;
 }
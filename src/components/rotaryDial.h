@@ -15,6 +15,8 @@ public:
   void init() const;
   void process();
 
+  bool isIdle() const;
+
   void resetCurrentNumber();
   int getDialedDigit() const;
   DialedNumberResult getCurrentNumber();
@@ -7,7 +7,11 @@ const constexpr char kMp3Dir[] = "C:/mp3";
 const constexpr char *kWifiWebPortalNumber = "3123";
 const constexpr char *kWifiSsid = "TsuryPhone";
 const constexpr char *kResetNumber = "5555";
+const constexpr char *kModemStatsNumber = "7828";
 const constexpr char *timeZone = "IST-2IDT,M3.4.4/26,M10.5.0";
+// Numbers in this country are turned into national format ("+9725..." to "05...") before they're
+// looked up. mp3/generate.py takes the same code through --country-code.
+const constexpr char *kCountryCallingCode = "972";
 const constexpr int kEarpieceVolume = 2;
 const constexpr int kEarpieceMicGain = 7;
 const constexpr int kSpeakerVolume = 7;
@@ -1,8 +1,10 @@
 #include "main.h"
+#include "common/logBenchmark.h"
 #include "common/logger.h"
 #include "common/phoneBook.h"
+#include "common/phoneBookStore.h"
 #include "common/string.h"
-#include "generated/phoneBook.h"
+#include "common/wakeup.h"
 
 namespace {
   const constexpr int kSerialBaudRate = kModemBaudRate;
@@ -15,14 +17,28 @@ namespace {
   const constexpr int kToggleVolumeToneDuration = 75;
   const constexpr int kCallWaitingToneDuration = 500;
   const constexpr int kInvalidNumberMp3RepeatCount = 100;
+  // The longest the loop sleeps when nothing is going on. GPIO edges and modem lines wake it
+  // earlier.
+  const constexpr uint32_t kIdleWaitMs = 20;
+  const constexpr uint32_t kLoopStatsInterval = 60000;
 }
 
 PhoneApp::PhoneApp() : _modem(), _ringer(), _hookSwitch(), _rotaryDial(), _wifi() {}
 
 void PhoneApp::setup() {
   Serial.begin(kSerialBaudRate);
+  Logger::init();
 
-  Logger::infoln(F("TsuryPhone starting..."));
+  LOG_INFOLN(F("TsuryPhone starting..."));
+
+#ifdef LOG_BENCHMARK
+  LogBenchmark::run();
+#endif
+
+  Wakeup::init();
+
+  PhoneBookStore::init();
+  resetDialedNumber();
 
   _wifi.init();
   _modem.init();
@@ -31,12 +47,14 @@ void PhoneApp::setup() {
   _hookSwitch.init();
   _timeManager.init();
 
-  Logger::infoln(F("TsuryPhone started!"));
+  LOG_INFOLN(F("TsuryPhone started!"));
 
   setState(AppState::CheckHardware);
 }
 
 void PhoneApp::loop() {
+  const uint32_t loopStart = micros();
+
 #ifdef DEBUG
   if (Serial.available()) {
     char c = Serial.read();
@@ -53,9 +71,16 @@ void PhoneApp::loop() {
   // The MP3 is not played immediately, to not surprise the user.
   const bool prevRangAtLeastOnce = _state.callState.rangAtLeastOnce;
 
-  _modem.deriveStateFromMessage(_state);
+  // Every complete line the modem sent since the last iteration is handled here, each with its
+  // own state derivation, so a burst of URCs doesn't trickle in one line per loop.
+  while (_modem.deriveStateFromMessage(_state)) {
+    if (_state.prevAppState != _state.newAppState) {
+      onStateChanged();
+    }
+  }
 
-  _modem.process(_state);
+  _modem.process();
+  processAudioEvents();
   _wifi.process();
   _hookSwitch.process();
   _rotaryDial.process();
@@ -69,6 +94,47 @@ void PhoneApp::loop() {
   }
 
   processState();
+
+  countLoopIteration(micros() - loopStart);
+  Wakeup::waitFor(isIdle() ? kIdleWaitMs : 0);
+}
+
+void PhoneApp::processAudioEvents() {
+  AudioEvent event;
+
+  while (_modem.popAudioEvent(event)) {
+    LOG_DEBUGLN(F("Audio %lu (%s) %s"),
+                event.id,
+                audioTagToString(event.tag),
+                audioEventTypeToString(event.type));
+  }
+}
+
+bool PhoneApp::isIdle() const {
+  return _modem.isIdle() && _ringer.isIdle() && _hookSwitch.isIdle() && _rotaryDial.isIdle();
+}
+
+// The busy time leaves out the wait for the next wakeup, so it's what logging and the components
+// actually cost an iteration.
+void PhoneApp::countLoopIteration(const uint32_t busyMicros) {
+  ++_loopIterations;
+  _loopBusyMicros.record(busyMicros);
+
+  const uint32_t elapsed = millis() - _loopStatsStart;
+
+  if (elapsed >= kLoopStatsInterval) {
+    _loopIterationsPerSecond = _loopIterations * 1000UL / elapsed;
+    LOG_DEBUGLN(F("Loop: %lu iterations/s, busy us p50 %lu, p99 %lu, max %lu"),
+                _loopIterationsPerSecond,
+                _loopBusyMicros.percentile(50),
+                _loopBusyMicros.percentile(99),
+                _loopBusyMicros.largest());
+
+    _loopBusyMicros.clear();
+
+    _loopIterations = 0;
+    _loopStatsStart = millis();
+  }
 }
 
 void PhoneApp::setState(const AppState newState) {
@@ -84,11 +150,11 @@ void PhoneApp::setState(const AppState newState) {
 
 void PhoneApp::onStateChanged() {
   if (_state.newAppState == _state.prevAppState) {
-    Logger::infoln(F("Retrying state %s"), appStateToString(_state.newAppState));
+    LOG_INFOLN(F("Retrying state %s"), appStateToString(_state.newAppState));
   } else {
-    Logger::infoln(F("Changing state from %s to %s"),
-                   appStateToString(_state.prevAppState),
-                   appStateToString(_state.newAppState));
+    LOG_INFOLN(F("Changing state from %s to %s"),
+               appStateToString(_state.prevAppState),
+               appStateToString(_state.newAppState));
   }
 
   _stateTime = millis();
@@ -128,16 +194,18 @@ void PhoneApp::onStateCheckLine() {
 void PhoneApp::onStateIdle() {
   stopEverything();
   _modem.setSpeakerVolume();
+  _modem.renderPendingAnnouncement();
+  _modem.syncSimContacts();
 
   if (_state.callState.otherPartyDropped) {
-    _modem.enqueueTone(Tone::CallWaitingTone, kCallDroppedToneDuration);
+    _modem.enqueueTone(Tone::CallWaitingTone, kCallDroppedToneDuration, AudioTag::CallDropped);
   }
 
   if (!_firstTimeSystemReady) {
     _firstTimeSystemReady = true;
-    _modem.enqueueMp3(state_ready);
+    _modem.enqueueMp3(state_ready, AudioTag::Prompt);
 
-    Logger::infoln(F("System ready!"));
+    LOG_INFOLN(F("System ready!"));
   }
 }
 
@@ -148,22 +216,23 @@ void PhoneApp::onStateIncomingCall() {
   if (callNumber[0] != '\0' && !callState.introducedCaller && callState.rangAtLeastOnce) {
     callState.introducedCaller = true;
 
-    if (hasMp3ForCall(callNumber)) {
-      Logger::infoln(F("Playing MP3 for caller: %s"), callNumber);
-      const char *mp3Ptr = getMp3ForCall(callNumber);
+    const char *callerName = _modem.getCallerName(callNumber);
 
-      if (mp3Ptr != nullptr) {
-        _modem.enqueueMp3(mp3Ptr);
-      } else {
-        Logger::errorln(F("No MP3 for caller: %s"), callNumber);
-      }
+    if (callerName != nullptr) {
+      LOG_INFOLN(F("Incoming call from %s (%s)"), callerName, callNumber);
+    }
+
+    const char *mp3Ptr = lookupCallerMp3(callNumber);
+
+    if (mp3Ptr != nullptr) {
+      LOG_INFOLN(F("Playing MP3 for caller: %s"), callNumber);
+      _modem.enqueueMp3(mp3Ptr, AudioTag::CallerAnnouncement);
     } else {
-      Logger::infoln(F("No MP3 for caller: %s"), callNumber);
-      // TODO: TTS?
+      _modem.announceCaller(callNumber);
     }
   } else {
     // We ring on both incoming call and incoming call ring states.
-    Logger::infoln(F("Ringing..."));
+    LOG_INFOLN(F("Ringing..."));
     _ringer.startRinging();
   }
 }
@@ -176,10 +245,16 @@ void PhoneApp::processStateInvalidNumber() {
 }
 
 void PhoneApp::stopEverything() {
-  Logger::infoln(F("Stopping everything..."));
+  LOG_INFOLN(F("Stopping everything..."));
   _modem.stopAllAudio();
   _ringer.stopRinging();
+  resetDialedNumber();
+}
+
+void PhoneApp::resetDialedNumber() {
   _rotaryDial.resetCurrentNumber();
+  _phoneBookCursor.reset();
+  _dialPlanCursor.reset();
 }
 
 void PhoneApp::onStateInCall() {
@@ -232,40 +307,53 @@ void PhoneApp::processStateIdle() {
   if (_hookSwitch.justChangedOnHook()) {
     stopEverything();
   } else if (_hookSwitch.justChangedOffHook()) {
-    _modem.enqueueTone(Tone::DialTone, kDialToneDuration);
+    _modem.enqueueTone(Tone::DialTone, kDialToneDuration, AudioTag::DialTone);
   }
 
   if (_hookSwitch.isOffHook()) {
     DialedNumberResult dialedNumberResult = _rotaryDial.getCurrentNumber();
     char *dialedNumber = dialedNumberResult.callNumber;
 
-    if (dialedNumberResult.dialedDigit != kInvalidDialedDigit) {
-      _modem.stopTone();
-      Logger::infoln(F("Dialed digit: %d"), dialedNumberResult.dialedDigit);
-      Logger::infoln(F("Dialed number: %s"), dialedNumber);
-
-      _modem.enqueueMp3(dialedDigitsToMp3s[dialedNumberResult.dialedDigit]);
+    // The number only changes with a digit, and neither does its validation.
+    if (dialedNumberResult.dialedDigit == kInvalidDialedDigit) {
+      return;
     }
 
-    const DialedNumberValidationResult dialedNumberValidation = validateDialedNumber(dialedNumber);
+    _modem.cancelAudio(AudioTag::DialTone);
+    LOG_INFOLN(F("Dialed digit: %d"), dialedNumberResult.dialedDigit);
+    LOG_INFOLN(F("Dialed number: %s"), dialedNumber);
+
+    _modem.enqueueMp3(dialedDigitsToMp3s[dialedNumberResult.dialedDigit], AudioTag::DialedDigit);
+    _phoneBookCursor.advance(dialedNumberResult.dialedDigit);
+    _dialPlanCursor.advance(dialedNumberResult.dialedDigit);
+
+    const DialedNumberValidationResult dialedNumberValidation =
+        validateDialedNumber(_phoneBookCursor, _dialPlanCursor);
 
     if (dialedNumberValidation == DialedNumberValidationResult::Valid) {
       if (strEqual(dialedNumber, kResetNumber)) {
-        _modem.enqueueTone(Tone::NegativeAcknowledgeOrErrorTone, kResetToneDuration);
+        _modem.enqueueTone(
+            Tone::NegativeAcknowledgeOrErrorTone, kResetToneDuration, AudioTag::Feedback);
+        Logger::flush();
         ESP.restart();
       } else if (strEqual(dialedNumber, kWifiWebPortalNumber)) {
-        _modem.enqueueTone(Tone::GeneralBeep, kWifiPortalToneDuration);
+        _modem.enqueueTone(Tone::GeneralBeep, kWifiPortalToneDuration, AudioTag::Feedback);
         _wifi.openConfigPortal();
+        // The phone book may have been replaced through the portal.
+        resetDialedNumber();
+      } else if (strEqual(dialedNumber, kModemStatsNumber)) {
+        _modem.enqueueTone(Tone::GeneralBeep, kWifiPortalToneDuration, AudioTag::Feedback);
+        _modem.logStats();
+        Logger::logStats();
+        resetDialedNumber();
       } else {
-        const char *numberToDial = isPhoneBookEntry(dialedNumber)
-                                       ? getPhoneBookNumberForEntry(dialedNumber)
-                                       : dialedNumber;
-        _modem.enqueueCall(numberToDial);
+        const char *phoneBookNumber = _phoneBookCursor.getNumber();
+        _modem.enqueueCall(phoneBookNumber != nullptr ? phoneBookNumber : dialedNumber);
 
-        _rotaryDial.resetCurrentNumber();
+        resetDialedNumber();
       }
     } else if (dialedNumberValidation == DialedNumberValidationResult::Invalid) {
-      _modem.enqueueMp3(dial_error, kInvalidNumberMp3RepeatCount);
+      _modem.enqueueMp3(dial_error, AudioTag::Prompt, kInvalidNumberMp3RepeatCount);
       setState(AppState::InvalidNumber);
     }
   }
@@ -291,17 +379,18 @@ void PhoneApp::processStateInCall() {
   const int dialedDigit = _rotaryDial.getDialedDigit();
 
   if (dialedDigit == 1) {
-    Logger::infoln(F("Toggling volume..."));
-    _modem.enqueueTone(Tone::PositiveAcknowledgeTone, kToggleVolumeToneDuration);
+    LOG_INFOLN(F("Toggling volume..."));
+    _modem.enqueueTone(
+        Tone::PositiveAcknowledgeTone, kToggleVolumeToneDuration, AudioTag::Feedback);
     _modem.toggleVolume();
   } else if (dialedDigit == 2 && _state.callState.hasCallWaiting()) {
     _modem.switchToCallWaiting();
   }
 
   if (_state.callState.hasCallWaiting() && !_state.callState.playedCallWaitingTone) {
-    _modem.enqueueTone(Tone::IndianDialTone, kCallWaitingToneDuration);
+    _modem.enqueueTone(Tone::IndianDialTone, kCallWaitingToneDuration, AudioTag::CallWaiting);
     _state.callState.playedCallWaitingTone = true;
   }
 
-  _rotaryDial.resetCurrentNumber();
+  resetDialedNumber();
 }
\ No newline at end of file
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "common\consts.h"
+#include "common\histogram.h"
+#include "common\phoneBook.h"
 #include "common\timeManager.h"
 #include "common\wifi.h"
 #include "components\hookSwitch.h"
@@ -9,6 +11,8 @@
 #include "components\rotaryDial.h"
 #include <Arduino.h>
 
+const constexpr size_t kLoopBusyHistogramBuckets = 18;
+
 class PhoneApp {
 public:
   PhoneApp();
@@ -38,15 +42,29 @@ private:
   void processStateInvalidNumber();
 
   void stopEverything();
+  void resetDialedNumber();
+
+  void processAudioEvents();
+
+  bool isIdle() const;
+  void countLoopIteration(const uint32_t busyMicros);
 
   Modem _modem;
   Ringer _ringer;
   HookSwitch _hookSwitch;
   RotaryDial _rotaryDial;
+  PhoneBookCursor _phoneBookCursor;
+  DialPlanCursor _dialPlanCursor;
   Wifi _wifi;
   TimeManager _timeManager;
-  State _state = {AppState::Startup, AppState::Startup, CallState(), "", false, false};
+  State _state = {AppState::Startup, AppState::Startup, CallState(), false};
 
   uint32_t _stateTime = 0UL;
   bool _firstTimeSystemReady = false;
+
+  uint32_t _loopIterations = 0;
+  uint32_t _loopStatsStart = 0UL;
+  uint32_t _loopIterationsPerSecond = 0;
+  // Up to 64 ms, anything longer is a stall worth looking at anyway.
+  Histogram<kLoopBusyHistogramBuckets> _loopBusyMicros;
 };
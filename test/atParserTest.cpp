@@ -0,0 +1,195 @@
+// The call-status parsers on the lines the modem sends, and on the ones it shouldn't: numbers that
+// don't fit, unquoted and empty fields, trailing garbage and values we don't know.
+
+#include "common/atParser.h"
+#include <string>
+
+namespace {
+  int failures = 0;
+
+#define CHECK(condition)                                                                          \
+  do {                                                                                             \
+    if (!(condition)) {                                                                            \
+      printf("%s:%d: %s failed\n", __FILE__, __LINE__, #condition);                                \
+      ++failures;                                                                                  \
+    }                                                                                              \
+  } while (false)
+
+  AtParseResult clcc(const char *line, ClccRecord &record) {
+    record = ClccRecord{};
+    return parseClcc(line, record);
+  }
+
+  AtParseResult cpas(const char *line) {
+    CpasStatus status;
+    return parseCpas(line, status);
+  }
+
+  AtParseResult registration(const char *line, RegistrationStatus &status) {
+    status = RegistrationStatus{};
+    return parseRegistration(line, status);
+  }
+
+  // With and without the number, and with the fields that may follow it.
+  void testClccFields() {
+    ClccRecord call;
+
+    CHECK(clcc("+CLCC: 1,0,4,0,0", call) == AtParseResult::Ok);
+    CHECK(call.id == 1 && call.direction == 0 && call.status == 4 && call.mode == 0 &&
+          call.mpty == 0);
+    CHECK(call.number[0] == '\0');
+
+    CHECK(clcc("+CLCC: 2,1,0,1,1,\"0521234567\"", call) == AtParseResult::Ok);
+    CHECK(call.id == 2 && call.direction == 1 && call.status == 0 && call.mode == 1 &&
+          call.mpty == 1);
+    CHECK(strcmp(call.number, "0521234567") == 0);
+
+    CHECK(clcc("+CLCC: 1,1,4,0,0,\"+972521234567\",145", call) == AtParseResult::Ok);
+    CHECK(strcmp(call.number, "+972521234567") == 0);
+
+    CHECK(clcc("+CLCC: 1,1,4,0,0,\"+972521234567\",145,\"Mom\"", call) == AtParseResult::Ok);
+    CHECK(strcmp(call.number, "+972521234567") == 0);
+
+    CHECK(clcc("+CLCC:1,0,2,0,0,\"100\",129", call) == AtParseResult::Ok);
+    CHECK(call.status == 2);
+    CHECK(strcmp(call.number, "100") == 0);
+
+    // Fields missing, or not numbers.
+    CHECK(clcc("+CLCC: ", call) == AtParseResult::Malformed);
+    CHECK(clcc("+CLCC: 1,0,4,0", call) == AtParseResult::Malformed);
+    CHECK(clcc("+CLCC: 1,0,,0,0", call) == AtParseResult::Malformed);
+    CHECK(clcc("+CLCC: 1,0,x,0,0", call) == AtParseResult::Malformed);
+    CHECK(clcc("+CPAS: 1,0,4,0,0", call) == AtParseResult::Malformed);
+    CHECK(clcc("+CLCC 1,0,4,0,0", call) == AtParseResult::Malformed);
+  }
+
+  // The number is only taken if it fits as a whole, a cut short number would call someone else.
+  void testClccLongNumber() {
+    ClccRecord call;
+    const size_t longest = sizeof(call.number) - 1;
+
+    const std::string fits = "+CLCC: 1,1,4,0,0,\"" + std::string(longest, '5') + "\",129";
+    CHECK(clcc(fits.c_str(), call) == AtParseResult::Ok);
+    CHECK(strlen(call.number) == longest);
+
+    const std::string tooLong = "+CLCC: 1,1,4,0,0,\"" + std::string(longest + 1, '5') + "\",129";
+    CHECK(clcc(tooLong.c_str(), call) == AtParseResult::FieldTooLong);
+    CHECK(call.number[0] == '\0');
+
+    const std::string wayTooLong = "+CLCC: 1,1,4,0,0,\"" + std::string(500, '5') + "\"";
+    CHECK(clcc(wayTooLong.c_str(), call) == AtParseResult::FieldTooLong);
+    CHECK(call.number[0] == '\0');
+  }
+
+  void testClccUnquotedAndEmpty() {
+    ClccRecord call;
+
+    // A withheld number.
+    CHECK(clcc("+CLCC: 1,1,4,0,0,\"\",128", call) == AtParseResult::Ok);
+    CHECK(call.number[0] == '\0');
+
+    CHECK(clcc("+CLCC: 1,1,4,0,0,0521234567,129", call) == AtParseResult::Malformed);
+    CHECK(clcc("+CLCC: 1,1,4,0,0,", call) == AtParseResult::Malformed);
+    CHECK(clcc("+CLCC: 1,1,4,0,0,,129", call) == AtParseResult::Malformed);
+
+    CHECK(clcc("+CLCC: 1,1,4,0,0,\"0521234567", call) == AtParseResult::Malformed);
+    CHECK(call.number[0] == '\0');
+  }
+
+  void testClccTrailingGarbage() {
+    ClccRecord call;
+
+    CHECK(clcc("+CLCC: 1,0,4,0,0x", call) == AtParseResult::Malformed);
+    CHECK(clcc("+CLCC: 1,0,4,0,0 ", call) == AtParseResult::Malformed);
+    CHECK(clcc("+CLCC: 1,1,4,0,0,\"0521234567\"x", call) == AtParseResult::Malformed);
+    CHECK(clcc("+CLCC: 1,1,4,0,0,\"0521234567\" ,129", call) == AtParseResult::Malformed);
+  }
+
+  // Values the standard doesn't define still parse, it's up to the caller to make sense of them.
+  void testClccOutOfRange() {
+    ClccRecord call;
+
+    CHECK(clcc("+CLCC: 9,2,7,9,3,\"100\"", call) == AtParseResult::Ok);
+    CHECK(call.id == 9 && call.direction == 2 && call.status == 7 && call.mode == 9 &&
+          call.mpty == 3);
+
+    CHECK(clcc("+CLCC: -1,0,4,0,0", call) == AtParseResult::Ok);
+    CHECK(call.id == -1);
+  }
+
+  void testCpas() {
+    for (int value = static_cast<int>(CpasStatus::Ready);
+         value <= static_cast<int>(CpasStatus::Asleep);
+         value++) {
+      const std::string line = "+CPAS: " + std::to_string(value);
+      CpasStatus status = CpasStatus::Asleep;
+
+      CHECK(parseCpas(line.c_str(), status) == AtParseResult::Ok);
+      CHECK(static_cast<int>(status) == value);
+    }
+
+    CHECK(cpas("+CPAS:3") == AtParseResult::Ok);
+
+    // Well formed, but not a status we know: not the same as a corrupted line.
+    CHECK(cpas("+CPAS: 6") == AtParseResult::Unsupported);
+    CHECK(cpas("+CPAS: 129") == AtParseResult::Unsupported);
+    CHECK(cpas("+CPAS: -1") == AtParseResult::Unsupported);
+
+    CpasStatus status = CpasStatus::Ringing;
+    CHECK(parseCpas("+CPAS: 6", status) == AtParseResult::Unsupported);
+    CHECK(status == CpasStatus::Ringing);
+
+    CHECK(cpas("+CPAS: ") == AtParseResult::Malformed);
+    CHECK(cpas("+CPAS: \"0\"") == AtParseResult::Malformed);
+    CHECK(cpas("+CPAS: 0x") == AtParseResult::Malformed);
+    CHECK(cpas("+CPAS: 0 ") == AtParseResult::Malformed);
+    CHECK(cpas("+CPAS: 0,1") == AtParseResult::Malformed);
+    CHECK(cpas("+CPAS: 7x") == AtParseResult::Malformed);
+    CHECK(cpas("+CLCC: 0") == AtParseResult::Malformed);
+  }
+
+  void testRegistration() {
+    RegistrationStatus status;
+
+    for (int mode = 0; mode <= 2; mode++) {
+      for (int stat = 0; stat <= 5; stat++) {
+        const std::string line = "+CGREG: " + std::to_string(mode) + "," + std::to_string(stat);
+
+        CHECK(registration(line.c_str(), status) == AtParseResult::Ok);
+        CHECK(status.mode == mode && status.stat == stat);
+        CHECK(status.isRegisteredHome() == (stat == 1));
+      }
+    }
+
+    // With the location and cell, as with +CGREG=2.
+    CHECK(registration("+CGREG: 2,1,\"1A2B\",\"01C3D4E5\"", status) == AtParseResult::Ok);
+    CHECK(status.mode == 2 && status.isRegisteredHome());
+
+    // Newer modems report more states, they're not registered at home.
+    CHECK(registration("+CGREG: 0,11", status) == AtParseResult::Ok);
+    CHECK(status.stat == 11 && !status.isRegisteredHome());
+
+    CHECK(registration("+CGREG: ", status) == AtParseResult::Malformed);
+    CHECK(registration("+CGREG: 0", status) == AtParseResult::Malformed);
+    CHECK(registration("+CGREG: 0,", status) == AtParseResult::Malformed);
+    CHECK(registration("+CGREG: ,1", status) == AtParseResult::Malformed);
+    CHECK(registration("+CGREG: 0,\"1\"", status) == AtParseResult::Malformed);
+    CHECK(registration("+CGREG: 0,1x", status) == AtParseResult::Malformed);
+    CHECK(registration("+CGREG: 0,1 ", status) == AtParseResult::Malformed);
+    CHECK(registration("+CREG: 0,1", status) == AtParseResult::Malformed);
+  }
+}
+
+int main() {
+  testClccFields();
+  testClccLongNumber();
+  testClccUnquotedAndEmpty();
+  testClccTrailingGarbage();
+  testClccOutOfRange();
+  testCpas();
+  testRegistration();
+
+  printf("%d failed\n", failures);
+
+  return failures == 0 ? 0 : 1;
+}
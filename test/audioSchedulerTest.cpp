@@ -0,0 +1,177 @@
+// The audio scheduler's bookkeeping of the modem's stop reports, which can come in after the clip
+// that follows the one they belong to has started.
+
+#include "components/audioScheduler.h"
+
+namespace {
+  int failures = 0;
+
+#define CHECK(condition)                                                                          \
+  do {                                                                                             \
+    if (!(condition)) {                                                                            \
+      printf("%s:%d: %s failed\n", __FILE__, __LINE__, #condition);                                \
+      ++failures;                                                                                  \
+    }                                                                                              \
+  } while (false)
+
+  AudioItem mp3(const char *file, const AudioTag tag) {
+    return {AudioType::Mp3, Tone::DialTone, 0, file, 0, tag};
+  }
+
+  AudioItem tone(const Tone toneId, const AudioTag tag) {
+    return {AudioType::Tone, toneId, 0, nullptr, 0, tag};
+  }
+
+  // A prompt plays, and the caller's announcement (also an mp3) preempts it. The prompt's stop
+  // report only comes in once the announcement is playing.
+  void testLateStopAfterPreempt() {
+    AudioScheduler audio;
+
+    audio.enqueue(mp3("prompt.mp3", AudioTag::Prompt));
+    audio.start();
+
+    const uint32_t announcement = audio.enqueue(mp3("caller.mp3", AudioTag::CallerAnnouncement));
+    CHECK(audio.shouldPreempt());
+    audio.preempt();
+    audio.start();
+    CHECK(audio.current().id == announcement);
+
+    CHECK(!audio.onPlaybackStopped(AudioType::Mp3));
+    CHECK(audio.isPlaying());
+    CHECK(audio.current().id == announcement);
+
+    CHECK(audio.onPlaybackStopped(AudioType::Mp3));
+    CHECK(!audio.isPlaying());
+  }
+
+  // Once the modem says the next clip started, the preempted one's report has come and gone.
+  void testStartClearsOwedStops() {
+    AudioScheduler audio;
+
+    audio.enqueue(mp3("prompt.mp3", AudioTag::Prompt));
+    audio.start();
+    audio.enqueue(mp3("caller.mp3", AudioTag::CallerAnnouncement));
+    audio.preempt();
+    audio.start();
+
+    CHECK(!audio.onPlaybackStopped(AudioType::Mp3));
+    audio.onPlaybackStarted(AudioType::Mp3);
+
+    CHECK(audio.onPlaybackStopped(AudioType::Mp3));
+    CHECK(!audio.isPlaying());
+  }
+
+  // The report was lost, or the clip had already ended: the start clears what was owed, so the
+  // announcement's own stop still finishes it.
+  void testStartWithoutLateStop() {
+    AudioScheduler audio;
+
+    audio.enqueue(mp3("prompt.mp3", AudioTag::Prompt));
+    audio.start();
+    audio.enqueue(mp3("caller.mp3", AudioTag::CallerAnnouncement));
+    audio.preempt();
+    audio.start();
+    audio.onPlaybackStarted(AudioType::Mp3);
+
+    CHECK(audio.onPlaybackStopped(AudioType::Mp3));
+  }
+
+  // Each cut short clip owes its own report.
+  void testSeveralPreemptions() {
+    AudioScheduler audio;
+
+    audio.enqueue(mp3("prompt.mp3", AudioTag::Prompt));
+    audio.start();
+    audio.enqueue(mp3("1.mp3", AudioTag::DialedDigit));
+    audio.preempt();
+    audio.start();
+    audio.enqueue(mp3("2.mp3", AudioTag::DialedDigit));
+    CHECK(audio.shouldPreempt());
+    audio.preempt();
+    const uint32_t last = audio.start().id;
+
+    CHECK(!audio.onPlaybackStopped(AudioType::Mp3));
+    CHECK(!audio.onPlaybackStopped(AudioType::Mp3));
+    CHECK(audio.current().id == last);
+    CHECK(audio.onPlaybackStopped(AudioType::Mp3));
+  }
+
+  // A tone's report doesn't touch an mp3, and the other way around.
+  void testOtherTypeStop() {
+    AudioScheduler audio;
+
+    audio.enqueue(tone(Tone::GeneralBeep, AudioTag::Prompt));
+    audio.start();
+    audio.enqueue(mp3("caller.mp3", AudioTag::CallerAnnouncement));
+    audio.preempt();
+    audio.start();
+
+    CHECK(!audio.onPlaybackStopped(AudioType::Tone));
+    CHECK(audio.isPlaying());
+    CHECK(audio.onPlaybackStopped(AudioType::Mp3));
+  }
+
+  // Cancelling the playing clip owes a report too.
+  void testLateStopAfterCancel() {
+    AudioScheduler audio;
+
+    audio.enqueue(mp3("digit.mp3", AudioTag::CallerDigits));
+    audio.start();
+    CHECK(audio.cancel(AudioTag::CallerDigits));
+
+    const uint32_t prompt = audio.enqueue(mp3("prompt.mp3", AudioTag::Prompt));
+    audio.start();
+
+    CHECK(!audio.onPlaybackStopped(AudioType::Mp3));
+    CHECK(audio.current().id == prompt);
+    CHECK(audio.onPlaybackStopped(AudioType::Mp3));
+  }
+
+  // A clip that ends on its own owes nothing.
+  void testNaturalEnd() {
+    AudioScheduler audio;
+
+    audio.enqueue(mp3("1.mp3", AudioTag::Prompt));
+    audio.enqueue(mp3("2.mp3", AudioTag::Prompt));
+    audio.start();
+
+    CHECK(audio.onPlaybackStopped(AudioType::Mp3));
+    audio.start();
+    CHECK(audio.onPlaybackStopped(AudioType::Mp3));
+    CHECK(!audio.onPlaybackStopped(AudioType::Mp3));
+  }
+
+  // The caller's digits are queued one at a time, each once the one before it left the queue.
+  void testIsQueued() {
+    AudioScheduler audio;
+
+    const uint32_t first = audio.enqueue(mp3("dial_0.mp3", AudioTag::CallerDigits));
+    CHECK(audio.isQueued(first));
+
+    audio.start();
+    CHECK(!audio.isQueued(first));
+
+    const uint32_t second = audio.enqueue(mp3("dial_5.mp3", AudioTag::CallerDigits));
+    CHECK(audio.isQueued(second));
+    CHECK(!audio.shouldPreempt());
+
+    audio.cancel(AudioTag::CallerDigits);
+    CHECK(!audio.isQueued(second));
+    CHECK(!audio.isQueued(0));
+  }
+}
+
+int main() {
+  testLateStopAfterPreempt();
+  testStartClearsOwedStops();
+  testStartWithoutLateStop();
+  testSeveralPreemptions();
+  testOtherTypeStop();
+  testLateStopAfterCancel();
+  testNaturalEnd();
+  testIsQueued();
+
+  printf("%d failed\n", failures);
+
+  return failures == 0 ? 0 : 1;
+}
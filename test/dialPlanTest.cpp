@@ -0,0 +1,173 @@
+// Walks the dial plan DFA that phoneBook/generate.py builds from dialPlan.txt, and compares it with
+// the hand written checks it replaced, for every number of up to 10 digits.
+//
+// Past its fourth digit, the old check only looks at the first four digits and the length. So for
+// each four digit prefix, it's enough that every DFA state the longer numbers can reach gives the
+// answer the old check gives for that prefix and length. That covers all 11,111,111,111 numbers
+// without dialing each one.
+
+#include "common/string.h"
+#include "generated/phoneBook.h"
+#include <set>
+
+namespace {
+  const constexpr size_t kMaxDigits = 10;
+  const constexpr size_t kPrefixDigits = 4;
+
+  // validateDialedNumber as it was before the dial plan, with an empty phone book.
+  DialedNumberValidationResult oldValidateDialedNumber(const char *number) {
+    DialedNumberValidationResult res = DialedNumberValidationResult::Invalid;
+    int len = strlen(number);
+
+    if (len == 0) {
+      res = DialedNumberValidationResult::Pending;
+    } else if (number[0] == '0') {
+      if (len < 2) {
+        res = DialedNumberValidationResult::Pending;
+      } else {
+        const char second = number[1];
+
+        if (second == '2' || second == '3' || second == '4' || second == '8' || second == '9') {
+          if (len == 9) {
+            res = DialedNumberValidationResult::Valid;
+          } else if (len < 9) {
+            res = DialedNumberValidationResult::Pending;
+          }
+        } else if (second == '5' || second == '7') {
+          if (len == 10) {
+            res = DialedNumberValidationResult::Valid;
+          } else if (len < 10) {
+            res = DialedNumberValidationResult::Pending;
+          }
+        }
+      }
+    } else if (number[0] == '1') {
+      if (len < 3) {
+        res = DialedNumberValidationResult::Pending;
+      } else {
+        if (strStartsWith(number, "10") || strStartsWith(number, "11")) {
+          if (len == 3) {
+            res = DialedNumberValidationResult::Valid;
+          } else if (len < 3) {
+            res = DialedNumberValidationResult::Pending;
+          }
+        } else if (strStartsWith(number, "12")) {
+          if (strStartsWith(number, "1222")) {
+            if (len == 8) {
+              res = DialedNumberValidationResult::Valid;
+            } else if (len < 8) {
+              res = DialedNumberValidationResult::Pending;
+            }
+          } else {
+            if (len == 4) {
+              res = DialedNumberValidationResult::Valid;
+            } else if (len < 4) {
+              res = DialedNumberValidationResult::Pending;
+            }
+          }
+        } else if (strStartsWith(number, "14")) {
+          if (strStartsWith(number, "145")) {
+            if (len == 3) {
+              res = DialedNumberValidationResult::Pending;
+            } else {
+              if (strStartsWith(number, "1455")) {
+                if (len == 4) {
+                  res = DialedNumberValidationResult::Valid;
+                }
+              }
+            }
+          }
+        } else if (strStartsWith(number, "17")) {
+          if (len == 10) {
+            res = DialedNumberValidationResult::Valid;
+          } else if (len < 10) {
+            res = DialedNumberValidationResult::Pending;
+          }
+        } else if (strStartsWith(number, "18")) {
+          if (len == 10) {
+            res = DialedNumberValidationResult::Valid;
+          } else if (len < 10) {
+            res = DialedNumberValidationResult::Pending;
+          }
+        }
+      }
+    }
+
+    return res;
+  }
+
+  const char *resultName(const DialedNumberValidationResult result) {
+    switch (result) {
+    case DialedNumberValidationResult::Valid:
+      return "Valid";
+    case DialedNumberValidationResult::Pending:
+      return "Pending";
+    case DialedNumberValidationResult::Invalid:
+    default:
+      return "Invalid";
+    }
+  }
+
+  size_t failures = 0;
+  size_t checks = 0;
+
+  void check(const uint16_t state, const char *number) {
+    const DialedNumberValidationResult expected = oldValidateDialedNumber(number);
+    const DialedNumberValidationResult actual = dialPlanStates[state].result;
+
+    ++checks;
+
+    if (actual != expected && ++failures <= 20) {
+      printf("%s: dial plan says %s, was %s\n", number, resultName(actual), resultName(expected));
+    }
+  }
+
+  // The longer numbers of a prefix: the digits after it only matter through the state they reach.
+  void checkLongerNumbers(const uint16_t prefixState, char *number) {
+    std::set<uint16_t> states = {prefixState};
+
+    for (size_t length = kPrefixDigits + 1; length <= kMaxDigits; length++) {
+      std::set<uint16_t> next;
+
+      for (const uint16_t state : states) {
+        for (int digit = 0; digit < 10; digit++) {
+          next.insert(dialPlanStates[state].next[digit]);
+        }
+      }
+
+      states.swap(next);
+
+      // Any digits do, the old check only reads the length past the prefix.
+      number[length - 1] = '0';
+      number[length] = '\0';
+
+      for (const uint16_t state : states) {
+        check(state, number);
+      }
+    }
+  }
+
+  void checkNumbers(const uint16_t state, char *number, const size_t length) {
+    number[length] = '\0';
+    check(state, number);
+
+    if (length == kPrefixDigits) {
+      checkLongerNumbers(state, number);
+      return;
+    }
+
+    for (int digit = 0; digit < 10; digit++) {
+      number[length] = '0' + digit;
+      checkNumbers(dialPlanStates[state].next[digit], number, length + 1);
+    }
+  }
+}
+
+int main() {
+  char number[kMaxDigits + 1];
+  checkNumbers(0, number, 0);
+
+  printf("%zu states checked, %zu failed\n", checks, failures);
+
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,131 @@
+// The uploader's MP3 blob and index, as mp3/generate.py writes them for the library mp3Library.py
+// makes: each listed clip is its source file byte for byte, with that file's hash, and a clip used
+// under several names is only stored once.
+
+#include "mp3/generated/writeMp3.h"
+#include <dirent.h>
+#include <string>
+#include <vector>
+
+namespace {
+  int failures = 0;
+
+#define CHECK(condition)                                                                          \
+  do {                                                                                             \
+    if (!(condition)) {                                                                            \
+      printf("%s:%d: %s failed\n", __FILE__, __LINE__, #condition);                                \
+      ++failures;                                                                                  \
+    }                                                                                              \
+  } while (false)
+
+  std::string readFile(const std::string &path) {
+    std::string data;
+    FILE *file = fopen(path.c_str(), "rb");
+
+    if (file == nullptr) {
+      printf("Can't open %s\n", path.c_str());
+      ++failures;
+      return data;
+    }
+
+    char buffer[4096];
+    size_t read;
+
+    while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+      data.append(buffer, read);
+    }
+
+    fclose(file);
+    return data;
+  }
+
+  std::vector<std::string> listMp3s(const std::string &folder) {
+    std::vector<std::string> names;
+    DIR *dir = opendir(folder.c_str());
+
+    if (dir == nullptr) {
+      return names;
+    }
+
+    while (const dirent *entry = readdir(dir)) {
+      const std::string name = entry->d_name;
+
+      if (name.size() > 4 && name.compare(name.size() - 4, 4, ".mp3") == 0) {
+        names.push_back(name);
+      }
+    }
+
+    closedir(dir);
+    return names;
+  }
+
+  // As fnv1a32() in generate.py.
+  uint32_t fnv1a32(const std::string &data) {
+    uint32_t value = 0x811C9DC5u;
+
+    for (const char c : data) {
+      value = (value ^ static_cast<uint8_t>(c)) * 0x01000193u;
+    }
+
+    return value;
+  }
+
+  std::string blobData(const MP3File &file) {
+    return std::string(reinterpret_cast<const char *>(getMp3Data(file)), file.length);
+  }
+
+  void testClipsMatchSources(const std::string &lib) {
+    for (unsigned int i = 0; i < mp3FilesCount; i++) {
+      const MP3File &file = mp3Files[i];
+      const std::string source = readFile(lib + "/" + file.fileName);
+
+      CHECK(blobData(file) == source);
+      CHECK(file.hash == fnv1a32(source));
+    }
+  }
+
+  void testClipsStoredOnce() {
+    for (unsigned int i = 0; i < mp3FilesCount; i++) {
+      for (unsigned int j = i + 1; j < mp3FilesCount; j++) {
+        CHECK(blobData(mp3Files[i]) != blobData(mp3Files[j]));
+      }
+    }
+  }
+
+  // Every file in the library is in the blob, under its own name or another with the same clip.
+  void testEveryFileListed(const std::string &lib) {
+    const std::vector<std::string> names = listMp3s(lib);
+    CHECK(names.size() > mp3FilesCount);
+
+    for (const std::string &name : names) {
+      const std::string source = readFile(lib + "/" + name);
+      bool found = false;
+
+      for (unsigned int i = 0; i < mp3FilesCount && !found; i++) {
+        found = blobData(mp3Files[i]) == source;
+      }
+
+      if (!found) {
+        printf("%s isn't in the blob\n", name.c_str());
+        ++failures;
+      }
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  if (argc != 2) {
+    printf("Usage: %s <library folder>\n", argv[0]);
+    return 2;
+  }
+
+  const std::string lib = argv[1];
+
+  testClipsMatchSources(lib);
+  testClipsStoredOnce();
+  testEveryFileListed(lib);
+
+  printf("%u clips, %d failed\n", mp3FilesCount, failures);
+
+  return failures == 0 ? 0 : 1;
+}
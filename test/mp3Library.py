@@ -0,0 +1,89 @@
+#!/usr/bin/env python3
+"""Writes a small MP3 library for mp3/generate.py to build from, and what the tests expect of it.
+
+<dir>/lib holds the clips and <dir>/numbers.txt maps call numbers to them, the way mp3/ has them
+next to generate.py. <dir>/expected/dial_<n>.frames is each digit clip without its tags and
+Xing frame. The clips are made up frames, generate.py only reads their headers.
+"""
+import argparse
+import os
+
+# MPEG2 layer III, 32 kbps, 16 kHz, no padding: 144 byte frames.
+FRAME_HEADER = bytes([0xFF, 0xF3, 0x48, 0xC4])
+FRAME_LENGTH = 144
+
+
+def frame(seed, index):
+    payload = bytes((seed * 31 + index * 7 + i) & 0xFF for i in range(FRAME_LENGTH - 4))
+    return FRAME_HEADER + payload
+
+
+def frames(seed, count):
+    return b"".join(frame(seed, i) for i in range(count))
+
+
+def xing_frame():
+    return (FRAME_HEADER + bytes(32) + b"Xing").ljust(FRAME_LENGTH, b"\0")
+
+
+def id3v2(seed, footer=False):
+    """An ID3v2 tag, with its size written as a syncsafe integer."""
+    body = bytes((seed + i) & 0x7F for i in range(200 + seed))
+    size = bytes((len(body) >> shift) & 0x7F for shift in (21, 14, 7, 0))
+    flags = 0x10 if footer else 0
+    tag = b"ID3" + bytes([4, 0, flags]) + size + body
+    return tag + (b"3DI" + bytes([4, 0, flags]) + size if footer else b"")
+
+
+def id3v1(seed):
+    return (b"TAG" + b"Digit %d" % seed).ljust(128, b"\0")
+
+
+def digit_clip(digit):
+    """The digits vary in the tags around their frames, which generate.py has to strip."""
+    audio = frames(digit, digit + 1)
+    data = id3v2(digit, footer=digit == 7)
+    if digit % 2 == 0:
+        data += xing_frame()
+    data += audio
+    if digit % 3 == 0:
+        data += id3v1(digit)
+    return data, audio
+
+
+def write(path, data):
+    with open(path, "wb") as f:
+        f.write(data)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("folder", help="Folder to write the library to")
+    args = parser.parse_args()
+
+    lib = os.path.join(args.folder, "lib")
+    expected = os.path.join(args.folder, "expected")
+    os.makedirs(lib, exist_ok=True)
+    os.makedirs(expected, exist_ok=True)
+
+    for digit in range(10):
+        data, audio = digit_clip(digit)
+        write(os.path.join(lib, f"dial_{digit}.mp3"), data)
+        write(os.path.join(expected, f"dial_{digit}.frames"), audio)
+
+    # call_mom is the same clip as call_dad, and state_ready the same as dial_3.
+    call = id3v2(20) + frames(20, 6)
+    write(os.path.join(lib, "call_dad.mp3"), call)
+    write(os.path.join(lib, "call_mom.mp3"), call)
+    write(os.path.join(lib, "dial_error.mp3"), frames(30, 3))
+    write(os.path.join(lib, "state_ready.mp3"), digit_clip(3)[0])
+
+    with open(os.path.join(args.folder, "numbers.txt"), "w") as f:
+        f.write("111,call_dad\n")
+        f.write("+972 54-222-3333,call_mom\n")
+        f.write("00972-3-1234567,dial_error\n")
+        f.write("555,no_such_clip\n")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,100 @@
+// The main app's side of mp3/generate.py, for the library mp3Library.py makes: the digit clips'
+// frames that caller announcements are rendered from, the names of shared clips, and the caller
+// lookup.
+
+#include "mp3/main/mp3.h"
+#include <string>
+
+namespace {
+  int failures = 0;
+
+#define CHECK(condition)                                                                          \
+  do {                                                                                             \
+    if (!(condition)) {                                                                            \
+      printf("%s:%d: %s failed\n", __FILE__, __LINE__, #condition);                                \
+      ++failures;                                                                                  \
+    }                                                                                              \
+  } while (false)
+
+  std::string readFile(const std::string &path) {
+    std::string data;
+    FILE *file = fopen(path.c_str(), "rb");
+
+    if (file == nullptr) {
+      printf("Can't open %s\n", path.c_str());
+      ++failures;
+      return data;
+    }
+
+    char buffer[4096];
+    size_t read;
+
+    while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+      data.append(buffer, read);
+    }
+
+    fclose(file);
+    return data;
+  }
+
+  bool isFile(const char *actual, const char *expected) {
+    return actual != nullptr && strcmp(actual, expected) == 0;
+  }
+
+  // Tags and the Xing frame are gone, so the digits can be played back to back as one MP3.
+  void testDigitFrames(const std::string &expected) {
+    for (int digit = 0; digit < 10; digit++) {
+      const std::string frames =
+          readFile(expected + "/dial_" + std::to_string(digit) + ".frames");
+      const std::string data(reinterpret_cast<const char *>(dialedDigitsMp3Data[digit]),
+                             dialedDigitsMp3Lengths[digit]);
+
+      CHECK(data == frames);
+      CHECK(isFile(dialedDigitsToMp3s[digit],
+                   ("dial_" + std::to_string(digit) + ".mp3").c_str()));
+    }
+  }
+
+  // A name whose clip is already in the library plays the file that holds it.
+  void testSharedClips() {
+    CHECK(isFile(call_mom, "call_dad.mp3"));
+    CHECK(isFile(state_ready, "dial_3.mp3"));
+    CHECK(isFile(dial_error, "dial_error.mp3"));
+
+    for (unsigned int i = 0; i < mp3FilesCount; i++) {
+      CHECK(strcmp(mp3Files[i], "call_mom.mp3") != 0);
+      CHECK(strcmp(mp3Files[i], "state_ready.mp3") != 0);
+    }
+  }
+
+  // numbers.txt lists numbers in any format, and callers come in either.
+  void testCallerLookup() {
+    CHECK(isFile(lookupCallerMp3("111"), "call_dad.mp3"));
+    CHECK(isFile(lookupCallerMp3("0542223333"), "call_dad.mp3"));
+    CHECK(isFile(lookupCallerMp3("+972542223333"), "call_dad.mp3"));
+    CHECK(isFile(lookupCallerMp3("031234567"), "dial_error.mp3"));
+    CHECK(isFile(lookupCallerMp3("+97231234567"), "dial_error.mp3"));
+    CHECK(isFile(lookupCallerMp3("0097231234567"), "dial_error.mp3"));
+
+    // A number whose clip isn't in the library, and ones that aren't listed.
+    CHECK(lookupCallerMp3("555") == nullptr);
+    CHECK(lookupCallerMp3("112") == nullptr);
+    CHECK(lookupCallerMp3("+442079460000") == nullptr);
+    CHECK(lookupCallerMp3("") == nullptr);
+  }
+}
+
+int main(int argc, char **argv) {
+  if (argc != 2) {
+    printf("Usage: %s <expected folder>\n", argv[0]);
+    return 2;
+  }
+
+  testDigitFrames(argv[1]);
+  testSharedClips();
+  testCallerLookup();
+
+  printf("%d failed\n", failures);
+
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,466 @@
+#!/usr/bin/env python3
+"""Runs mp3/stream.py against a model of the uploader's host stream (mp3/hostStream.cpp) over a
+pseudo-terminal, with frames corrupted or lost on the way in both directions and modem writes that
+fail.
+
+No board or pyserial needed: the host end of the pty stands in for the serial port.
+"""
+import contextlib
+import fcntl
+import io
+import os
+import select
+import struct
+import sys
+import tempfile
+import termios
+import threading
+import tty
+import unittest
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "mp3"))
+
+import stream  # noqa: E402
+from generate import fnv1a32  # noqa: E402
+
+# As in hostStream.cpp.
+FRAME_MAX_PAYLOAD = 1024
+WRITE_BUFFER_SIZE = 4096
+MAX_FILE_NAME = 47
+MP3_DIR = "C:/mp3"
+
+NAK_UNKNOWN_TYPE, NAK_BAD_REQUEST, NAK_NO_FILE, NAK_MODEM_ERROR = range(1, 5)
+
+# Short, so lost replies cost little. The device answers in well under a millisecond here.
+LINK_TIMEOUT = 0.2
+LINK_RETRIES = 5
+
+
+class PtyPort:
+    """The host end of the pty, with the part of pyserial's Serial that stream.Link uses."""
+
+    def __init__(self, fd):
+        self.fd = fd
+
+    @property
+    def in_waiting(self):
+        return struct.unpack("i", fcntl.ioctl(self.fd, termios.FIONREAD, b"\0" * 4))[0]
+
+    def read(self, size):
+        ready, _, _ = select.select([self.fd], [], [], 0.05)
+        return os.read(self.fd, size) if ready else b""
+
+    def write(self, data):
+        view = memoryview(data)
+        while view:
+            view = view[os.write(self.fd, view):]
+
+
+class Faults:
+    """What goes wrong, counted from 1 over the frames the device received or sent."""
+
+    def __init__(self, corrupt_requests=(), corrupt_replies=(), drop_replies=(), failed_writes=()):
+        self.corrupt_requests = set(corrupt_requests)
+        self.corrupt_replies = set(corrupt_replies)
+        self.drop_replies = set(drop_replies)
+        # File names whose first modem write fails.
+        self.failed_writes = set(failed_writes)
+
+
+class DeviceModel:
+    """The device side of the host stream, as hostStream.cpp implements it, on the other end of the
+    pty. The modem's filesystem is a dict of full paths to contents."""
+
+    def __init__(self, fd, faults=None):
+        self.fd = fd
+        self.faults = faults or Faults()
+        self.files = {}
+        self.stopping = threading.Event()
+
+        self.rx_frame = bytearray()
+        self.rx_in_frame = False
+        self.rx_previous = 0
+
+        self.session_active = False
+        self.last_reply = None
+        self.last_seq = 0
+
+        self.handle = None
+        self.read_offset = 0
+        self.write_buffer = bytearray()
+
+        self.frames_received = 0
+        self.replies_sent = 0
+        self.bad_crcs = 0
+        self.replays = 0
+        self.modem_writes = {}
+
+        self.thread = threading.Thread(target=self._run, daemon=True)
+
+    def start(self):
+        self.thread.start()
+
+    def _run(self):
+        while not self.stopping.is_set():
+            ready, _, _ = select.select([self.fd], [], [], 0.02)
+            if not ready:
+                continue
+            try:
+                data = os.read(self.fd, 4096)
+            except OSError:
+                return
+            for byte in data:
+                frame = self._receive(byte)
+                if frame is not None:
+                    self._handle(*frame)
+
+    def stop(self):
+        self.stopping.set()
+        self.thread.join()
+
+    def _log(self, text):
+        # Logs share the port with the frames, as plain text.
+        self._send(f"[INFO] 0 {text}\n".encode())
+
+    def _send(self, data):
+        view = memoryview(data)
+        while view:
+            view = view[os.write(self.fd, view):]
+
+    def _receive(self, byte):
+        """receiveFrame(), one byte at a time."""
+        if not self.rx_in_frame:
+            self.rx_in_frame = self.rx_previous == stream.SOF[0] and byte == stream.SOF[1]
+            self.rx_previous = byte
+            self.rx_frame.clear()
+            return None
+
+        self.rx_frame.append(byte)
+        if len(self.rx_frame) < stream.HEADER.size:
+            return None
+
+        frame_type, seq, length = stream.HEADER.unpack_from(self.rx_frame)
+        if length > FRAME_MAX_PAYLOAD:
+            self._log(f"Dropping frame with a {length} byte payload")
+            self.rx_in_frame = False
+            self.rx_previous = 0
+            return None
+        if len(self.rx_frame) < stream.HEADER.size + length + 2:
+            return None
+
+        self.rx_in_frame = False
+        self.rx_previous = 0
+        self.frames_received += 1
+
+        body = bytearray(self.rx_frame[:stream.HEADER.size + length])
+        if self.frames_received in self.faults.corrupt_requests:
+            body[-1] ^= 0x40
+        (crc,) = struct.unpack_from("<H", self.rx_frame, stream.HEADER.size + length)
+        if stream.crc16(body) != crc:
+            self.bad_crcs += 1
+            self._log("Dropping frame with a bad CRC")
+            return None
+
+        return frame_type, seq, bytes(body[stream.HEADER.size:])
+
+    def _reply(self, frame_type, seq, payload=b""):
+        self.last_reply = stream.encode_frame(frame_type, seq, payload)
+        self.last_seq = seq
+        self._write_reply(self.last_reply)
+
+    def _write_reply(self, frame):
+        self.replies_sent += 1
+        if self.replies_sent in self.faults.drop_replies:
+            return
+        if self.replies_sent in self.faults.corrupt_replies:
+            frame = bytearray(frame)
+            frame[-1] ^= 0x01
+        self._send(bytes(frame))
+
+    def _ack(self, seq, payload=b""):
+        self._reply(stream.ACK, seq, payload)
+
+    def _nak(self, seq, reason):
+        self._reply(stream.NAK, seq, bytes([reason]))
+
+    def _handle(self, frame_type, seq, payload):
+        if frame_type != stream.HELLO and not self.session_active:
+            self._nak(seq, NAK_BAD_REQUEST)
+            return
+
+        if frame_type != stream.HELLO and self.last_reply is not None and seq == self.last_seq:
+            self.replays += 1
+            self._write_reply(self.last_reply)
+            return
+
+        handlers = {
+            stream.HELLO: self._hello,
+            stream.OPEN: self._open,
+            stream.WRITE: self._write,
+            stream.READ: self._read,
+            stream.CLOSE: self._close,
+            stream.DELETE: self._delete,
+            stream.SIZE: self._size,
+            stream.BYE: self._bye,
+        }
+        handler = handlers.get(frame_type)
+        if handler is None:
+            self._nak(seq, NAK_UNKNOWN_TYPE)
+        else:
+            handler(seq, payload)
+
+    def _full_path(self, name):
+        if not name or len(name) > MAX_FILE_NAME or b"/" in name:
+            return None
+        return MP3_DIR + "/" + name.decode()
+
+    def _flush(self):
+        if not self.write_buffer:
+            return True
+        path = self.handle
+        name = path.rsplit("/", 1)[1]
+        self.modem_writes[name] = self.modem_writes.get(name, 0) + 1
+        data = bytes(self.write_buffer)
+        self.write_buffer.clear()
+        if name in self.faults.failed_writes:
+            self.faults.failed_writes.discard(name)
+            return False
+        self.files[path] += data
+        return True
+
+    def _close_current(self):
+        if self.handle is None:
+            return True
+        flushed = self._flush()
+        self.handle = None
+        return flushed
+
+    def _hello(self, seq, payload):
+        if not self.session_active:
+            self._log("Host stream session started")
+            self.session_active = True
+        elif not self._close_current():
+            self._log("Failed to close the open file")
+        self._ack(seq, struct.pack("<BHH", stream.PROTOCOL_VERSION, FRAME_MAX_PAYLOAD,
+                                   WRITE_BUFFER_SIZE))
+
+    def _open(self, seq, payload):
+        path = self._full_path(payload[1:]) if len(payload) >= 2 else None
+        if path is None:
+            self._nak(seq, NAK_BAD_REQUEST)
+            return
+        self._close_current()
+        if payload[0] == stream.MODE_EXISTING and path not in self.files:
+            self._nak(seq, NAK_MODEM_ERROR)
+            return
+        if payload[0] == stream.MODE_TRUNCATE:
+            self.files[path] = b""
+        self.handle = path
+        self.read_offset = 0
+        self._ack(seq)
+
+    def _write(self, seq, payload):
+        if self.handle is None:
+            self._nak(seq, NAK_NO_FILE)
+            return
+        offset = 0
+        while offset < len(payload):
+            chunk = payload[offset:offset + WRITE_BUFFER_SIZE - len(self.write_buffer)]
+            self.write_buffer += chunk
+            offset += len(chunk)
+            if len(self.write_buffer) == WRITE_BUFFER_SIZE and not self._flush():
+                self._nak(seq, NAK_MODEM_ERROR)
+                return
+        self._ack(seq)
+
+    def _read(self, seq, payload):
+        if len(payload) != 2:
+            self._nak(seq, NAK_BAD_REQUEST)
+            return
+        if self.handle is None:
+            self._nak(seq, NAK_NO_FILE)
+            return
+        (wanted,) = struct.unpack("<H", payload)
+        data = self.files[self.handle][self.read_offset:self.read_offset +
+                                       min(wanted, FRAME_MAX_PAYLOAD)]
+        self.read_offset += len(data)
+        self._ack(seq, data)
+
+    def _close(self, seq, payload):
+        if self.handle is None:
+            self._nak(seq, NAK_NO_FILE)
+            return
+        if not self._close_current():
+            self._nak(seq, NAK_MODEM_ERROR)
+            return
+        self._ack(seq)
+
+    def _delete(self, seq, payload):
+        path = self._full_path(payload)
+        if path is None:
+            self._nak(seq, NAK_BAD_REQUEST)
+            return
+        if self.files.pop(path, None) is None:
+            self._nak(seq, NAK_MODEM_ERROR)
+            return
+        self._ack(seq)
+
+    def _size(self, seq, payload):
+        path = self._full_path(payload)
+        if path is None:
+            self._nak(seq, NAK_BAD_REQUEST)
+            return
+        self._ack(seq, struct.pack("<i", len(self.files[path]) if path in self.files else -1))
+
+    def _bye(self, seq, payload):
+        self._ack(seq)
+        self._close_current()
+        self.session_active = False
+        self.last_reply = None
+        self._log("Host stream session ended")
+
+
+class StreamTest(unittest.TestCase):
+    # Sizes around the frame and write buffer boundaries, and one clip under two names.
+    CLIPS = {
+        "call_dad.mp3": 9000,
+        "call_mom.mp3": "call_dad.mp3",
+        "dial_0.mp3": 1,
+        "dial_1.mp3": FRAME_MAX_PAYLOAD,
+        "dial_2.mp3": WRITE_BUFFER_SIZE,
+        "dial_3.mp3": WRITE_BUFFER_SIZE + 1,
+        "state_ready.mp3": 300,
+    }
+    UNIQUE = [name for name, size in CLIPS.items() if isinstance(size, int)]
+
+    def setUp(self):
+        self.folder = tempfile.TemporaryDirectory()
+        self.library = {}
+        for index, (name, size) in enumerate(self.CLIPS.items()):
+            data = self.library[size] if isinstance(size, str) else bytes(
+                (index * 7 + i * 13) & 0xFF for i in range(size))
+            self.library[name] = data
+            with open(os.path.join(self.folder.name, name), "wb") as f:
+                f.write(data)
+
+        self.host_fd, device_fd = os.openpty()
+        tty.setraw(self.host_fd)
+        self.device_fd = device_fd
+        self.device = None
+
+    def tearDown(self):
+        if self.device is not None:
+            self.device.stop()
+        os.close(self.host_fd)
+        os.close(self.device_fd)
+        self.folder.cleanup()
+
+    def start_device(self, faults=None, files=None):
+        if self.device is not None:
+            self.device.stop()
+        self.device = DeviceModel(self.device_fd, faults)
+        if files is not None:
+            self.device.files = files
+        self.device.start()
+        return self.device
+
+    def sync(self):
+        link = stream.Link(PtyPort(self.host_fd), LINK_TIMEOUT, LINK_RETRIES, verbose=False)
+        output = io.StringIO()
+        with contextlib.redirect_stdout(output):
+            ok = stream.sync(link, self.folder.name)
+        return ok, output.getvalue()
+
+    def manifest(self):
+        text = self.device.files.get(MP3_DIR + "/" + stream.MANIFEST_FILE, b"").decode()
+        return stream.parse_manifest(text)
+
+    def assert_uploaded(self, names):
+        for name in names:
+            self.assertEqual(self.device.files.get(MP3_DIR + "/" + name), self.library[name], name)
+            self.assertEqual(self.manifest().get(name),
+                             (len(self.library[name]), fnv1a32(self.library[name])), name)
+
+    def test_upload(self):
+        device = self.start_device()
+        ok, output = self.sync()
+
+        self.assertTrue(ok, output)
+        self.assert_uploaded(self.UNIQUE)
+        # The second name of a clip is never sent.
+        self.assertNotIn(MP3_DIR + "/call_mom.mp3", device.files)
+        self.assertEqual(sorted(self.manifest()), sorted(self.UNIQUE))
+        self.assertEqual(device.bad_crcs, 0)
+        self.assertEqual(device.replays, 0)
+
+    def test_nothing_changed(self):
+        self.start_device()
+        self.assertTrue(self.sync()[0])
+
+        device = self.start_device(files=self.device.files)
+        ok, output = self.sync()
+
+        self.assertTrue(ok, output)
+        self.assertEqual(output.count(" unchanged\n"), len(self.UNIQUE))
+        self.assertEqual(set(device.modem_writes), {stream.MANIFEST_FILE})
+
+    def test_stale_file_deleted(self):
+        self.start_device()
+        self.assertTrue(self.sync()[0])
+
+        os.remove(os.path.join(self.folder.name, "state_ready.mp3"))
+        ok, output = self.sync()
+
+        self.assertTrue(ok, output)
+        self.assertNotIn(MP3_DIR + "/state_ready.mp3", self.device.files)
+        self.assertNotIn("state_ready.mp3", self.manifest())
+
+    # A request that arrives damaged is dropped and resent. A reply that arrives damaged or not at
+    # all makes the host resend with the same seq, which the device must answer from its last
+    # reply without running the request again: a write run twice would show in the contents.
+    def test_line_noise(self):
+        device = self.start_device(Faults(corrupt_requests={3, 8, 15, 22},
+                                          corrupt_replies={4, 12, 20},
+                                          drop_replies={6, 17}))
+        ok, output = self.sync()
+
+        self.assertTrue(ok, output)
+        self.assert_uploaded(self.UNIQUE)
+        self.assertEqual(device.bad_crcs, 4)
+        self.assertEqual(device.replays, 5)
+
+    # A flush that fails is a NAK, on the WRITE that filled the buffer or on the CLOSE that wrote
+    # the rest. The file is reported and left out of the manifest, so the next run sends it again.
+    def test_failed_flush(self):
+        device = self.start_device(Faults(failed_writes={"call_dad.mp3", "dial_0.mp3"}))
+        ok, output = self.sync()
+
+        self.assertFalse(ok)
+        self.assertIn("Write file failed for call_dad.mp3: modem error", output)
+        self.assertIn("Write file failed for dial_0.mp3: modem error", output)
+        self.assertNotIn("call_dad.mp3", self.manifest())
+        self.assertNotIn("dial_0.mp3", self.manifest())
+        self.assert_uploaded([name for name in self.UNIQUE
+                              if name not in ("call_dad.mp3", "dial_0.mp3")])
+
+        device.modem_writes.clear()
+        ok, output = self.sync()
+
+        self.assertTrue(ok, output)
+        self.assert_uploaded(self.UNIQUE)
+        self.assertEqual(set(device.modem_writes),
+                         {"call_dad.mp3", "dial_0.mp3", stream.MANIFEST_FILE})
+
+    def test_no_reply(self):
+        self.start_device(Faults(drop_replies=set(range(2, 2 + LINK_RETRIES + 1))))
+        link = stream.Link(PtyPort(self.host_fd), LINK_TIMEOUT, LINK_RETRIES, verbose=False)
+        link.hello()
+
+        with self.assertRaisesRegex(stream.StreamError, "no reply"):
+            link.file_size(stream.MANIFEST_FILE)
+
+
+if __name__ == "__main__":
+    # Keeps the resends of frames that make the device write to the modem quick as well.
+    stream.MODEM_WRITE_TIMEOUT = LINK_TIMEOUT
+    unittest.main()
@@ -0,0 +1,89 @@
+#pragma once
+
+// Just enough of the Arduino core and FreeRTOS for the host tests. millis() is a counter the tests
+// move by hand, and Serial prints to stdout.
+
+#include <cctype>
+#include <cstdarg>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+class __FlashStringHelper;
+
+#define PROGMEM
+#define PGM_P const char *
+#define PSTR(s) (s)
+#define F(s) (reinterpret_cast<const __FlashStringHelper *>(PSTR(s)))
+#define snprintf_P snprintf
+#define vsnprintf_P vsnprintf
+#define strlen_P strlen
+
+// Pin levels, for config.h.
+#define LOW 0x0
+#define HIGH 0x1
+
+extern uint32_t hostMillis;
+
+inline uint32_t millis() {
+  return hostMillis;
+}
+
+class Print {
+public:
+  virtual ~Print() = default;
+
+  virtual size_t write(const uint8_t *data, const size_t size) {
+    return fwrite(data, 1, size, stdout);
+  }
+
+  size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3))) {
+    va_list args;
+    va_start(args, format);
+    const int length = vprintf(format, args);
+    va_end(args);
+    return length < 0 ? 0 : length;
+  }
+
+  void flush() {
+    fflush(stdout);
+  }
+};
+
+extern Print Serial;
+
+// FreeRTOS, for the logger. The tests never start its task, so records are printed right away.
+using UBaseType_t = unsigned int;
+using TickType_t = uint32_t;
+using SemaphoreHandle_t = void *;
+
+#define tskIDLE_PRIORITY 0
+#define tskNO_AFFINITY 0x7FFFFFFF
+#define portMAX_DELAY 0xFFFFFFFF
+#define pdMS_TO_TICKS(ms) (ms)
+
+inline SemaphoreHandle_t xSemaphoreCreateMutex() {
+  return nullptr;
+}
+
+inline int xSemaphoreTake(SemaphoreHandle_t, TickType_t) {
+  return 1;
+}
+
+inline int xSemaphoreGive(SemaphoreHandle_t) {
+  return 1;
+}
+
+inline void vTaskDelay(TickType_t) {}
+
+inline int xTaskCreatePinnedToCore(void (*)(void *),
+                                   const char *,
+                                   uint32_t,
+                                   void *,
+                                   UBaseType_t,
+                                   void *,
+                                   int) {
+  return 1;
+}
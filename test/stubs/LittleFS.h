@@ -0,0 +1,55 @@
+#pragma once
+
+// A LittleFS with nothing on it, for the phone book store. Writes fail, so it keeps the built-in
+// phone book.
+
+#include "Arduino.h"
+
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+
+class File {
+public:
+  size_t size() const {
+    return 0;
+  }
+
+  size_t read(uint8_t *, const size_t) {
+    return 0;
+  }
+
+  size_t write(const uint8_t *, const size_t) {
+    return 0;
+  }
+
+  void close() {}
+
+  explicit operator bool() const {
+    return false;
+  }
+};
+
+class LittleFSFS {
+public:
+  bool begin(const bool) {
+    return true;
+  }
+
+  bool exists(const char *) {
+    return false;
+  }
+
+  File open(const char *, const char *) {
+    return File();
+  }
+
+  bool remove(const char *) {
+    return false;
+  }
+
+  bool rename(const char *, const char *) {
+    return false;
+  }
+};
+
+extern LittleFSFS LittleFS;
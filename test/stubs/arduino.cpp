@@ -0,0 +1,8 @@
+#include <Arduino.h>
+#include <LittleFS.h>
+
+uint32_t hostMillis = 0;
+
+Print Serial;
+
+LittleFSFS LittleFS;
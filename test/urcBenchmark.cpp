@@ -0,0 +1,197 @@
+// Times classifyUrc against the chain of strEqual/strStartsWith checks it replaced, over the lines
+// the modem sent during a call: boot, registration, an incoming call answered with a greeting, a
+// tone and a hang up. Also checks that both give the same answer for every line the old chain
+// knew.
+//
+// urcBenchmark [passes over the mix]
+
+#include "common/string.h"
+#include "common/urc.h"
+#include <chrono>
+
+namespace {
+  const constexpr unsigned long kDefaultPasses = 200000;
+
+  const char *const kRecordedUrcs[] = {
+      "ATE0",
+      "OK",
+      "+CPIN: READY",
+      "SMS DONE",
+      "PB DONE",
+      "+CSMS: 1,1,1",
+      "OK",
+      "+CGREG: 0,2",
+      "+CGREG: 0,1",
+      "OK",
+      "+CPAS: 0",
+      "OK",
+      "RING",
+      "+CLCC: 1,1,4,0,0,\"0541234567\",129,\"\"",
+      "OK",
+      "RING",
+      "+CLCC: 1,1,4,0,0,\"0541234567\",129,\"\"",
+      "OK",
+      "+CPAS: 3",
+      "OK",
+      "VOICE CALL: BEGIN",
+      "+CLCC: 1,1,0,0,0,\"0541234567\",129,\"\"",
+      "OK",
+      "+CCMXPLAY:",
+      "OK",
+      "+AUDIOSTATE: audio play",
+      "+CLCC: 1,1,0,0,0,\"0541234567\",129,\"\"",
+      "OK",
+      "+AUDIOSTATE: audio play stop",
+      "OK",
+      "+STTONE: 0",
+      "+CCWA: \"0521112222\",129,1",
+      "+CLCC: 1,1,0,0,0,\"0541234567\",129,\"\"",
+      "+CLCC: 2,1,5,0,0,\"0521112222\",129,\"\"",
+      "OK",
+      "+CCMXSTOP:",
+      "+AUDIOSTATE: audio stop",
+      "VOICE CALL: END: 000042",
+      "NO CARRIER",
+      "+CLCC: 1,1,6,0,0,\"0541234567\",129,\"\"",
+      "OK",
+      "+CPAS: 0",
+      "OK",
+      "+CME ERROR: 3",
+      "ERROR",
+      "+CSQ: 21,99",
+      "+CPIN: SIM REMOVED",
+  };
+
+  // The classification as it was before classifyUrc: the known messages first, then the handled
+  // ones in the order the message processing tested them.
+  UrcType classifyWithPrefixChain(const char *message) {
+    static const char *const kKnownMessages[] = {
+        "ATE0",
+        "+CCMXPLAY:",
+        "+CCMXSTOP:",
+        "+CSMS: 1,1,1",
+        "NO CARRIER",
+        "+CPIN: READY",
+        "SMS DONE",
+        "PB DONE",
+        "+CPIN: SIM REMOVED",
+    };
+
+    for (const char *known : kKnownMessages) {
+      if (strEqual(message, known)) {
+        return UrcType::Ignored;
+      }
+    }
+
+    if (strStartsWith(message, "VOICE CALL:") || strStartsWith(message, "+CCWA")) {
+      return UrcType::Ignored;
+    }
+
+    if (strEqual(message, "OK")) {
+      return UrcType::Ok;
+    }
+
+    if (strStartsWith(message, "+CGREG")) {
+      return UrcType::Registration;
+    }
+
+    if (strStartsWith(message, "+CLCC")) {
+      return UrcType::CallList;
+    }
+
+    if (strStartsWith(message, "RING")) {
+      return UrcType::Ring;
+    }
+
+    if (strStartsWith(message, "+CPAS")) {
+      return UrcType::PhoneActivity;
+    }
+
+    if (strStartsWith(message, "+AUDIOSTATE: ")) {
+      if (strEqual(message, "+AUDIOSTATE: audio play stop")) {
+        return UrcType::AudioStopped;
+      }
+
+      if (strEqual(message, "+AUDIOSTATE: audio play")) {
+        return UrcType::AudioPlaying;
+      }
+
+      return UrcType::AudioStateOther;
+    }
+
+    if (strEqual(message, "+STTONE: 0")) {
+      return UrcType::ToneStopped;
+    }
+
+    return UrcType::Unknown;
+  }
+
+  // Lines the old chain had no name for: NO CARRIER and the SIM's state were ignored, and command
+  // results weren't classified at all.
+  bool isNewerType(const UrcType type) {
+    switch (type) {
+    case UrcType::Error:
+    case UrcType::CmeError:
+    case UrcType::NoCarrier:
+    case UrcType::Connect:
+    case UrcType::FileOpened:
+    case UrcType::Iccid:
+    case UrcType::SimStorage:
+    case UrcType::SimContact:
+    case UrcType::SimState:
+      return true;
+    default:
+      return false;
+    }
+  }
+
+  template <typename Classifier>
+  double nanosecondsPerLine(Classifier classify, const unsigned long passes) {
+    const size_t lineCount = sizeof(kRecordedUrcs) / sizeof(kRecordedUrcs[0]);
+    unsigned long checksum = 0;
+
+    const auto start = std::chrono::steady_clock::now();
+
+    for (unsigned long pass = 0; pass < passes; pass++) {
+      for (const char *line : kRecordedUrcs) {
+        // Keeps the compiler from hoisting the calls out of the loop.
+        const char *volatile opaque = line;
+        checksum += static_cast<unsigned long>(classify(opaque));
+      }
+    }
+
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    const double nanoseconds = std::chrono::duration<double, std::nano>(elapsed).count();
+
+    // Printed so the sum is used.
+    printf("  checksum %lu\n", checksum);
+
+    return nanoseconds / (static_cast<double>(passes) * lineCount);
+  }
+}
+
+int main(int argc, char **argv) {
+  const unsigned long passes = argc > 1 ? strtoul(argv[1], nullptr, 10) : kDefaultPasses;
+  int mismatches = 0;
+
+  for (const char *line : kRecordedUrcs) {
+    const UrcType newType = classifyUrc(line);
+    const UrcType oldType = classifyWithPrefixChain(line);
+
+    if (newType != oldType && !isNewerType(newType)) {
+      printf("Mismatch for \"%s\": %d, was %d\n", line, static_cast<int>(newType),
+             static_cast<int>(oldType));
+      ++mismatches;
+    }
+  }
+
+  printf("Prefix chain:\n");
+  const double chain = nanosecondsPerLine(&classifyWithPrefixChain, passes);
+  printf("classifyUrc:\n");
+  const double trie = nanosecondsPerLine(&classifyUrc, passes);
+
+  printf("Prefix chain %.1f ns/line, classifyUrc %.1f ns/line (%.2fx)\n", chain, trie,
+         chain / trie);
+
+  return mismatches == 0 ? 0 : 1;
+}